@@ -0,0 +1,238 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Allocation profiler of the pipeline stages
+//==============================================================
+#include "pch.h"
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <new>
+#include <atomic>
+#include <algorithm>
+
+using namespace std;
+
+#include "AllocProfiler.hpp"
+
+namespace {
+
+	const char* const SZ_ALLOC_STAGES[AllocProfiler::STAGE_COUNT] = {
+		"other", "read feed", "parse csv", "parse log", "build order book", "stream sinks", "build offers",
+		"plot variation", "plot order book", "plot order diff", "plot spread", "plot price diff", "plot wall",
+		"plot liquidity", "plot trades", "inject html", "chart data", "assemble html" };
+}
+
+#ifdef ORDERSTREAM_ALLOC_PROFILE
+
+namespace {
+
+	// Counters of one thread, written by that thread only unless the table ran out of slots
+	struct alignas(64) ThreadCounters {
+		atomic<uint64_t>	vnAllocs[AllocProfiler::STAGE_COUNT];
+		atomic<uint64_t>	vnBytes[AllocProfiler::STAGE_COUNT];
+	};
+
+	// Counters of the blocks, updated by the thread releasing them as well
+	struct alignas(64) StageCounters {
+		atomic<uint64_t>	nFrees;
+		atomic<uint64_t>	nFreedBytes;
+		atomic<int64_t>		nLiveBytes;
+		atomic<int64_t>		nPeakBytes;
+	};
+
+	// Header in front of each block, its size keeps the block aligned as malloc returns it
+	struct AllocHeader {
+		uint64_t	nSize;
+		uint64_t	nStage;
+	};
+
+	static_assert(sizeof(AllocHeader) == 16, "AllocHeader must keep the blocks 16 byte aligned");
+
+	const size_t MAX_THREADS = 256;
+
+	// All static and zero initialized, usable before any constructor of the program runs
+	ThreadCounters				g_vThreads[MAX_THREADS];
+	StageCounters				g_vStages[AllocProfiler::STAGE_COUNT];
+	atomic<size_t>				g_nThreads(0);
+
+	thread_local ThreadCounters*	t_ptc = nullptr;
+	thread_local int				t_nStage = AllocProfiler::STAGE_OTHER;
+
+	// Threads past the size of the table share its last slot
+	inline void addCount(atomic<uint64_t>& anCount, uint64_t nValue, bool bShared) {
+		if (bShared)
+			anCount.fetch_add(nValue, memory_order_relaxed);
+		else
+			anCount.store(anCount.load(memory_order_relaxed) + nValue, memory_order_relaxed);
+	}
+
+	void* allocate(size_t nSize) {
+
+		AllocHeader* pah;
+		while ((pah = static_cast<AllocHeader*>(malloc(nSize + sizeof(AllocHeader)))) == nullptr) {
+			new_handler nh = get_new_handler();
+			if (nh == nullptr)
+				return nullptr;
+			nh();
+		}
+
+		if (t_ptc == nullptr)
+			t_ptc = &g_vThreads[min(g_nThreads.fetch_add(1, memory_order_relaxed), MAX_THREADS - 1)];
+		bool bShared = t_ptc == &g_vThreads[MAX_THREADS - 1];
+
+		int nStage = t_nStage;
+		addCount(t_ptc->vnAllocs[nStage], 1, bShared);
+		addCount(t_ptc->vnBytes[nStage], nSize, bShared);
+
+		StageCounters& sc = g_vStages[nStage];
+		int64_t nLive = sc.nLiveBytes.fetch_add(static_cast<int64_t>(nSize), memory_order_relaxed) + static_cast<int64_t>(nSize);
+		int64_t nPeak = sc.nPeakBytes.load(memory_order_relaxed);
+		while (nLive > nPeak && !sc.nPeakBytes.compare_exchange_weak(nPeak, nLive, memory_order_relaxed))
+			;
+
+		pah->nSize	= nSize;
+		pah->nStage	= static_cast<uint64_t>(nStage);
+		return pah + 1;
+	}
+
+	void release(void* p) {
+
+		if (p == nullptr)
+			return;
+
+		AllocHeader* pah = static_cast<AllocHeader*>(p) - 1;
+		StageCounters& sc = g_vStages[pah->nStage];
+		sc.nFrees.fetch_add(1, memory_order_relaxed);
+		sc.nFreedBytes.fetch_add(pah->nSize, memory_order_relaxed);
+		sc.nLiveBytes.fetch_sub(static_cast<int64_t>(pah->nSize), memory_order_relaxed);
+		free(pah);
+	}
+
+	// Prints the report once the program has returned from main
+	struct AllocReporter {
+		~AllocReporter()	{ AllocProfiler::report(); }
+	} g_allocReporter;
+}
+
+void* operator new(size_t nSize) {
+
+	void* p = allocate(nSize);
+	if (p == nullptr)
+		throw bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t nSize) {
+
+	return operator new(nSize);
+}
+
+void* operator new(size_t nSize, const nothrow_t&) noexcept {
+
+	return allocate(nSize);
+}
+
+void* operator new[](size_t nSize, const nothrow_t&) noexcept {
+
+	return allocate(nSize);
+}
+
+void operator delete(void* p) noexcept						{ release(p); }
+void operator delete[](void* p) noexcept					{ release(p); }
+void operator delete(void* p, size_t) noexcept				{ release(p); }
+void operator delete[](void* p, size_t) noexcept			{ release(p); }
+void operator delete(void* p, const nothrow_t&) noexcept	{ release(p); }
+void operator delete[](void* p, const nothrow_t&) noexcept	{ release(p); }
+
+AllocProfiler::ALLOC_STAGE AllocProfiler::setStage(ALLOC_STAGE eStage) {
+
+	ALLOC_STAGE ePrevious = static_cast<ALLOC_STAGE>(t_nStage);
+	t_nStage = eStage;
+	return ePrevious;
+}
+
+bool AllocProfiler::isEnabled() {
+
+	return true;
+}
+
+AllocProfiler::StageStats AllocProfiler::getStats(ALLOC_STAGE eStage) {
+
+	StageStats ss = StageStats();
+	size_t nThreads = min(g_nThreads.load(memory_order_relaxed), MAX_THREADS);
+	for (size_t i = 0; i < nThreads; ++i) {
+		ss.nAllocs	+= g_vThreads[i].vnAllocs[eStage].load(memory_order_relaxed);
+		ss.nBytes	+= g_vThreads[i].vnBytes[eStage].load(memory_order_relaxed);
+	}
+
+	const StageCounters& sc = g_vStages[eStage];
+	ss.nFrees		= sc.nFrees.load(memory_order_relaxed);
+	ss.nFreedBytes	= sc.nFreedBytes.load(memory_order_relaxed);
+	ss.nPeakBytes	= sc.nPeakBytes.load(memory_order_relaxed);
+	return ss;
+}
+
+#else
+
+AllocProfiler::ALLOC_STAGE AllocProfiler::setStage(ALLOC_STAGE /*eStage*/) {
+
+	return STAGE_OTHER;
+}
+
+bool AllocProfiler::isEnabled() {
+
+	return false;
+}
+
+AllocProfiler::StageStats AllocProfiler::getStats(ALLOC_STAGE /*eStage*/) {
+
+	return StageStats();
+}
+
+#endif
+
+const char* AllocProfiler::getStageName(ALLOC_STAGE eStage) {
+
+	return SZ_ALLOC_STAGES[eStage];
+}
+
+void AllocProfiler::report() {
+
+	if (!isEnabled())
+		return;
+
+	// Take all the counters first, the report allocates as it prints
+	StageStats vss[STAGE_COUNT];
+	int viRank[STAGE_COUNT];
+	StageStats ssTotal = StageStats();
+	for (int i = 0; i < STAGE_COUNT; ++i) {
+		vss[i] = getStats(static_cast<ALLOC_STAGE>(i));
+		viRank[i] = i;
+		ssTotal.nAllocs		+= vss[i].nAllocs;
+		ssTotal.nFrees		+= vss[i].nFrees;
+		ssTotal.nBytes		+= vss[i].nBytes;
+		ssTotal.nFreedBytes	+= vss[i].nFreedBytes;
+	}
+
+	sort(viRank, viRank + STAGE_COUNT, [&vss](int i1, int i2) { return vss[i1].nBytes > vss[i2].nBytes; });
+
+	cout << endl << " Allocations by stage, ranked by allocated bytes" << endl;
+	cout << "   " << left << setw(18) << "stage" << right << setw(14) << "allocs" << setw(16) << "bytes" << setw(8) << "%" << setw(12) << "bytes/alloc"
+		<< setw(16) << "peak live" << setw(14) << "live at exit" << endl;
+
+	for (int i : viRank) {
+
+		const StageStats& ss = vss[i];
+		if (ss.nAllocs == 0)
+			continue;
+
+		double dShare = ssTotal.nBytes ? 100.0 * ss.nBytes / ssTotal.nBytes : 0;
+		cout << "   " << left << setw(18) << getStageName(static_cast<ALLOC_STAGE>(i)) << right << setw(14) << ss.nAllocs << setw(16) << ss.nBytes
+			<< setw(8) << fixed << setprecision(1) << dShare << setw(12) << ss.nBytes / ss.nAllocs
+			<< setw(16) << ss.nPeakBytes << setw(14) << static_cast<int64_t>(ss.nBytes - ss.nFreedBytes) << endl;
+	}
+
+	cout << "   " << left << setw(18) << "total" << right << setw(14) << ssTotal.nAllocs << setw(16) << ssTotal.nBytes << setw(8) << "100.0"
+		<< setw(12) << (ssTotal.nAllocs ? ssTotal.nBytes / ssTotal.nAllocs : 0) << setw(16) << "" << setw(14) << static_cast<int64_t>(ssTotal.nBytes - ssTotal.nFreedBytes) << endl;
+}
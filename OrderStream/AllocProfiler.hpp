@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Heap traffic of the pipeline stages, for builds defining ORDERSTREAM_ALLOC_PROFILE in both projects.
+// The global operator new and delete are replaced: each block carries a small header with its size and the
+// stage that allocated it, so that a free is charged back to that stage whichever thread releases it.
+// Allocation counts and bytes go to counters owned by the allocating thread, taken from a fixed table so the
+// profiler itself never allocates; the bytes still live and their peak are kept per stage. The stage of a
+// thread is set by an AllocScope for the time it is in scope, nested scopes restoring the outer stage, and
+// a report of the stages ranked by allocated bytes is printed when the program exits.
+// Without ORDERSTREAM_ALLOC_PROFILE nothing is replaced and the scopes compile to nothing.
+class AllocProfiler {
+
+public:
+	enum ALLOC_STAGE {
+		STAGE_OTHER = 0,
+		STAGE_READ_FEED,
+		STAGE_PARSE_CSV,
+		STAGE_PARSE_LOG,
+		STAGE_BUILD_BOOK,
+		STAGE_SINKS,
+		STAGE_BUILD_OFFERS,
+		STAGE_PLOT_VARIATION,
+		STAGE_PLOT_ORDERBOOK,
+		STAGE_PLOT_ORDERDIFF,
+		STAGE_PLOT_SPREAD,
+		STAGE_PLOT_PRICEDIFF,
+		STAGE_PLOT_WALL,
+		STAGE_PLOT_LIQUIDITY,
+		STAGE_PLOT_TRADES,
+		STAGE_INJECT_HTML,
+		STAGE_CHART_DATA,
+		STAGE_ASSEMBLE_HTML,
+		STAGE_COUNT
+	};
+
+	typedef struct StageStats {
+		uint64_t	nAllocs;
+		uint64_t	nFrees;
+		uint64_t	nBytes;			// Bytes allocated by the stage
+		uint64_t	nFreedBytes;	// Bytes of the stage released, by any stage
+		int64_t		nPeakBytes;		// Highest bytes of the stage live at once
+	} StageStats;
+
+	// Stage of the calling thread, returns the previous one
+	static ALLOC_STAGE setStage(ALLOC_STAGE eStage);
+
+	static const char* getStageName(ALLOC_STAGE eStage);
+	static bool isEnabled();
+
+	// Counters of a stage summed over all threads, and the ranked report of all the stages
+	static StageStats getStats(ALLOC_STAGE eStage);
+	static void report();
+};
+
+// Charges the allocations of the calling thread to a stage while in scope
+class AllocScope {
+
+public:
+#ifdef ORDERSTREAM_ALLOC_PROFILE
+	explicit AllocScope(AllocProfiler::ALLOC_STAGE eStage) : m_ePrevious(AllocProfiler::setStage(eStage)) {}
+	~AllocScope()	{ AllocProfiler::setStage(m_ePrevious); }
+#else
+	explicit AllocScope(AllocProfiler::ALLOC_STAGE /*eStage*/) {}
+#endif
+
+	AllocScope(const AllocScope&) = delete;
+	AllocScope& operator=(const AllocScope&) = delete;
+
+#ifdef ORDERSTREAM_ALLOC_PROFILE
+private:
+	AllocProfiler::ALLOC_STAGE	m_ePrevious;
+#endif
+};
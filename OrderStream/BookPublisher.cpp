@@ -0,0 +1,57 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Live publication of the book of a stream to reader threads
+//==============================================================
+#include "pch.h"
+#include <algorithm>
+#include <boost/regex.hpp>
+#include <boost/make_shared.hpp>
+
+using namespace std;
+using namespace boost;
+
+#include "BookPublisher.hpp"
+
+BookPublisher::BookPublisher(int nSnapshotRows) : m_nSnapshotRows(max(nSnapshotRows, 1)), m_nRowsSinceSnapshot(0), m_bComplete(false) {
+
+	TopOfBook tob = { -1, FeedClock::TIME_INVALID, 0, 0, 0, 0 };
+	m_slTop.store(tob);
+}
+
+void BookPublisher::onRow(const OBStream& obs, const OBRowFeed& obrf, int iRow) {
+
+	TopOfBook tob = { iRow, obrf.nTimestamp, obrf.pairBidPriceSize.first, obrf.pairBidPriceSize.second, obrf.pairAskPriceSize.first, obrf.pairAskPriceSize.second };
+	m_slTop.store(tob);
+
+	if (++m_nRowsSinceSnapshot >= m_nSnapshotRows)
+		publish(obrf, iRow, false);
+}
+
+void BookPublisher::onBook(OBStream& obs) {
+
+	// The last row is always published, marked as complete
+	if (obs.getNumRows() > 0)
+		publish(obs.getRowFeedAt(obs.getNumRows() - 1), obs.getNumRows() - 1, true);
+	else
+		publish(OBRowFeed(), -1, true);
+
+	m_bComplete.store(true, std::memory_order_release);
+}
+
+void BookPublisher::publish(const OBRowFeed& obrf, int iRow, bool bComplete) {
+
+	// Build the new version aside then swap it in, the previous one lives on while readers hold it
+	boost::shared_ptr<BookSnapshot> pbs = boost::make_shared<BookSnapshot>();
+	pbs->iRow = iRow;
+	pbs->bComplete = bComplete;
+	pbs->obrf = obrf;
+
+	boost::atomic_store(&m_pSnapshot, boost::shared_ptr<const BookSnapshot>(pbs));
+	m_nRowsSinceSnapshot = 0;
+}
+
+boost::shared_ptr<const BookSnapshot> BookPublisher::getSnapshot() const {
+
+	return boost::atomic_load(&m_pSnapshot);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstdint>
+
+#include "OrderStream.hpp"
+#include "SeqLock.hpp"
+
+// Best bid and ask of the last row of a stream
+typedef struct TopOfBook {
+
+	int64_t		nRow;			// Row of the stream, -1 before the first row
+	int64_t		nTimestamp;
+	int64_t		nBidPrice;
+	int64_t		nBidSize;
+	int64_t		nAskPrice;
+	int64_t		nAskSize;
+
+} TopOfBook;
+
+// Immutable version of the book of a stream at one of its rows
+typedef struct BookSnapshot {
+
+	int			iRow;
+	bool		bComplete;		// The stream has no more rows
+	OBRowFeed	obrf;			// Row holding the book levels
+
+} BookSnapshot;
+
+// Publishes the book of a stream while it is built, for readers on other threads such as a live view or
+// queries. It is a sink of the stream and runs on the builder thread:
+//  - the top of book of every row is written under a seqlock, a few stores that never wait on the readers
+//  - every N rows, and on the last row, the full book is copied into a new immutable snapshot and the shared
+//    pointer to the current one is swapped. Readers holding an older snapshot keep it alive until they
+//    release it, so the writer never frees a version still being read.
+// Readers get consistent versions without taking a lock the writer waits on.
+class BookPublisher : public OBSink {
+
+public:
+	BookPublisher() = delete;
+	explicit BookPublisher(int nSnapshotRows);
+
+	void onRow(const OBStream& obs, const OBRowFeed& obrf, int iRow);
+	void onBook(OBStream& obs);
+
+	// Reader side, any thread
+	uint64_t getTopOfBook(TopOfBook& tob) const			{ return m_slTop.load(tob); }
+	boost::shared_ptr<const BookSnapshot> getSnapshot() const;
+	bool isComplete() const								{ return m_bComplete.load(std::memory_order_acquire); }
+
+private:
+	void publish(const OBRowFeed& obrf, int iRow, bool bComplete);
+
+private:
+	int										m_nSnapshotRows;
+	int										m_nRowsSinceSnapshot;
+
+	SeqLock<TopOfBook>						m_slTop;
+	boost::shared_ptr<const BookSnapshot>	m_pSnapshot;
+	std::atomic<bool>						m_bComplete;
+};
@@ -0,0 +1,162 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Sidecar chart data file of the trade plot
+//==============================================================
+#include "pch.h"
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <boost/algorithm/string.hpp>
+
+using namespace std;
+
+#include "ChartData.hpp"
+
+ChartDataWriter::ChartDataWriter(const string& szFile, DATA_MODE eMode) : m_szFile(szFile), m_eMode(eMode) {
+	m_szBuffer.reserve(WRITE_BUFFER_SIZE);
+}
+
+ChartDataWriter::DATA_MODE ChartDataWriter::getMode(const string& szMode) {
+
+	if (boost::iequals(szMode, "json"))
+		return DATA_JSON;
+
+	if (boost::iequals(szMode, "binary"))
+		return DATA_BINARY;
+
+	return DATA_INLINE;
+}
+
+const char* ChartDataWriter::getModeName(DATA_MODE eMode) {
+
+	switch (eMode) {
+	case DATA_JSON:		return "json";
+	case DATA_BINARY:	return "binary";
+	default:			return "inline";
+	}
+}
+
+void ChartDataWriter::flush() {
+
+	if (!m_szBuffer.empty()) {
+		m_ofs.write(m_szBuffer.data(), m_szBuffer.size());
+		m_szBuffer.clear();
+	}
+}
+
+void ChartDataWriter::put(const char* p, size_t n) {
+
+	if (m_szBuffer.size() + n > WRITE_BUFFER_SIZE)
+		flush();
+	m_szBuffer.append(p, n);
+}
+
+void ChartDataWriter::putUint32(uint32_t n) {
+
+	// Little-endian whatever the host order
+	char b[4] = { static_cast<char>(n), static_cast<char>(n >> 8), static_cast<char>(n >> 16), static_cast<char>(n >> 24) };
+	put(b, sizeof(b));
+}
+
+void ChartDataWriter::putPadded(const string& sz) {
+
+	// Length, then the bytes padded to 4 so that the columns stay aligned for typed arrays
+	putUint32(static_cast<uint32_t>(sz.size()));
+	put(sz);
+	static const char PAD[4] = { 0, 0, 0, 0 };
+	put(PAD, (4 - sz.size() % 4) % 4);
+}
+
+bool ChartDataWriter::write(const vector<ChartSeries>& vSeries) {
+
+	if (m_eMode == DATA_INLINE)
+		return true;
+
+	m_ofs.open(m_szFile, ios_base::out | ios_base::binary | ios_base::trunc);
+	if (!m_ofs.is_open())
+		return false;
+
+	if (m_eMode == DATA_JSON)
+		writeJson(vSeries);
+	else
+		writeBinary(vSeries);
+
+	flush();
+	m_ofs.close();
+	return !m_ofs.fail();
+}
+
+void ChartDataWriter::writeJson(const vector<ChartSeries>& vSeries) {
+
+	put("chartDataLoaded({\n");
+
+	for (size_t s = 0; s < vSeries.size(); ++s) {
+
+		const ChartSeries& cs = vSeries[s];
+		size_t nRows = cs.vColumns.empty() ? 0 : cs.vColumns[0].size();
+
+		put("\"" + cs.szName + "\":{\"columns\":[");
+		for (size_t c = 0; c < cs.vColumnNames.size(); ++c)
+			put((c ? ",\"" : "\"") + cs.vColumnNames[c] + "\"");
+		put("],\"rows\":" + to_string(nRows) + ",\"data\":[");
+
+		char sz[32];
+		for (size_t c = 0; c < cs.vColumns.size(); ++c) {
+
+			put(c ? ",\n[" : "\n[");
+			const vector<double>& vd = cs.vColumns[c];
+			for (size_t i = 0; i < vd.size(); ++i) {
+
+				int n;
+				if (std::isnan(vd[i]))
+					n = snprintf(sz, sizeof(sz), i ? ",null" : "null");
+				else if (cs.bInteger)
+					n = snprintf(sz, sizeof(sz), i ? ",%lld" : "%lld", static_cast<long long>(vd[i]));
+				else
+					n = snprintf(sz, sizeof(sz), i ? ",%.7g" : "%.7g", vd[i]);
+				put(sz, n);
+			}
+			put("]");
+		}
+		put(s + 1 < vSeries.size() ? "]},\n" : "]}\n");
+	}
+
+	put("});\n");
+}
+
+void ChartDataWriter::writeBinary(const vector<ChartSeries>& vSeries) {
+
+	putUint32(DATA_MAGIC);
+	putUint32(DATA_VERSION);
+	putUint32(static_cast<uint32_t>(vSeries.size()));
+	putUint32(0);
+
+	for (const ChartSeries& cs : vSeries) {
+
+		uint32_t nRows = cs.vColumns.empty() ? 0 : static_cast<uint32_t>(cs.vColumns[0].size());
+
+		putUint32(static_cast<uint32_t>(cs.vColumns.size()));
+		putUint32(nRows);
+		putUint32(cs.bInteger ? DATA_INT32 : DATA_FLOAT32);
+		putPadded(cs.szName);
+		for (const string& szColumn : cs.vColumnNames)
+			putPadded(szColumn);
+
+		// Whole columns one after the other, 4 bytes per value
+		for (const vector<double>& vd : cs.vColumns) {
+			for (double d : vd) {
+
+				uint32_t u;
+				if (cs.bInteger) {
+					u = static_cast<uint32_t>(static_cast<int32_t>(d));
+				}
+				else {
+					float f = static_cast<float>(d);
+					memcpy(&u, &f, sizeof(u));
+				}
+				putUint32(u);
+			}
+		}
+	}
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+
+using namespace std;
+
+// Numeric columns of one chart, one value per row of the chart. Rows are numbered from 0 and the row
+// number is not stored. NaN values are left as gaps in the chart.
+typedef struct ChartSeries {
+
+	string					szName;
+	vector<string>			vColumnNames;
+	bool					bInteger;		// Values are whole numbers that fit in 32 bits
+	vector<vector<double>>	vColumns;
+
+} ChartSeries;
+
+// Writes the per row chart series to a sidecar file that tradebar.htm loads when a chart first needs it,
+// instead of inlining every row as JavaScript text in the page.
+//   DATA_JSON		a script calling chartDataLoaded({...}) with one array per column, loadable from file://
+//   DATA_BINARY	little-endian int32/float32 columns read as typed arrays, the page must be served over http
+// Output goes through one large buffer flushed in big writes.
+class ChartDataWriter {
+
+public:
+	enum DATA_MODE {
+		DATA_INLINE = 0,
+		DATA_JSON,
+		DATA_BINARY
+	};
+
+	ChartDataWriter() = delete;
+	ChartDataWriter(const string& szFile, DATA_MODE eMode);
+
+	// Write all the series, return false when the file can't be written
+	bool write(const vector<ChartSeries>& vSeries);
+
+	static DATA_MODE getMode(const string& szMode);
+	static const char* getModeName(DATA_MODE eMode);
+
+private:
+	void writeJson(const vector<ChartSeries>& vSeries);
+	void writeBinary(const vector<ChartSeries>& vSeries);
+
+	void put(const char* p, size_t n);
+	void put(const string& sz)			{ put(sz.data(), sz.size()); }
+	void putUint32(uint32_t n);
+	void putPadded(const string& sz);
+	void flush();
+
+private:
+	string		m_szFile;
+	DATA_MODE	m_eMode;
+	ofstream	m_ofs;
+	string		m_szBuffer;
+
+	static constexpr size_t WRITE_BUFFER_SIZE	= 1 << 20;
+	static constexpr uint32_t DATA_MAGIC		= 0x4443534F;	// "OSCD"
+	static constexpr uint32_t DATA_VERSION		= 1;
+	static constexpr uint32_t DATA_INT32		= 1;
+	static constexpr uint32_t DATA_FLOAT32		= 2;
+};
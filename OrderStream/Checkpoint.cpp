@@ -0,0 +1,444 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Checkpoint and resume of the parse state of a stream
+//==============================================================
+#include "pch.h"
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <cstring>
+#include <boost/regex.hpp>
+#include <boost/filesystem.hpp>
+
+using namespace std;
+using namespace boost;
+
+#include "Checkpoint.hpp"
+
+namespace {
+
+	// Fixed layout of the checkpoint header, all values are little-endian
+	struct CheckpointHeader {
+		uint32_t	nMagic;
+		uint32_t	nVersion;
+		uint64_t	nRows;
+		uint64_t	nJournalBytes;
+	};
+
+	const size_t JOURNAL_BUFFER_SIZE = 1 << 16;
+
+	// Zigzag then 7 bits per byte, the same encoding as the series columns
+	void putVarint(string& sz, uint64_t u) {
+		while (u >= 0x80) {
+			sz += static_cast<char>(u | 0x80);
+			u >>= 7;
+		}
+		sz += static_cast<char>(u);
+	}
+
+	void putSigned(string& sz, int64_t n) {
+		putVarint(sz, (static_cast<uint64_t>(n) << 1) ^ static_cast<uint64_t>(n >> 63));
+	}
+
+	void putDelta(string& sz, int64_t nValue, int64_t nPrev) {
+		putSigned(sz, static_cast<int64_t>(static_cast<uint64_t>(nValue) - static_cast<uint64_t>(nPrev)));
+	}
+
+	void putString(string& sz, const string& szValue) {
+		putVarint(sz, szValue.size());
+		sz += szValue;
+	}
+
+	// Decoders step over the bytes they read and return false on a truncated record
+	bool getVarint(const char*& p, const char* pEnd, uint64_t& u) {
+		u = 0;
+		for (int nShift = 0; p < pEnd && nShift < 64; nShift += 7) {
+			uint8_t b = static_cast<uint8_t>(*p++);
+			u |= static_cast<uint64_t>(b & 0x7f) << nShift;
+			if (!(b & 0x80))
+				return true;
+		}
+		return false;
+	}
+
+	bool getSigned(const char*& p, const char* pEnd, int64_t& n) {
+		uint64_t u;
+		if (!getVarint(p, pEnd, u))
+			return false;
+		n = static_cast<int64_t>(u >> 1) ^ -static_cast<int64_t>(u & 1);
+		return true;
+	}
+
+	bool getDelta(const char*& p, const char* pEnd, int64_t nPrev, int64_t& nValue) {
+		int64_t nDelta;
+		if (!getSigned(p, pEnd, nDelta))
+			return false;
+		nValue = static_cast<int64_t>(static_cast<uint64_t>(nPrev) + static_cast<uint64_t>(nDelta));
+		return true;
+	}
+
+	bool getString(const char*& p, const char* pEnd, string& szValue) {
+		uint64_t nLen;
+		if (!getVarint(p, pEnd, nLen) || nLen > static_cast<uint64_t>(pEnd - p))
+			return false;
+		szValue.assign(p, static_cast<size_t>(nLen));
+		p += nLen;
+		return true;
+	}
+
+	bool getLong(const char*& p, const char* pEnd, int64_t nPrev, long& lValue) {
+		int64_t nValue;
+		if (!getDelta(p, pEnd, nPrev, nValue))
+			return false;
+		lValue = static_cast<long>(nValue);
+		return true;
+	}
+
+	enum ROWFLAG_ID {
+		ROWFLAG_INSTRUMENT	= 1,	// Instrument differs from the previous row
+		ROWFLAG_STATUS		= 2,	// Trading status differs from the previous row
+		ROWFLAG_TRADE		= 4		// Row has a latest trade or an accumulated volume
+	};
+
+	// Levels are stored from the best price, each one relative to the previous
+	void putLevels(string& sz, const vector<pairPriceSize>& vp, long lBest) {
+		putVarint(sz, vp.size());
+		long lPrev = lBest;
+		for (const pairPriceSize& pps : vp) {
+			putDelta(sz, pps.first, lPrev);
+			putSigned(sz, pps.second);
+			lPrev = pps.first;
+		}
+	}
+
+	bool getLevels(const char*& p, const char* pEnd, vector<pairPriceSize>& vp, long lBest) {
+		uint64_t nLevels;
+		if (!getVarint(p, pEnd, nLevels) || nLevels > static_cast<uint64_t>(pEnd - p))
+			return false;
+
+		vp.resize(static_cast<size_t>(nLevels));
+		long lPrev = lBest;
+		for (pairPriceSize& pps : vp) {
+			int64_t nSize;
+			if (!getLong(p, pEnd, lPrev, pps.first) || !getSigned(p, pEnd, nSize))
+				return false;
+			pps.second = static_cast<long>(nSize);
+			lPrev = pps.first;
+		}
+		return true;
+	}
+
+	void encodeRow(string& sz, const OBRowFeed& obrf, Checkpoint::RowContext& rc) {
+
+		unsigned nFlags = 0;
+		if (obrf.szInstrument != rc.szInstrument)
+			nFlags |= ROWFLAG_INSTRUMENT;
+		if (obrf.szFeedStat != rc.szFeedStat)
+			nFlags |= ROWFLAG_STATUS;
+		if (obrf.nVolume != 0 || obrf.pairLastTrade.first != 0 || obrf.pairLastTrade.second != 0)
+			nFlags |= ROWFLAG_TRADE;
+
+		putVarint(sz, nFlags);
+		if (nFlags & ROWFLAG_INSTRUMENT)
+			putString(sz, obrf.szInstrument);
+		if (nFlags & ROWFLAG_STATUS)
+			putString(sz, obrf.szFeedStat);
+		putString(sz, obrf.datetime);
+
+		putDelta(sz, obrf.nTimestamp, rc.nTimestamp);
+		putDelta(sz, obrf.nTimestampLast, obrf.nTimestamp);
+		putVarint(sz, static_cast<uint64_t>(obrf.nRepeat));
+
+		putDelta(sz, obrf.pairBidPriceSize.first, rc.lBid);
+		putSigned(sz, obrf.pairBidPriceSize.second);
+		putDelta(sz, obrf.pairAskPriceSize.first, rc.lAsk);
+		putSigned(sz, obrf.pairAskPriceSize.second);
+
+		putLevels(sz, obrf.vecBidLevels, obrf.pairBidPriceSize.first);
+		putLevels(sz, obrf.vecAskLevels, obrf.pairAskPriceSize.first);
+
+		if (nFlags & ROWFLAG_TRADE) {
+			putSigned(sz, obrf.nVolume);
+			putSigned(sz, obrf.pairLastTrade.first);
+			putSigned(sz, obrf.pairLastTrade.second);
+		}
+
+		if (nFlags & ROWFLAG_INSTRUMENT)
+			rc.szInstrument = obrf.szInstrument;
+		if (nFlags & ROWFLAG_STATUS)
+			rc.szFeedStat = obrf.szFeedStat;
+		rc.nTimestamp	= obrf.nTimestamp;
+		rc.lBid			= obrf.pairBidPriceSize.first;
+		rc.lAsk			= obrf.pairAskPriceSize.first;
+	}
+
+	bool decodeRow(const char*& p, const char* pEnd, OBRowFeed& obrf, Checkpoint::RowContext& rc) {
+
+		uint64_t nFlags, nRepeat;
+		int64_t nSize;
+		if (!getVarint(p, pEnd, nFlags))
+			return false;
+		if ((nFlags & ROWFLAG_INSTRUMENT) && !getString(p, pEnd, rc.szInstrument))
+			return false;
+		if ((nFlags & ROWFLAG_STATUS) && !getString(p, pEnd, rc.szFeedStat))
+			return false;
+
+		obrf.szInstrument	= rc.szInstrument;
+		obrf.szFeedStat		= rc.szFeedStat;
+		if (!getString(p, pEnd, obrf.datetime))
+			return false;
+
+		if (!getDelta(p, pEnd, rc.nTimestamp, obrf.nTimestamp) || !getDelta(p, pEnd, obrf.nTimestamp, obrf.nTimestampLast) || !getVarint(p, pEnd, nRepeat))
+			return false;
+		obrf.nRepeat = static_cast<int>(nRepeat);
+
+		if (!getLong(p, pEnd, rc.lBid, obrf.pairBidPriceSize.first) || !getSigned(p, pEnd, nSize))
+			return false;
+		obrf.pairBidPriceSize.second = static_cast<long>(nSize);
+
+		if (!getLong(p, pEnd, rc.lAsk, obrf.pairAskPriceSize.first) || !getSigned(p, pEnd, nSize))
+			return false;
+		obrf.pairAskPriceSize.second = static_cast<long>(nSize);
+
+		if (!getLevels(p, pEnd, obrf.vecBidLevels, obrf.pairBidPriceSize.first) || !getLevels(p, pEnd, obrf.vecAskLevels, obrf.pairAskPriceSize.first))
+			return false;
+
+		obrf.nVolume = 0;
+		obrf.pairLastTrade = make_pair(0L, 0L);
+		if (nFlags & ROWFLAG_TRADE) {
+			int64_t nPrice;
+			if (!getSigned(p, pEnd, obrf.nVolume) || !getSigned(p, pEnd, nPrice) || !getSigned(p, pEnd, nSize))
+				return false;
+			obrf.pairLastTrade = make_pair(static_cast<long>(nPrice), static_cast<long>(nSize));
+		}
+
+		rc.nTimestamp	= obrf.nTimestamp;
+		rc.lBid			= obrf.pairBidPriceSize.first;
+		rc.lAsk			= obrf.pairAskPriceSize.first;
+		return true;
+	}
+
+	// A single row of the checkpoint state is encoded on its own
+	void encodeRow(string& sz, const OBRowFeed& obrf) {
+		Checkpoint::RowContext rc = Checkpoint::RowContext();
+		encodeRow(sz, obrf, rc);
+	}
+
+	bool decodeRow(const char*& p, const char* pEnd, OBRowFeed& obrf) {
+		Checkpoint::RowContext rc = Checkpoint::RowContext();
+		return decodeRow(p, pEnd, obrf, rc);
+	}
+
+	bool getFeedStamp(const string& szFile, uint64_t& nSize, int64_t& nTime) {
+
+		boost::system::error_code ec;
+		nSize = boost::filesystem::file_size(szFile, ec);
+		if (ec)
+			return false;
+
+		nTime = static_cast<int64_t>(boost::filesystem::last_write_time(szFile, ec));
+		return !ec;
+	}
+
+	bool readFile(const string& szFile, uint64_t nBytes, string& sz) {
+
+		ifstream ifs(szFile, ios_base::in | ios_base::binary);
+		if (!ifs.is_open())
+			return false;
+
+		sz.resize(static_cast<size_t>(nBytes));
+		return nBytes == 0 || ifs.read(&sz[0], sz.size());
+	}
+}
+
+Checkpoint::Checkpoint(const string& szFile, int nEveryRows) :
+	m_szFile(szFile), m_szJournalFile(szFile + ".rows"), m_rc(), m_nRows(0), m_nJournalBytes(0) {
+
+	m_nEveryRows	= max(nEveryRows, 1);
+	m_nNextSave		= m_nEveryRows;
+}
+
+bool Checkpoint::load(const vector<string>& vFiles, CheckpointState& cs, vector<OBRowFeed>& vRows) {
+
+	string szState;
+	{
+		ifstream ifs(m_szFile, ios_base::in | ios_base::binary);
+		if (!ifs.is_open())
+			return false;
+		szState.assign(istreambuf_iterator<char>(ifs), istreambuf_iterator<char>());
+	}
+
+	CheckpointHeader ch;
+	if (szState.size() < sizeof(ch))
+		return false;
+	memcpy(&ch, szState.data(), sizeof(ch));
+	if (ch.nMagic != CHECKPOINT_MAGIC || ch.nVersion != CHECKPOINT_VERSION)
+		return false;
+
+	const char* p = szState.data() + sizeof(ch);
+	const char* pEnd = szState.data() + szState.size();
+
+	// The checkpoint only holds for the same feed files, unchanged since it was written
+	uint64_t nSources;
+	if (!getVarint(p, pEnd, nSources) || nSources != vFiles.size())
+		return false;
+
+	cs.vSources.resize(vFiles.size());
+	for (size_t i = 0; i < vFiles.size(); ++i) {
+
+		CheckpointSource& csrc = cs.vSources[i];
+		uint64_t nSize, nSizeNow, nFlags;
+		int64_t nTime, nTimeNow;
+		if (!getString(p, pEnd, csrc.szFile) || csrc.szFile != vFiles[i])
+			return false;
+		if (!getVarint(p, pEnd, nSize) || !getSigned(p, pEnd, nTime) || !getFeedStamp(csrc.szFile, nSizeNow, nTimeNow) || nSize != nSizeNow || nTime != nTimeNow)
+			return false;
+		if (!getVarint(p, pEnd, csrc.nOffset) || !getSigned(p, pEnd, csrc.nFeedRow) || !getVarint(p, pEnd, nFlags))
+			return false;
+
+		csrc.bEndOfFeed	= (nFlags & 1) != 0;
+		csrc.bHasNext	= (nFlags & 2) != 0;
+		csrc.obrfNext	= OBRowFeed();
+		if (csrc.bHasNext && !decodeRow(p, pEnd, csrc.obrfNext))
+			return false;
+	}
+
+	uint64_t nPending;
+	if (!getVarint(p, pEnd, nPending) || !getVarint(p, pEnd, cs.nConflatedIn) || !getVarint(p, pEnd, cs.nConflatedOut))
+		return false;
+	cs.bPending = nPending != 0;
+	cs.obrfPending = OBRowFeed();
+	if (cs.bPending && !decodeRow(p, pEnd, cs.obrfPending))
+		return false;
+
+	// Rows past the checkpoint may have been journaled before the run stopped, they are parsed again
+	string szJournal;
+	if (!readFile(m_szJournalFile, ch.nJournalBytes, szJournal))
+		return false;
+
+	vector<OBRowFeed> vJournal;
+	vJournal.reserve(static_cast<size_t>(ch.nRows));
+	RowContext rc = RowContext();
+	p = szJournal.data();
+	pEnd = szJournal.data() + szJournal.size();
+	for (uint64_t nRow = 0; nRow < ch.nRows; ++nRow) {
+		vJournal.push_back(OBRowFeed());
+		if (!decodeRow(p, pEnd, vJournal.back(), rc))
+			return false;
+	}
+
+	vRows.swap(vJournal);
+	m_rc			= rc;
+	m_nRows			= ch.nRows;
+	m_nJournalBytes	= ch.nJournalBytes;
+	m_nNextSave		= m_nRows + m_nEveryRows;
+	return true;
+}
+
+void Checkpoint::open(bool bResume) {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_CHECKPOINT_OPEN = "Checkpoint::open";
+
+	if (bResume) {
+		// Drop the rows journaled after the checkpoint before appending to it
+		boost::system::error_code ec;
+		boost::filesystem::resize_file(m_szJournalFile, m_nJournalBytes, ec);
+		if (!ec)
+			m_ofsJournal.open(m_szJournalFile, ios_base::out | ios_base::binary | ios_base::app);
+	}
+	else {
+		m_rc			= RowContext();
+		m_nRows			= 0;
+		m_nJournalBytes	= 0;
+		m_nNextSave		= m_nEveryRows;
+		m_ofsJournal.open(m_szJournalFile, ios_base::out | ios_base::binary | ios_base::trunc);
+	}
+
+	if (!m_ofsJournal.is_open()) {
+		TracedException te(SZ_CHECKPOINT_EXCEPTION, "Unable to open checkpoint journal " + m_szJournalFile, SZ_CHECKPOINT_OPEN);
+		throw te;
+	}
+	m_szBuffer.reserve(JOURNAL_BUFFER_SIZE + 4096);
+}
+
+bool Checkpoint::addRow(const OBRowFeed& obrf) {
+
+	size_t nSize = m_szBuffer.size();
+	encodeRow(m_szBuffer, obrf, m_rc);
+	m_nJournalBytes += m_szBuffer.size() - nSize;
+	++m_nRows;
+
+	if (m_szBuffer.size() >= JOURNAL_BUFFER_SIZE) {
+		m_ofsJournal.write(m_szBuffer.data(), m_szBuffer.size());
+		m_szBuffer.clear();
+	}
+
+	if (m_nRows < m_nNextSave)
+		return false;
+
+	m_nNextSave = m_nRows + m_nEveryRows;
+	return true;
+}
+
+bool Checkpoint::save(const CheckpointState& cs) {
+
+	// The journal has to hold every row the checkpoint covers before the checkpoint is replaced
+	m_ofsJournal.write(m_szBuffer.data(), m_szBuffer.size());
+	m_ofsJournal.flush();
+	m_szBuffer.clear();
+	if (!m_ofsJournal)
+		return false;
+
+	CheckpointHeader ch;
+	ch.nMagic			= CHECKPOINT_MAGIC;
+	ch.nVersion			= CHECKPOINT_VERSION;
+	ch.nRows			= m_nRows;
+	ch.nJournalBytes	= m_nJournalBytes;
+
+	string szState(reinterpret_cast<const char*>(&ch), sizeof(ch));
+	putVarint(szState, cs.vSources.size());
+	for (const CheckpointSource& csrc : cs.vSources) {
+
+		uint64_t nSize = 0;
+		int64_t nTime = 0;
+		if (!getFeedStamp(csrc.szFile, nSize, nTime))
+			return false;
+
+		putString(szState, csrc.szFile);
+		putVarint(szState, nSize);
+		putSigned(szState, nTime);
+		putVarint(szState, csrc.nOffset);
+		putSigned(szState, csrc.nFeedRow);
+		putVarint(szState, (csrc.bEndOfFeed ? 1 : 0) | (csrc.bHasNext ? 2 : 0));
+		if (csrc.bHasNext)
+			encodeRow(szState, csrc.obrfNext);
+	}
+
+	putVarint(szState, cs.bPending ? 1 : 0);
+	putVarint(szState, cs.nConflatedIn);
+	putVarint(szState, cs.nConflatedOut);
+	if (cs.bPending)
+		encodeRow(szState, cs.obrfPending);
+
+	// Write next to the final name and rename so that a crash never leaves a partial checkpoint
+	string szTemp = m_szFile + ".tmp";
+	boost::system::error_code ec;
+	{
+		ofstream ofs(szTemp, ios_base::out | ios_base::binary | ios_base::trunc);
+		if (!ofs.is_open())
+			return false;
+
+		// The state is only complete once the close flushed it, a torn file must never replace the checkpoint
+		ofs.write(szState.data(), szState.size());
+		ofs.close();
+		if (!ofs) {
+			boost::filesystem::remove(szTemp, ec);
+			return false;
+		}
+	}
+
+	boost::filesystem::rename(szTemp, m_szFile, ec);
+	return !ec;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <fstream>
+#include <cstdint>
+
+#include "OrderStream.hpp"
+
+// Position of one feed file of a stream at a checkpoint, with the row read ahead of it when files are merged
+typedef struct CheckpointSource {
+
+	string		szFile;
+	uint64_t	nOffset;		// Byte offset of the next line in the (decompressed) feed
+	int64_t		nFeedRow;		// Row number of the next line, header excluded
+	bool		bEndOfFeed;
+	bool		bHasNext;
+	OBRowFeed	obrfNext;
+
+} CheckpointSource;
+
+// Parse state of a stream at a checkpoint
+typedef struct CheckpointState {
+
+	vector<CheckpointSource>	vSources;
+
+	// Row held back by the conflator and its counters
+	bool						bPending;
+	OBRowFeed					obrfPending;
+	uint64_t					nConflatedIn;
+	uint64_t					nConflatedOut;
+
+} CheckpointState;
+
+// Periodic checkpoint of a stream so that a long run can resume after a crash or a kill. The rows handed to
+// the order book are appended to a delta encoded journal (<checkpoint>.rows) as they are parsed, and every
+// N rows the parse state is written to the checkpoint file next to a temporary name and renamed over it:
+// the offset and row of each feed file, the rows read ahead of the merge and the row held by the conflator,
+// along with the number of journaled rows it covers. A resumed run reloads the journal, folds it back into
+// the order book aggregates and offer maps, and carries on parsing from the saved offsets, so only the feed
+// after the checkpoint is parsed again. A checkpoint of other feed files, or of files changed since, is ignored.
+class Checkpoint {
+
+public:
+	Checkpoint() = delete;
+	Checkpoint(const string& szFile, int nEveryRows);
+
+	// Load the state and the journaled rows of the checkpoint, return false when it is missing, stale or of other files
+	bool load(const vector<string>& vFiles, CheckpointState& cs, vector<OBRowFeed>& vRows);
+
+	// Start the journal from scratch, or after the rows of the loaded checkpoint
+	void open(bool bResume);
+
+	// Journal a row handed to the order book, return true when a checkpoint is due
+	bool addRow(const OBRowFeed& obrf);
+
+	// Write the parse state covering the rows journaled so far, return false when it can't be written
+	bool save(const CheckpointState& cs);
+
+	uint64_t getRows() const					{ return m_nRows; }
+	const string& getFile() const				{ return m_szFile; }
+
+	// Last row of the journal, the next row is encoded relative to it
+	typedef struct RowContext {
+		string		szInstrument;
+		string		szFeedStat;
+		int64_t		nTimestamp;
+		long		lBid;
+		long		lAsk;
+	} RowContext;
+
+private:
+	string			m_szFile;
+	string			m_szJournalFile;
+	int64_t			m_nEveryRows;
+
+	ofstream		m_ofsJournal;
+	string			m_szBuffer;
+	RowContext		m_rc;
+	uint64_t		m_nRows;
+	uint64_t		m_nJournalBytes;
+	uint64_t		m_nNextSave;
+
+	static constexpr uint32_t CHECKPOINT_MAGIC		= 0x4B43534F;	// "OSCK"
+	static constexpr uint32_t CHECKPOINT_VERSION	= 1;
+	static constexpr auto SZ_CHECKPOINT_EXCEPTION	= "Checkpoint Exception";
+};
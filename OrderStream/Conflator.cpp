@@ -0,0 +1,175 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Conflation of consecutive feed rows before book building
+//==============================================================
+#include "pch.h"
+#include <iostream>
+#include <vector>
+#include <boost/regex.hpp>
+#include <boost/algorithm/string.hpp>
+
+using namespace std;
+using namespace boost;
+
+#include "Conflator.hpp"
+
+namespace {
+
+	const uint64_t FNV_OFFSET	= 0xcbf29ce484222325ULL;
+	const uint64_t FNV_PRIME	= 0x100000001b3ULL;
+
+	inline uint64_t mixValue(uint64_t h, uint64_t v) {
+		return (h ^ v) * FNV_PRIME;
+	}
+
+	// Spread the bits of the final value so that close book states give unrelated hashes
+	inline uint64_t finalize(uint64_t h) {
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		h *= 0xc4ceb9fe1a85ec53ULL;
+		h ^= h >> 33;
+		return h;
+	}
+}
+
+Conflator::Conflator(CONFLATION_ID eMode, int nIntervalMs) :
+	m_eMode(eMode), m_bPending(false), m_nPendingHash(0), m_nRowsIn(0), m_nRowsOut(0) {
+
+	m_nIntervalNs = static_cast<int64_t>(max(nIntervalMs, 1)) * FeedClock::NS_PER_MS;
+}
+
+Conflator::CONFLATION_ID Conflator::getMode(const string& szMode) {
+
+	if (boost::iequals(szMode, "duplicate"))
+		return CONFLATION_DUPLICATE;
+
+	if (boost::iequals(szMode, "time"))
+		return CONFLATION_TIME;
+
+	return CONFLATION_NONE;
+}
+
+uint64_t Conflator::hashBookState(const OBRowFeed& obrf) {
+
+	uint64_t h = FNV_OFFSET;
+
+	for (char c : obrf.szFeedStat)
+		h = mixValue(h, static_cast<unsigned char>(c));
+
+	return finalize(mixBook(h, obrf));
+}
+
+uint64_t Conflator::hashBook(const OBRowFeed& obrf) {
+
+	return finalize(mixBook(FNV_OFFSET, obrf));
+}
+
+uint64_t Conflator::mixBook(uint64_t h, const OBRowFeed& obrf) {
+
+	h = mixValue(h, static_cast<uint64_t>(obrf.pairBidPriceSize.first));
+	h = mixValue(h, static_cast<uint64_t>(obrf.pairBidPriceSize.second));
+	h = mixValue(h, static_cast<uint64_t>(obrf.pairAskPriceSize.first));
+	h = mixValue(h, static_cast<uint64_t>(obrf.pairAskPriceSize.second));
+
+	// Level counts separate the bid levels from the ask levels
+	h = mixValue(h, obrf.vecBidLevels.size());
+	for (const pairPriceSize& pps : obrf.vecBidLevels) {
+		h = mixValue(h, static_cast<uint64_t>(pps.first));
+		h = mixValue(h, static_cast<uint64_t>(pps.second));
+	}
+
+	h = mixValue(h, obrf.vecAskLevels.size());
+	for (const pairPriceSize& pps : obrf.vecAskLevels) {
+		h = mixValue(h, static_cast<uint64_t>(pps.first));
+		h = mixValue(h, static_cast<uint64_t>(pps.second));
+	}
+
+	return h;
+}
+
+bool Conflator::isSameBookState(const OBRowFeed& obrf1, const OBRowFeed& obrf2) {
+
+	return obrf1.pairBidPriceSize == obrf2.pairBidPriceSize && obrf1.pairAskPriceSize == obrf2.pairAskPriceSize
+		&& obrf1.szFeedStat == obrf2.szFeedStat && obrf1.vecBidLevels == obrf2.vecBidLevels && obrf1.vecAskLevels == obrf2.vecAskLevels;
+}
+
+void Conflator::restore(const OBRowFeed* pobrfPending, uint64_t nRowsIn, uint64_t nRowsOut) {
+
+	m_bPending = pobrfPending != nullptr;
+	if (m_bPending) {
+		m_obrfPending = *pobrfPending;
+		m_nPendingHash = (m_eMode == CONFLATION_DUPLICATE) ? hashBookState(m_obrfPending) : 0;
+	}
+	m_nRowsIn = nRowsIn;
+	m_nRowsOut = nRowsOut;
+}
+
+void Conflator::release(OBRowFeed& obrfOut) {
+
+	obrfOut = std::move(m_obrfPending);
+	m_bPending = false;
+	++m_nRowsOut;
+}
+
+bool Conflator::push(OBRowFeed& obrf, OBRowFeed& obrfOut) {
+
+	++m_nRowsIn;
+
+	uint64_t nHash = (m_eMode == CONFLATION_DUPLICATE) ? hashBookState(obrf) : 0;
+	bool bReleased = false;
+
+	if (m_bPending) {
+
+		if (m_eMode == CONFLATION_DUPLICATE) {
+
+			// Same book state as the pending row, only extend its run. The trade columns aren't part of the book
+			// state, the run carries the latest ones so that the volume traded within it isn't moved to the next run
+			if (nHash == m_nPendingHash && isSameBookState(obrf, m_obrfPending)) {
+				m_obrfPending.nRepeat += obrf.nRepeat;
+				m_obrfPending.nTimestampLast = obrf.nTimestampLast;
+				m_obrfPending.nVolume = obrf.nVolume;
+				m_obrfPending.pairLastTrade = obrf.pairLastTrade;
+				return false;
+			}
+		}
+		else {
+			bool bTimed = obrf.nTimestamp != FeedClock::TIME_INVALID && m_obrfPending.nTimestamp != FeedClock::TIME_INVALID;
+
+			// Within the interval of the pending row, keep the latest book state under the time of the first row
+			if (bTimed && obrf.nTimestamp - m_obrfPending.nTimestamp < m_nIntervalNs) {
+
+				int nRepeat = m_obrfPending.nRepeat + obrf.nRepeat;
+				int64_t nTimestamp = m_obrfPending.nTimestamp;
+				string datetime;
+				datetime.swap(m_obrfPending.datetime);
+
+				m_obrfPending = std::move(obrf);
+				m_obrfPending.nRepeat = nRepeat;
+				m_obrfPending.nTimestamp = nTimestamp;
+				m_obrfPending.datetime.swap(datetime);
+				return false;
+			}
+		}
+
+		// The run or interval is over
+		release(obrfOut);
+		bReleased = true;
+	}
+
+	m_obrfPending = std::move(obrf);
+	m_nPendingHash = nHash;
+	m_bPending = true;
+
+	return bReleased;
+}
+
+bool Conflator::flush(OBRowFeed& obrfOut) {
+
+	if (!m_bPending)
+		return false;
+
+	release(obrfOut);
+	return true;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+
+#include "OrderStream.hpp"
+
+// Conflates the parsed rows of a feed before they reach the order book.
+//   CONFLATION_DUPLICATE	merges runs of consecutive rows holding the same book state into their first row
+//   CONFLATION_TIME		releases at most one row per interval holding the latest book state of that interval
+// A conflated row keeps the number of feed rows it stands for and the time of the last one, so that the
+// order book is built once per distinct state instead of once per feed update.
+class Conflator {
+
+public:
+	enum CONFLATION_ID {
+		CONFLATION_NONE = 0,
+		CONFLATION_DUPLICATE,
+		CONFLATION_TIME
+	};
+
+	Conflator() = delete;
+	Conflator(CONFLATION_ID eMode, int nIntervalMs);
+
+	// Take a parsed row, return true when a conflated row is released in obrfOut
+	bool push(OBRowFeed& obrf, OBRowFeed& obrfOut);
+
+	// Release the pending row at the end of the feed, return false when there is none
+	bool flush(OBRowFeed& obrfOut);
+
+	uint64_t getRowsIn() const		{ return m_nRowsIn; }
+	uint64_t getRowsOut() const		{ return m_nRowsOut; }
+
+	// Row waiting for the end of its run or interval, null when there is none
+	const OBRowFeed* getPending() const	{ return m_bPending ? &m_obrfPending : nullptr; }
+
+	// Resume with the pending row and counters saved in a checkpoint
+	void restore(const OBRowFeed* pobrfPending, uint64_t nRowsIn, uint64_t nRowsOut);
+
+	// 64-bit hash of the trading status, best bid/ask and book levels of a row
+	static uint64_t hashBookState(const OBRowFeed& obrf);
+
+	// 64-bit hash of the best bid/ask and book levels only, comparable between feeds of different status codes
+	static uint64_t hashBook(const OBRowFeed& obrf);
+
+	// Exact comparison of the book state of two rows
+	static bool isSameBookState(const OBRowFeed& obrf1, const OBRowFeed& obrf2);
+
+	static CONFLATION_ID getMode(const string& szMode);
+
+private:
+	void release(OBRowFeed& obrfOut);
+	static uint64_t mixBook(uint64_t h, const OBRowFeed& obrf);
+
+private:
+	CONFLATION_ID	m_eMode;
+	int64_t			m_nIntervalNs;
+
+	// Row waiting for the end of its run or interval
+	bool			m_bPending;
+	OBRowFeed		m_obrfPending;
+	uint64_t		m_nPendingHash;
+
+	uint64_t		m_nRowsIn;
+	uint64_t		m_nRowsOut;
+};
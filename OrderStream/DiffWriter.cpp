@@ -0,0 +1,291 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Row by row diff of the CSV and LOG streams
+//==============================================================
+#include "pch.h"
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <boost/regex.hpp>
+#include <boost/algorithm/string.hpp>
+
+using namespace std;
+using namespace boost;
+
+#include "DiffWriter.hpp"
+
+DiffWriter::DiffWriter(const string& szDiffFile, DIFF_MODE eMode, bool bMismatchOnly, int nLevels, int nEchoRows, int nEchoEvery) :
+	m_szDiffFile(szDiffFile), m_eMode(eMode), m_bMismatchOnly(bMismatchOnly), m_nLevels(max(nLevels, 1)), m_nEchoRows(nEchoRows), m_nEchoEvery(max(nEchoEvery, 1)),
+	m_nPairs(0), m_nMismatches(0) {
+
+	m_szBuffer.reserve(WRITE_BUFFER_SIZE + WRITE_BUFFER_SIZE / 4);
+}
+
+DiffWriter::DIFF_MODE DiffWriter::getMode(const string& szMode) {
+
+	if (boost::iequals(szMode, "csv"))
+		return DIFF_CSV;
+
+	if (boost::iequals(szMode, "binary"))
+		return DIFF_BINARY;
+
+	return DIFF_TEXT;
+}
+
+void DiffWriter::putNumber(string& sz, int64_t n) {
+
+	char buf[24];
+	char* p = buf + sizeof(buf);
+	uint64_t u = (n < 0) ? 0 - static_cast<uint64_t>(n) : static_cast<uint64_t>(n);
+
+	do {
+		*--p = static_cast<char>('0' + u % 10);
+		u /= 10;
+	} while (u != 0);
+
+	if (n < 0)
+		*--p = '-';
+
+	sz.append(p, buf + sizeof(buf) - p);
+}
+
+void DiffWriter::putPair(string& sz, const pairPriceSize& pps) {
+
+	putNumber(sz, pps.first);
+	sz += ',';
+	putNumber(sz, pps.second);
+}
+
+void DiffWriter::putLevels(string& sz, const vector<pairPriceSize>& vp) {
+
+	for (size_t i = 0; i < vp.size(); ++i) {
+		if (i > 0)
+			sz += ';';
+		putPair(sz, vp[i]);
+	}
+}
+
+void DiffWriter::padTo(string& sz, size_t nLineStart, size_t nColumn) {
+
+	// Columns already passed are not padded, like the tabulations of a format
+	size_t nLength = sz.size() - nLineStart;
+	if (nLength < nColumn)
+		sz.append(nColumn - nLength, ' ');
+}
+
+void DiffWriter::putText(string& sz, const string& szFeedName, const OBRowFeed& obrf) {
+
+	// [source]    instrument  datetime  stat  Bid{p,s}  Ask{p,s}  BookBid{p,s;...}  BookAsk{p,s;...}
+	size_t nLine = sz.size();
+	sz += '[';
+	sz += szFeedName;
+	sz += "] ";
+	padTo(sz, nLine, 12);
+	sz += ' ';
+	sz += obrf.szInstrument;
+	sz += ' ';
+	padTo(sz, nLine, 28);
+	sz += obrf.datetime;
+	sz += ' ';
+	padTo(sz, nLine, 52);
+	sz += obrf.szFeedStat;
+	sz += ' ';
+	padTo(sz, nLine, 66);
+	sz += "Bid{";
+	putPair(sz, obrf.pairBidPriceSize);
+	sz += "} ";
+	padTo(sz, nLine, 83);
+	sz += "Ask{";
+	putPair(sz, obrf.pairAskPriceSize);
+	sz += '}';
+	padTo(sz, nLine, 101);
+	sz += "BookBid{";
+	putLevels(sz, obrf.vecBidLevels);
+	sz += '}';
+	padTo(sz, nLine, 160);
+	sz += "BookAsk{";
+	putLevels(sz, obrf.vecAskLevels);
+	sz += "}\n";
+}
+
+void DiffWriter::putCsv(int iRow, const string& szFeedName, const OBRowFeed& obrf, bool bMatch) {
+
+	putNumber(m_szBuffer, iRow);
+	m_szBuffer += ',';
+	m_szBuffer += szFeedName;
+	m_szBuffer += ',';
+	m_szBuffer += obrf.szInstrument;
+	m_szBuffer += ',';
+	m_szBuffer += obrf.datetime;
+	m_szBuffer += ',';
+	m_szBuffer += obrf.szFeedStat;
+	m_szBuffer += ',';
+	putPair(m_szBuffer, obrf.pairBidPriceSize);
+	m_szBuffer += ',';
+	putPair(m_szBuffer, obrf.pairAskPriceSize);
+	m_szBuffer += ",\"";
+	putLevels(m_szBuffer, obrf.vecBidLevels);
+	m_szBuffer += "\",\"";
+	putLevels(m_szBuffer, obrf.vecAskLevels);
+	m_szBuffer += "\",";
+	m_szBuffer += bMatch ? '1' : '0';
+	m_szBuffer += '\n';
+}
+
+void DiffWriter::putBinary(int iRow, uint8_t iSource, const OBRowFeed& obrf, bool bMatch) {
+
+	DiffRecord dr;
+	memset(&dr, 0, sizeof(dr));
+	dr.nRow			= iRow;
+	dr.iSource		= iSource;
+	dr.bMatch		= bMatch ? 1 : 0;
+	dr.nBidLevels	= static_cast<uint8_t>(min(obrf.vecBidLevels.size(), static_cast<size_t>(m_nLevels)));
+	dr.nAskLevels	= static_cast<uint8_t>(min(obrf.vecAskLevels.size(), static_cast<size_t>(m_nLevels)));
+	dr.nTimestamp	= obrf.nTimestamp;
+	dr.nBidPrice	= static_cast<int32_t>(obrf.pairBidPriceSize.first);
+	dr.nBidSize		= static_cast<int32_t>(obrf.pairBidPriceSize.second);
+	dr.nAskPrice	= static_cast<int32_t>(obrf.pairAskPriceSize.first);
+	dr.nAskSize		= static_cast<int32_t>(obrf.pairAskPriceSize.second);
+	m_szBuffer.append(reinterpret_cast<const char*>(&dr), sizeof(dr));
+
+	for (const vector<pairPriceSize>* pvp : { &obrf.vecBidLevels, &obrf.vecAskLevels }) {
+		for (size_t i = 0; i < static_cast<size_t>(m_nLevels); ++i) {
+			int32_t vLevel[2] = { 0, 0 };
+			if (i < pvp->size()) {
+				vLevel[0] = static_cast<int32_t>((*pvp)[i].first);
+				vLevel[1] = static_cast<int32_t>((*pvp)[i].second);
+			}
+			m_szBuffer.append(reinterpret_cast<const char*>(vLevel), sizeof(vLevel));
+		}
+	}
+}
+
+void DiffWriter::flush() {
+
+	if (!m_szBuffer.empty()) {
+		m_ofs.write(m_szBuffer.data(), m_szBuffer.size());
+		m_szBuffer.clear();
+	}
+}
+
+void DiffWriter::onBooks(OBStreamCSV& obsCsv, OBStreamLog& obsLog) {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_DIFFWRITER_ONBOOKS = "onBooks";
+
+	m_ofs.open(m_szDiffFile, (m_eMode == DIFF_BINARY) ? ios_base::out | ios_base::trunc | ios_base::binary : ios_base::out | ios_base::trunc);
+	if (!m_ofs.is_open()) {
+		TracedException te(SZ_DIFFWRITER_EXCEPTION, "Unable to open diff file " + m_szDiffFile, SZ_DIFFWRITER_ONBOOKS);
+		throw te;
+	}
+
+	try {
+		// Header of the output, and of the console when something is echoed
+		string szTextHeader;
+		szTextHeader += "Source   ";
+		padTo(szTextHeader, 0, 12);
+		szTextHeader += " Instrument ";
+		padTo(szTextHeader, 0, 28);
+		szTextHeader += "DateTime ";
+		padTo(szTextHeader, 0, 52);
+		szTextHeader += "Stat ";
+		padTo(szTextHeader, 0, 66);
+		szTextHeader += "Bid      ";
+		padTo(szTextHeader, 0, 83);
+		szTextHeader += "Ask     ";
+		padTo(szTextHeader, 0, 101);
+		szTextHeader += "BookBid         ";
+		padTo(szTextHeader, 0, 160);
+		szTextHeader += "BookAsk\n";
+
+		if (m_eMode == DIFF_TEXT) {
+			m_szBuffer += szTextHeader;
+		}
+		else if (m_eMode == DIFF_CSV) {
+			m_szBuffer += "Pair,Source,Instrument,DateTime,Status,BestBidPrice,BestBidSize,BestAskPrice,BestAskSize,BidOrderBook,AskOrderBook,Match\n";
+		}
+		else {
+			uint32_t vHeader[3] = { 1, static_cast<uint32_t>(m_nLevels), static_cast<uint32_t>(sizeof(DiffRecord) + 4 * sizeof(int32_t) * m_nLevels) };
+			m_szBuffer += "OSDF";
+			m_szBuffer.append(reinterpret_cast<const char*>(vHeader), sizeof(vHeader));
+		}
+
+		m_szEcho.clear();
+		if (m_nEchoRows != 0)
+			m_szEcho += szTextHeader;
+
+		int nMinRows = min(obsCsv.getNumRows(), obsLog.getNumRows());
+		int nWritten = 0;
+		int nEchoed = 0;
+		m_nPairs = 0;
+		m_nMismatches = 0;
+
+		for (int i = 0; i < nMinRows; ++i) {
+
+			const OBRowFeed& obrfCsv = obsCsv.getRowFeedAt(i);
+			const OBRowFeed& obrfLog = obsLog.getRowFeedAt(i);
+			bool bMatch = obsCsv.getBookHash(i) == obsLog.getBookHash(i);
+
+			++m_nPairs;
+			if (!bMatch)
+				++m_nMismatches;
+			if (m_bMismatchOnly && bMatch)
+				continue;
+
+			switch (m_eMode) {
+			case DIFF_TEXT:
+				putText(m_szBuffer, obsCsv.getSourceFile(), obrfCsv);
+				putText(m_szBuffer, obsLog.getSourceFile(), obrfLog);
+				m_szBuffer += '\n';
+				break;
+			case DIFF_CSV:
+				putCsv(i, obsCsv.getSourceFile(), obrfCsv, bMatch);
+				putCsv(i, obsLog.getSourceFile(), obrfLog, bMatch);
+				break;
+			default:
+				putBinary(i, 0, obrfCsv, bMatch);
+				putBinary(i, 1, obrfLog, bMatch);
+				break;
+			}
+
+			// Echo a sample of the pairs to the console for a quick view
+			if ((m_nEchoRows < 0 || nEchoed < m_nEchoRows) && nWritten % m_nEchoEvery == 0) {
+				putText(m_szEcho, obsCsv.getSourceFile(), obrfCsv);
+				putText(m_szEcho, obsLog.getSourceFile(), obrfLog);
+				m_szEcho += '\n';
+				++nEchoed;
+			}
+			++nWritten;
+
+			if (m_szBuffer.size() >= WRITE_BUFFER_SIZE)
+				flush();
+		}
+
+		flush();
+		m_ofs.close();
+
+		// A write that failed, on a full disk for instance, leaves a truncated diff behind the summary
+		if (!m_ofs) {
+			TracedException te(SZ_DIFFWRITER_EXCEPTION, "Unable to write diff file " + m_szDiffFile, SZ_DIFFWRITER_ONBOOKS);
+			throw te;
+		}
+
+		cout.write(m_szEcho.data(), m_szEcho.size());
+		if (nEchoed < nWritten)
+			cout << " " << nEchoed << " of " << nWritten << " row pairs shown, all of them are in " << m_szDiffFile << endl;
+		cout << " Diff: " << m_nMismatches << " of " << m_nPairs << " row pairs have different books" << endl;
+	}
+	catch (const TracedException&) {
+		throw;
+	}
+	catch (const std::bad_alloc&) {
+		TracedException te(SZ_DIFFWRITER_EXCEPTION, TracedException::SZ_EXCEPTION_BADALLOC, SZ_DIFFWRITER_ONBOOKS);
+		throw te;
+	}
+	catch (...) {
+		TracedException te(SZ_DIFFWRITER_EXCEPTION, TracedException::SZ_EXCEPTION_UNEXPECTED, SZ_DIFFWRITER_ONBOOKS);
+		throw te;
+	}
+}
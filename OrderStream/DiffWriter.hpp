@@ -0,0 +1,79 @@
+#pragma once
+
+#include <fstream>
+#include <cstdint>
+
+#include "OrderStream.hpp"
+
+// Writes row i of the CSV stream next to row i of the LOG stream once both of their books are complete:
+//   text    the two rows one below the other in aligned columns, with a blank line after each pair
+//   csv     one record per row with the pair number, the source and whether the pair books match
+//   binary  "OSDF" header then fixed width records, see DiffRecord
+// A pair matches when the book hashes of both rows are equal, the mismatch only mode skips the matching pairs.
+// Rows are formatted straight into one reusable buffer written to the file in large blocks. The console
+// gets the text layout of at most nEchoRows pairs, one pair in nEchoEvery.
+class DiffWriter : public OBPairSink {
+
+public:
+	enum DIFF_MODE {
+		DIFF_TEXT = 0,
+		DIFF_CSV,
+		DIFF_BINARY
+	};
+
+	// Fixed part of a binary record, followed by nLevels bid then nLevels ask <price, size> int32 pairs,
+	// levels past the ones of the row are zero
+	typedef struct DiffRecord {
+		int32_t		nRow;
+		uint8_t		iSource;		// 0 for CSV, 1 for LOG
+		uint8_t		bMatch;
+		uint8_t		nBidLevels;
+		uint8_t		nAskLevels;
+		int64_t		nTimestamp;
+		int32_t		nBidPrice;
+		int32_t		nBidSize;
+		int32_t		nAskPrice;
+		int32_t		nAskSize;
+	} DiffRecord;
+
+	DiffWriter() = delete;
+	DiffWriter(const string& szDiffFile, DIFF_MODE eMode, bool bMismatchOnly, int nLevels, int nEchoRows, int nEchoEvery);
+
+	const string& getDiffFile() const	{ return m_szDiffFile; }
+	uint64_t getPairs() const			{ return m_nPairs; }
+	uint64_t getMismatches() const		{ return m_nMismatches; }
+
+	static DIFF_MODE getMode(const string& szMode);
+
+protected:
+	void	onBooks(OBStreamCSV& obsCsv, OBStreamLog& obsLog);
+
+private:
+	void	putText(string& sz, const string& szFeedName, const OBRowFeed& obrf);
+	void	putCsv(int iRow, const string& szFeedName, const OBRowFeed& obrf, bool bMatch);
+	void	putBinary(int iRow, uint8_t iSource, const OBRowFeed& obrf, bool bMatch);
+
+	static void	putNumber(string& sz, int64_t n);
+	static void	putPair(string& sz, const pairPriceSize& pps);
+	static void	putLevels(string& sz, const vector<pairPriceSize>& vp);
+	static void	padTo(string& sz, size_t nLineStart, size_t nColumn);
+	void		flush();
+
+private:
+	string		m_szDiffFile;
+	DIFF_MODE	m_eMode;
+	bool		m_bMismatchOnly;
+	int			m_nLevels;
+	int			m_nEchoRows;
+	int			m_nEchoEvery;
+
+	ofstream	m_ofs;
+	string		m_szBuffer;
+	string		m_szEcho;
+
+	uint64_t	m_nPairs;
+	uint64_t	m_nMismatches;
+
+	static constexpr size_t WRITE_BUFFER_SIZE	= 1 << 20;
+	static constexpr auto SZ_DIFFWRITER_EXCEPTION = "DiffWriter Exception";
+};
@@ -0,0 +1,161 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Fixed-format timestamp parsers for the CSV and LOG feed clocks
+//==============================================================
+#include "pch.h"
+#include <cstdio>
+
+using namespace std;
+
+#include "FeedClock.hpp"
+
+namespace {
+
+	// Read decimal digits and flag anything that is not a digit without branching
+	inline unsigned digit(const char* p, unsigned& nBad) {
+		unsigned d = static_cast<unsigned>(static_cast<unsigned char>(*p)) - '0';
+		nBad |= (d > 9);
+		return d;
+	}
+
+	inline unsigned twoDigits(const char* p, unsigned& nBad) {
+		return digit(p, nBad) * 10 + digit(p + 1, nBad);
+	}
+
+	inline unsigned fourDigits(const char* p, unsigned& nBad) {
+		return twoDigits(p, nBad) * 100 + twoDigits(p + 2, nBad);
+	}
+
+	inline int64_t timeOfDayNs(unsigned nHour, unsigned nMin, unsigned nSec, unsigned& nBad) {
+		nBad |= (nHour > 23) | (nMin > 59) | (nSec > 60);
+		return (static_cast<int64_t>(nHour) * 3600 + nMin * 60 + nSec) * FeedClock::NS_PER_SEC;
+	}
+}
+
+FeedClock::FeedClock(int nUtcOffsetMinutes) : m_nDateKey(0), m_nDayNs(0), m_bDateValid(false) {
+	m_nOffsetNs = static_cast<int64_t>(nUtcOffsetMinutes) * 60 * NS_PER_SEC;
+}
+
+int64_t FeedClock::daysFromCivil(int nYear, int nMonth, int nDay) {
+
+	// Count from March so that the leap day falls at the end of the year
+	nYear -= nMonth <= 2;
+	const int64_t nEra = (nYear >= 0 ? nYear : nYear - 399) / 400;
+	const int64_t nYoe = nYear - nEra * 400;
+	const int64_t nDoy = (153 * (nMonth + (nMonth > 2 ? -3 : 9)) + 2) / 5 + nDay - 1;
+	const int64_t nDoe = nYoe * 365 + nYoe / 4 - nYoe / 100 + nDoy;
+	return nEra * 146097 + nDoe - 719468;
+}
+
+int64_t FeedClock::getDayNs(uint64_t nDateKey, int nYear, int nMonth, int nDay) {
+
+	// Only convert the date again when it changes from the previous row
+	if (!m_bDateValid || nDateKey != m_nDateKey) {
+		m_nDateKey		= nDateKey;
+		m_nDayNs		= daysFromCivil(nYear, nMonth, nDay) * NS_PER_DAY;
+		m_bDateValid	= true;
+	}
+	return m_nDayNs;
+}
+
+int64_t FeedClock::parseCsv(const char* psz, size_t nLen) {
+
+	// 06/12/2018 05:00:02
+	// 0123456789012345678
+	if (nLen < 19)
+		return TIME_INVALID;
+
+	unsigned nBad = 0;
+	unsigned nMonth	= twoDigits(psz, nBad);
+	unsigned nDay	= twoDigits(psz + 3, nBad);
+	unsigned nYear	= fourDigits(psz + 6, nBad);
+	unsigned nHour	= twoDigits(psz + 11, nBad);
+	unsigned nMin	= twoDigits(psz + 14, nBad);
+	unsigned nSec	= twoDigits(psz + 17, nBad);
+
+	nBad |= (psz[2] != '/') | (psz[5] != '/') | (psz[10] != ' ') | (psz[13] != ':') | (psz[16] != ':');
+	nBad |= (nMonth - 1 > 11) | (nDay - 1 > 30);
+
+	int64_t nTime = timeOfDayNs(nHour, nMin, nSec, nBad);
+	if (nBad)
+		return TIME_INVALID;
+
+	uint64_t nDateKey = nYear * 10000ULL + nMonth * 100 + nDay;
+	return getDayNs(nDateKey, nYear, nMonth, nDay) + nTime - m_nOffsetNs;
+}
+
+int64_t FeedClock::parseLog(const char* psz, size_t nLen) {
+
+	// 20180612-06:47:07.111
+	// 012345678901234567890
+	if (nLen < 17)
+		return TIME_INVALID;
+
+	unsigned nBad = 0;
+	unsigned nYear	= fourDigits(psz, nBad);
+	unsigned nMonth	= twoDigits(psz + 4, nBad);
+	unsigned nDay	= twoDigits(psz + 6, nBad);
+	unsigned nHour	= twoDigits(psz + 9, nBad);
+	unsigned nMin	= twoDigits(psz + 12, nBad);
+	unsigned nSec	= twoDigits(psz + 15, nBad);
+
+	nBad |= (psz[8] != '-') | (psz[11] != ':') | (psz[14] != ':');
+	nBad |= (nMonth - 1 > 11) | (nDay - 1 > 30);
+
+	int64_t nTime = timeOfDayNs(nHour, nMin, nSec, nBad);
+	if (nBad)
+		return TIME_INVALID;
+
+	// Optional fraction of a second scaled up to nanoseconds
+	if (nLen > 18 && psz[17] == '.') {
+
+		static const int64_t SCALE[10] = { 1000000000, 100000000, 10000000, 1000000, 100000, 10000, 1000, 100, 10, 1 };
+
+		int64_t nFraction = 0;
+		size_t i = 18;
+		for (; i < nLen && i < 27; ++i) {
+
+			unsigned d = static_cast<unsigned>(static_cast<unsigned char>(psz[i])) - '0';
+			if (d > 9)
+				break;
+			nFraction = nFraction * 10 + d;
+		}
+		nTime += nFraction * SCALE[i - 18];
+	}
+
+	uint64_t nDateKey = nYear * 10000ULL + nMonth * 100 + nDay;
+	return getDayNs(nDateKey, nYear, nMonth, nDay) + nTime - m_nOffsetNs;
+}
+
+string FeedClock::format(int64_t nTime) {
+
+	if (nTime == TIME_INVALID)
+		return "invalid";
+
+	int64_t nDays = nTime / NS_PER_DAY;
+	int64_t nDayNs = nTime % NS_PER_DAY;
+	if (nDayNs < 0) {
+		nDayNs += NS_PER_DAY;
+		--nDays;
+	}
+
+	// Inverse of daysFromCivil
+	nDays += 719468;
+	const int64_t nEra = (nDays >= 0 ? nDays : nDays - 146096) / 146097;
+	const int64_t nDoe = nDays - nEra * 146097;
+	const int64_t nYoe = (nDoe - nDoe / 1460 + nDoe / 36524 - nDoe / 146096) / 365;
+	const int64_t nDoy = nDoe - (365 * nYoe + nYoe / 4 - nYoe / 100);
+	const int64_t nMp = (5 * nDoy + 2) / 153;
+	const int nDay = static_cast<int>(nDoy - (153 * nMp + 2) / 5 + 1);
+	const int nMonth = static_cast<int>(nMp < 10 ? nMp + 3 : nMp - 9);
+	const int nYear = static_cast<int>(nYoe + nEra * 400 + (nMonth <= 2));
+
+	int64_t nSecs = nDayNs / NS_PER_SEC;
+	int nMs = static_cast<int>((nDayNs % NS_PER_SEC) / NS_PER_MS);
+
+	char sz[32];
+	snprintf(sz, sizeof(sz), "%04d%02d%02d-%02d:%02d:%02d.%03d", nYear, nMonth, nDay,
+		static_cast<int>(nSecs / 3600), static_cast<int>((nSecs / 60) % 60), static_cast<int>(nSecs % 60), nMs);
+	return string(sz);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+using namespace std;
+
+// Converts the fixed-format clocks of the feeds into nanoseconds since the epoch (UTC).
+//   CSV feed : "06/12/2018 05:00:02"		MM/DD/YYYY HH:MM:SS
+//   LOG feed : "20180612-06:47:07.111"	YYYYMMDD-HH:MM:SS[.fraction]
+// Fields are read at fixed positions without any branching on their content. The date rarely changes within
+// a file, so its raw characters are compared against the previous row and the epoch day is only computed again
+// when they differ. Each source can be shifted by its own offset from UTC.
+class FeedClock {
+
+public:
+	FeedClock() : FeedClock(0) {}
+	explicit FeedClock(int nUtcOffsetMinutes);
+
+	// Return TIME_INVALID when the text does not hold a valid timestamp in the expected format
+	int64_t parseCsv(const char* psz, size_t nLen);
+	int64_t parseLog(const char* psz, size_t nLen);
+
+	int64_t parseCsv(const string& sz)			{ return parseCsv(sz.data(), sz.size()); }
+	int64_t parseLog(const string& sz)			{ return parseLog(sz.data(), sz.size()); }
+
+	// Days since 1970-01-01 of a proleptic Gregorian date
+	static int64_t daysFromCivil(int nYear, int nMonth, int nDay);
+
+	// Format a timestamp as "YYYYMMDD-HH:MM:SS.mmm" for reports
+	static string format(int64_t nTime);
+
+	static constexpr int64_t TIME_INVALID	= INT64_MIN;
+	static constexpr int64_t NS_PER_SEC		= 1000000000LL;
+	static constexpr int64_t NS_PER_MS		= 1000000LL;
+	static constexpr int64_t NS_PER_DAY		= 86400LL * NS_PER_SEC;
+
+private:
+	int64_t getDayNs(uint64_t nDateKey, int nYear, int nMonth, int nDay);
+
+private:
+	int64_t		m_nOffsetNs;		// Offset of the source clock from UTC
+
+	// Date of the previous row as raw characters and its epoch time at midnight
+	uint64_t	m_nDateKey;
+	int64_t		m_nDayNs;
+	bool		m_bDateValid;
+};
@@ -0,0 +1,121 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Sparse time index sidecar of a feed file
+//==============================================================
+#include "pch.h"
+#include <fstream>
+#include <algorithm>
+#include <boost/filesystem.hpp>
+
+using namespace std;
+
+#include "FeedIndex.hpp"
+
+namespace {
+
+	// Fixed layout of the sidecar header, all values are little-endian
+	struct IndexHeader {
+		uint32_t	nMagic;
+		uint32_t	nVersion;
+		uint64_t	nFeedSize;
+		int64_t		nFeedTime;
+		uint64_t	nEntries;
+	};
+}
+
+FeedIndex::FeedIndex(const string& szFeedFile, int nEveryRows, int nEveryMs) :
+	m_szFeedFile(szFeedFile), m_szIndexFile(szFeedFile + ".idx"), m_bLoaded(false) {
+
+	m_nEveryRows	= max(nEveryRows, 1);
+	m_nEveryNs		= static_cast<int64_t>(max(nEveryMs, 1)) * 1000000LL;
+}
+
+bool FeedIndex::getFeedStamp(uint64_t& nSize, int64_t& nTime) const {
+
+	boost::system::error_code ec;
+	nSize = boost::filesystem::file_size(m_szFeedFile, ec);
+	if (ec)
+		return false;
+
+	nTime = static_cast<int64_t>(boost::filesystem::last_write_time(m_szFeedFile, ec));
+	return !ec;
+}
+
+bool FeedIndex::load() {
+
+	m_bLoaded = false;
+	m_vEntries.clear();
+
+	ifstream ifs(m_szIndexFile, ios_base::in | ios_base::binary);
+	if (!ifs.is_open())
+		return false;
+
+	uint64_t nSize = 0;
+	int64_t nTime = 0;
+	if (!getFeedStamp(nSize, nTime))
+		return false;
+
+	// Discard the sidecar when the feed was replaced since it was written
+	IndexHeader ih;
+	if (!ifs.read(reinterpret_cast<char*>(&ih), sizeof(ih)))
+		return false;
+
+	if (ih.nMagic != INDEX_MAGIC || ih.nVersion != INDEX_VERSION || ih.nFeedSize != nSize || ih.nFeedTime != nTime)
+		return false;
+
+	m_vEntries.resize(static_cast<size_t>(ih.nEntries));
+	if (!m_vEntries.empty() && !ifs.read(reinterpret_cast<char*>(&m_vEntries[0]), m_vEntries.size() * sizeof(FeedIndexEntry))) {
+		m_vEntries.clear();
+		return false;
+	}
+
+	m_bLoaded = true;
+	return true;
+}
+
+bool FeedIndex::save() const {
+
+	IndexHeader ih;
+	ih.nMagic	= INDEX_MAGIC;
+	ih.nVersion	= INDEX_VERSION;
+	ih.nEntries	= m_vEntries.size();
+	if (!getFeedStamp(ih.nFeedSize, ih.nFeedTime))
+		return false;
+
+	// Write next to the final name and rename so that a reader never sees a partial index
+	string szTemp = m_szIndexFile + ".tmp";
+	boost::system::error_code ec;
+	{
+		ofstream ofs(szTemp, ios_base::out | ios_base::binary | ios_base::trunc);
+		if (!ofs.is_open())
+			return false;
+
+		ofs.write(reinterpret_cast<const char*>(&ih), sizeof(ih));
+		if (!m_vEntries.empty())
+			ofs.write(reinterpret_cast<const char*>(&m_vEntries[0]), m_vEntries.size() * sizeof(FeedIndexEntry));
+
+		// Only a close that flushed every entry makes a usable index
+		ofs.close();
+		if (!ofs) {
+			boost::filesystem::remove(szTemp, ec);
+			return false;
+		}
+	}
+
+	boost::filesystem::rename(szTemp, m_szIndexFile, ec);
+	return !ec;
+}
+
+const FeedIndexEntry* FeedIndex::seek(int64_t nTimestamp) const {
+
+	// Entries are recorded in feed order, which is time order. Rows before the entry found may share its
+	// time, the feeds stamp their rows to the second, so the seek stops at the last entry strictly before.
+	vector<FeedIndexEntry>::const_iterator it = lower_bound(m_vEntries.begin(), m_vEntries.end(), nTimestamp,
+		[](const FeedIndexEntry& fie, int64_t nTime) { return fie.nTimestamp < nTime; });
+
+	if (it == m_vEntries.begin())
+		return nullptr;
+
+	return &*(it - 1);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+struct FeedIndexEntry {
+	int64_t		nTimestamp;		// Row time in nanoseconds since epoch (UTC)
+	uint64_t	nOffset;		// Byte offset of the row line in the (decompressed) feed
+	int64_t		nRow;			// Row number in the feed, header excluded
+};
+
+// Sparse time index of a feed persisted in a sidecar file next to it (<feed>.idx). An entry is recorded every
+// N rows or every M milliseconds of feed time, whichever comes first, while the feed is read for the first
+// time. Later runs load the sidecar and seek straight to the last entry before the start of a time window,
+// so only the rows of the window are parsed. The sidecar is ignored when the feed file size or time changed.
+class FeedIndex {
+
+public:
+	FeedIndex() = delete;
+	FeedIndex(const string& szFeedFile, int nEveryRows, int nEveryMs);
+
+	// Load the sidecar, return false when it is missing or stale
+	bool load();
+
+	// Persist the entries recorded while reading the whole feed, return false when the sidecar can't be written
+	bool save() const;
+
+	// Record the row when enough rows or time went by since the last entry
+	void add(int64_t nTimestamp, uint64_t nOffset, int64_t nRow) {
+
+		if (m_vEntries.empty() || nRow - m_vEntries.back().nRow >= m_nEveryRows || nTimestamp - m_vEntries.back().nTimestamp >= m_nEveryNs) {
+			FeedIndexEntry fie = { nTimestamp, nOffset, nRow };
+			m_vEntries.push_back(fie);
+		}
+	}
+
+	// Last entry strictly before the given time, null when no row of the feed precedes it
+	const FeedIndexEntry* seek(int64_t nTimestamp) const;
+
+	bool isLoaded() const						{ return m_bLoaded; }
+	size_t size() const							{ return m_vEntries.size(); }
+	const string& getIndexFile() const			{ return m_szIndexFile; }
+
+private:
+	bool getFeedStamp(uint64_t& nSize, int64_t& nTime) const;
+
+private:
+	string					m_szFeedFile;
+	string					m_szIndexFile;
+	int64_t					m_nEveryRows;
+	int64_t					m_nEveryNs;
+	bool					m_bLoaded;
+	vector<FeedIndexEntry>	m_vEntries;
+
+	static constexpr uint32_t INDEX_MAGIC	= 0x5849534F;	// "OSIX"
+	static constexpr uint32_t INDEX_VERSION	= 1;
+};
@@ -0,0 +1,111 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Tests of the sparse time index of the feeds
+//==============================================================
+#include "pch.h"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <boost/lexical_cast.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/regex.hpp>
+
+using namespace std;
+using namespace boost;
+
+#include "FeedIndex.hpp"
+#include "FeedReader.hpp"
+#include "TestCheck.hpp"
+
+namespace {
+
+	const int64_t NS_PER_SECOND = 1000000000LL;
+
+	// Rows of the test feed as "row;second", several rows stamped in the same second as the feeds do
+	const int64_t ROW_SECONDS[] = { 1000, 1001, 1001, 1001, 1002, 1002, 1003 };
+	const size_t ROW_COUNT = sizeof(ROW_SECONDS) / sizeof(ROW_SECONDS[0]);
+
+	int64_t getRowTime(const string& line) {
+
+		return lexical_cast<int64_t>(line.substr(line.find(';') + 1)) * NS_PER_SECOND;
+	}
+
+	// Index every row of the feed and persist the sidecar as a first run over the feed does
+	bool writeFeed(const string& szFeed) {
+
+		ofstream file(szFeed, ios_base::out | ios_base::binary | ios_base::trunc);
+		for (size_t i = 0; i < ROW_COUNT; ++i)
+			file << i << ';' << ROW_SECONDS[i] << '\n';
+		file.close();
+
+		FeedIndex fi(szFeed, 1, 1000);
+		FeedReader fr(szFeed);
+		string line;
+		for (int64_t nRow = 0; fr.getline(line); ++nRow)
+			fi.add(getRowTime(line), fr.getLineOffset(), nRow);
+
+		return fi.save();
+	}
+
+	// Rows of the [from, end) window as a later run reads them, from the row the sidecar seeks to
+	vector<int64_t> readWindow(const string& szFeed, int64_t nFrom) {
+
+		FeedIndex fi(szFeed, 1, 1000);
+		check(fi.load(), "sidecar of " + szFeed + " loads");
+
+		const FeedIndexEntry* pfie = fi.seek(nFrom);
+		FeedReader fr(szFeed, pfie ? pfie->nOffset : 0);
+
+		vector<int64_t> vRows;
+		string line;
+		for (int64_t nRow = pfie ? pfie->nRow : 0; fr.getline(line); ++nRow) {
+			if (getRowTime(line) >= nFrom)
+				vRows.push_back(nRow);
+		}
+		return vRows;
+	}
+
+	void testSeekStrictlyBefore() {
+
+		FeedIndex fi("seek.csv", 1, 1000);
+		for (size_t i = 0; i < ROW_COUNT; ++i)
+			fi.add(ROW_SECONDS[i] * NS_PER_SECOND, i * 16, static_cast<int64_t>(i));
+
+		check(fi.seek(1000 * NS_PER_SECOND) == nullptr, "seek to the first second starts from the top of the feed");
+
+		const FeedIndexEntry* pfie = fi.seek(1001 * NS_PER_SECOND);
+		check(pfie != nullptr && pfie->nRow == 0, "seek to a second shared by several rows stops before the first of them");
+
+		pfie = fi.seek(1002 * NS_PER_SECOND);
+		check(pfie != nullptr && pfie->nRow == 3, "seek stops at the last row of the previous second");
+
+		pfie = fi.seek(2000 * NS_PER_SECOND);
+		check(pfie != nullptr && pfie->nRow == static_cast<int64_t>(ROW_COUNT) - 1, "seek past the feed stops at its last row");
+	}
+
+	void testWindowStartSharedSecond() {
+
+		string szFeed = (filesystem::temp_directory_path() / filesystem::unique_path("feedindex-%%%%%%%%.csv")).string();
+		check(writeFeed(szFeed), "sidecar of " + szFeed + " is written");
+
+		// The window starts on a second shared by rows 1 to 3, all of them belong to it
+		vector<int64_t> vRows = readWindow(szFeed, 1001 * NS_PER_SECOND);
+		vector<int64_t> vExpected = { 1, 2, 3, 4, 5, 6 };
+		check(vRows == vExpected, "window starting on a shared second keeps every row of that second");
+
+		vRows = readWindow(szFeed, 1002 * NS_PER_SECOND);
+		vExpected = { 4, 5, 6 };
+		check(vRows == vExpected, "window starting on the next second keeps both of its rows");
+
+		boost::system::error_code ec;
+		filesystem::remove(szFeed + ".idx", ec);
+		filesystem::remove(szFeed, ec);
+	}
+}
+
+void runFeedIndexTests() {
+
+	testSeekStrictlyBefore();
+	testWindowStartSharedSecond();
+}
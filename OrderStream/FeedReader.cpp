@@ -0,0 +1,588 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Threaded feed reader with transparent gzip/zstd decompression
+//==============================================================
+#include "pch.h"
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <boost/make_shared.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/regex.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filter/zstd.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/error.hpp>
+#if !defined(BOOST_ASIO_HAS_WINDOWS_RANDOM_ACCESS_HANDLE)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+using namespace boost;
+
+#include "FeedReader.hpp"
+#include "AllocProfiler.hpp"
+
+FeedIoService::FeedIoService(size_t nThreads, size_t nReadsInFlight) :
+	m_work(boost::asio::make_work_guard(m_ioc)), m_nReadsInFlight(max(nReadsInFlight, static_cast<size_t>(1))) {
+
+	for (size_t i = 0; i < max(nThreads, static_cast<size_t>(1)); ++i)
+		m_threads.create_thread([this]() { m_ioc.run(); });
+}
+
+FeedIoService::~FeedIoService() {
+
+	// The readers are gone by now, let the threads return once the queue is empty
+	m_work.reset();
+	m_threads.join_all();
+}
+
+FeedReader::AsyncState::AsyncState(boost::asio::io_context& ioc) :
+	strand(ioc.get_executor()),
+#if defined(BOOST_ASIO_HAS_WINDOWS_RANDOM_ACCESS_HANDLE)
+	handle(ioc),
+#else
+	fd(-1),
+#endif
+	nFileSize(0), nReadOffset(0), nSkipHead(0), bStopping(false), nPending(0), bReadyWaiting(false) {
+}
+
+FeedReader::FeedReader(const string& szFile, uint64_t nStartOffset, size_t nBufferSize, size_t nMaxBuffers, FeedIoService* pIoService) :
+	m_szFile(szFile), m_nStartOffset(nStartOffset), m_nBufferSize(nBufferSize), m_ring(nMaxBuffers), m_nPos(0), m_nBufferOffset(nStartOffset), m_nLineOffset(nStartOffset),
+	m_pIoService(nullptr) {
+
+	m_eCompression = getCompression(m_szFile);
+
+	// Plain feeds are read by the pool of the io service, compressed feeds keep their thread since decompressing
+	// them is the work and not the reads
+	if (pIoService && !isCompressed()) {
+		m_pIoService = pIoService;
+		m_pAsync.reset(new AsyncState(pIoService->getContext()));
+		postAsync([this]() { openAsync(); });
+		return;
+	}
+
+	// Start reading and decompressing ahead of the parser
+	m_thread = boost::thread(boost::bind(&FeedReader::readFeed, this));
+}
+
+FeedReader::~FeedReader() {
+
+	// Release the reader thread in case the parser gave up before the end of the feed
+	m_ring.cancel();
+
+	if (!m_pAsync) {
+		m_thread.join();
+		return;
+	}
+
+	// No read is issued once the ring is cancelled, wait for the ones in flight since their handlers use the reader
+	AsyncState& as = *m_pAsync;
+	boost::unique_lock<boost::mutex> lock(as.mtxPending);
+	while (as.nPending > 0)
+		as.cvPending.wait(lock);
+	lock.unlock();
+
+	closeAsync();
+}
+
+FeedReader::COMPRESSION_ID FeedReader::getCompression(const string& szFile) {
+
+	if (boost::iends_with(szFile, ".gz"))
+		return COMPRESSION_GZIP;
+
+	if (boost::iends_with(szFile, ".zst"))
+		return COMPRESSION_ZSTD;
+
+	return COMPRESSION_NONE;
+}
+
+vector<string> FeedReader::expandFiles(const string& szSpec) {
+
+	vector<string> vSpecs;
+	vector<string> vFiles;
+	boost::split(vSpecs, szSpec, boost::is_any_of(";"), boost::token_compress_on);
+
+	for (string& szPattern : vSpecs) {
+
+		boost::trim(szPattern);
+		if (szPattern.empty())
+			continue;
+
+		filesystem::path pathPattern(szPattern);
+		string szName = pathPattern.filename().string();
+		if (szName.find_first_of("*?") == string::npos) {
+			vFiles.push_back(szPattern);
+			continue;
+		}
+
+		// Turn the wildcards of the file name into a regex, escaping everything else
+		string szRegex;
+		for (char c : szName) {
+			if (c == '*')
+				szRegex += ".*";
+			else if (c == '?')
+				szRegex += '.';
+			else if (strchr("\\^$.|+()[]{}", c) != nullptr)
+				(szRegex += '\\') += c;
+			else
+				szRegex += c;
+		}
+		regex reName(szRegex);
+
+		filesystem::path pathDir = pathPattern.parent_path();
+		vector<string> vMatches;
+		boost::system::error_code ec;
+		for (filesystem::directory_iterator it(pathDir.empty() ? filesystem::path(".") : pathDir, ec), itEnd; !ec && it != itEnd; it.increment(ec)) {
+
+			string szFile = it->path().filename().string();
+
+			// Skip the time index sidecars written next to the feeds
+			if (filesystem::is_regular_file(it->status()) && !boost::iends_with(szFile, ".idx") && regex_match(szFile, reName))
+				vMatches.push_back((pathDir / szFile).string());
+		}
+
+		if (vMatches.empty()) {
+			vFiles.push_back(szPattern);
+			continue;
+		}
+
+		sort(vMatches.begin(), vMatches.end());
+		vFiles.insert(vFiles.end(), vMatches.begin(), vMatches.end());
+	}
+
+	return vFiles;
+}
+
+bool FeedReader::pushBuffer(pFeedBuffer& pBuffer) {
+
+	// The ring applies back pressure on the reader when the parser falls behind
+	return m_ring.push(pBuffer);
+}
+
+void FeedReader::readFeed() {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_FEEDREADER_READFEED = "readFeed";
+
+	AllocScope as(AllocProfiler::STAGE_READ_FEED);
+
+	try {
+		ifstream file(m_szFile, ios_base::in | ios_base::binary);
+		if (!file.is_open()) {
+			TracedException te(SZ_FEEDREADER_EXCEPTION, SZ_FEEDREADER_OPEN, SZ_FEEDREADER_READFEED);
+			throw te;
+		}
+
+		// Decompress on this thread so that the parser only sees plain text
+		iostreams::filtering_istream fis;
+
+		if (m_eCompression == COMPRESSION_GZIP) {
+			fis.push(iostreams::gzip_decompressor());
+		}
+		else if (m_eCompression == COMPRESSION_ZSTD) {
+			fis.push(iostreams::zstd_decompressor());
+		}
+
+		// Plain files are read directly without going through the filter chain
+		if (isCompressed()) {
+			fis.push(file);
+
+			// Let corrupted or truncated archives surface as exceptions instead of a silent end of feed
+			fis.exceptions(ios_base::badbit);
+		}
+		istream& in = isCompressed() ? static_cast<istream&>(fis) : static_cast<istream&>(file);
+
+		// Start from a known line offset, compressed feeds have to be decompressed up to it
+		if (m_nStartOffset > 0) {
+			if (isCompressed()) {
+				uint64_t nSkip = m_nStartOffset;
+				while (nSkip > 0 && in) {
+					streamsize nChunk = static_cast<streamsize>(min<uint64_t>(nSkip, m_nBufferSize));
+					in.ignore(nChunk);
+					nSkip -= static_cast<uint64_t>(in.gcount());
+				}
+			}
+			else {
+				file.seekg(static_cast<streamoff>(m_nStartOffset));
+			}
+		}
+
+		// Partial last line of a buffer carried over to the next one
+		string szCarry;
+
+		while (true) {
+
+			pFeedBuffer pBuffer = boost::make_shared<string>();
+			pBuffer->swap(szCarry);
+
+			size_t nFilled = pBuffer->size();
+			pBuffer->resize(nFilled + m_nBufferSize);
+			in.read(&(*pBuffer)[nFilled], m_nBufferSize);
+			nFilled += static_cast<size_t>(in.gcount());
+			pBuffer->resize(nFilled);
+
+			bool bEof = !in;
+
+			// Only hand over whole lines so that the parser never splits a line across buffers
+			if (!bEof) {
+				size_t nEol = pBuffer->find_last_of('\n');
+
+				if (nEol == string::npos) {
+					szCarry.swap(*pBuffer);
+					continue;
+				}
+				szCarry.assign(*pBuffer, nEol + 1, string::npos);
+				pBuffer->resize(nEol + 1);
+			}
+
+			// Stop when the parser abandoned the feed
+			if (!pBuffer->empty() && !pushBuffer(pBuffer))
+				break;
+
+			if (bEof)
+				break;
+		}
+	}
+	catch (const TracedException& te) {
+		m_eei = te.getExceptionInfo();
+	}
+	catch (const std::bad_alloc&) {
+		TracedException te(SZ_FEEDREADER_EXCEPTION, TracedException::SZ_EXCEPTION_BADALLOC, SZ_FEEDREADER_READFEED);
+		m_eei = te.getExceptionInfo();
+	}
+	catch (const std::exception& e) {
+		// Corrupted or truncated archives are reported by the decompressors
+		TracedException te(SZ_FEEDREADER_EXCEPTION, e.what(), SZ_FEEDREADER_READFEED);
+		m_eei = te.getExceptionInfo();
+	}
+	catch (...) {
+		TracedException te(SZ_FEEDREADER_EXCEPTION, TracedException::SZ_EXCEPTION_UNEXPECTED, SZ_FEEDREADER_READFEED);
+		m_eei = te.getExceptionInfo();
+	}
+
+	// Let the parser drain the ring up to the end of the feed
+	m_ring.close();
+}
+
+template <typename Handler>
+void FeedReader::postAsync(Handler fnHandler) {
+
+	beginPending();
+	boost::asio::post(m_pAsync->strand, [this, fnHandler]() {
+		fnHandler();
+		endPending();
+	});
+}
+
+void FeedReader::beginPending() {
+
+	boost::lock_guard<boost::mutex> lock(m_pAsync->mtxPending);
+	++m_pAsync->nPending;
+}
+
+void FeedReader::endPending() {
+
+	// Notify under the lock, the reader may be destroyed as soon as the count drops to zero
+	AsyncState& as = *m_pAsync;
+	boost::lock_guard<boost::mutex> lock(as.mtxPending);
+	if (--as.nPending == 0)
+		as.cvPending.notify_all();
+}
+
+void FeedReader::openAsync() {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_FEEDREADER_OPENASYNC = "openAsync";
+
+	AsyncState& as = *m_pAsync;
+	try {
+		boost::system::error_code ec;
+		as.nFileSize = filesystem::file_size(m_szFile, ec);
+
+#if defined(BOOST_ASIO_HAS_WINDOWS_RANDOM_ACCESS_HANDLE)
+		// Overlapped so that the reads complete through the IOCP of the io_context
+		HANDLE hFile = INVALID_HANDLE_VALUE;
+		if (!ec)
+			hFile = ::CreateFileA(m_szFile.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING,
+				FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (hFile == INVALID_HANDLE_VALUE) {
+			TracedException te(SZ_FEEDREADER_EXCEPTION, SZ_FEEDREADER_OPEN, SZ_FEEDREADER_OPENASYNC);
+			throw te;
+		}
+		as.handle.assign(hFile);
+#else
+		if (!ec)
+			as.fd = ::open(m_szFile.c_str(), O_RDONLY);
+		if (as.fd < 0) {
+			TracedException te(SZ_FEEDREADER_EXCEPTION, SZ_FEEDREADER_OPEN, SZ_FEEDREADER_OPENASYNC);
+			throw te;
+		}
+#endif
+
+		// Reads start on the aligned block holding the start offset, the bytes before it are dropped
+		as.nReadOffset = m_nStartOffset - m_nStartOffset % READ_ALIGNMENT;
+		as.nSkipHead = static_cast<size_t>(m_nStartOffset - as.nReadOffset);
+	}
+	catch (const TracedException& te) {
+		failAsync(te);
+		return;
+	}
+
+	progressAsync();
+}
+
+void FeedReader::closeAsync() {
+
+#if defined(BOOST_ASIO_HAS_WINDOWS_RANDOM_ACCESS_HANDLE)
+	boost::system::error_code ec;
+	m_pAsync->handle.close(ec);
+#else
+	if (m_pAsync->fd >= 0) {
+		::close(m_pAsync->fd);
+		m_pAsync->fd = -1;
+	}
+#endif
+}
+
+void FeedReader::readBlock(ReadBlock& rb) {
+
+	AsyncState& as = *m_pAsync;
+	uint64_t nOffset = rb.nOffset + rb.nFilled;
+	char* pData = &(*rb.pData)[rb.nFilled];
+	size_t nSize = rb.pData->size() - rb.nFilled;
+	ReadBlock* prb = &rb;
+
+	beginPending();
+
+#if defined(BOOST_ASIO_HAS_WINDOWS_RANDOM_ACCESS_HANDLE)
+	as.handle.async_read_some_at(nOffset, boost::asio::buffer(pData, nSize),
+		boost::asio::bind_executor(as.strand, [this, prb](const boost::system::error_code& ec, size_t nBytes) {
+			onBlockRead(*prb, ec, nBytes);
+			endPending();
+		}));
+#else
+	// Without overlapped file reads the positioned read runs on a thread of the pool, its completion on the strand
+	int fd = as.fd;
+	boost::asio::post(m_pIoService->getContext(), [this, prb, fd, nOffset, pData, nSize]() {
+
+		ssize_t nRead = ::pread(fd, pData, nSize, static_cast<off_t>(nOffset));
+		boost::system::error_code ec;
+		if (nRead < 0)
+			ec = boost::system::error_code(errno, boost::system::system_category());
+		else if (nRead == 0)
+			ec = boost::asio::error::eof;
+		size_t nBytes = (nRead > 0) ? static_cast<size_t>(nRead) : 0;
+
+		boost::asio::post(m_pAsync->strand, [this, prb, ec, nBytes]() {
+			onBlockRead(*prb, ec, nBytes);
+			endPending();
+		});
+	});
+#endif
+}
+
+void FeedReader::onBlockRead(ReadBlock& rb, const boost::system::error_code& ec, size_t nBytes) {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_FEEDREADER_ONBLOCKREAD = "onBlockRead";
+
+	AsyncState& as = *m_pAsync;
+	if (as.bStopping)
+		return;
+
+	rb.nFilled += nBytes;
+	if (ec && ec != boost::asio::error::eof) {
+		TracedException te(SZ_FEEDREADER_EXCEPTION, ec.message(), SZ_FEEDREADER_ONBLOCKREAD);
+		failAsync(te);
+		return;
+	}
+
+	if (ec || nBytes == 0) {
+		// The feed is shorter than when it was opened, it ends with this block
+		rb.pData->resize(rb.nFilled);
+		as.nFileSize = min(as.nFileSize, rb.nOffset + rb.nFilled);
+		rb.bDone = true;
+	}
+	else if (rb.nFilled < rb.pData->size()) {
+		// Carry on with a short read
+		readBlock(rb);
+		return;
+	}
+	else {
+		rb.bDone = true;
+	}
+
+	progressAsync();
+}
+
+void FeedReader::progressAsync() {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_FEEDREADER_PROGRESSASYNC = "progressAsync";
+
+	AllocScope as(AllocProfiler::STAGE_READ_FEED);
+
+	try {
+		deliverBlocks();
+		pumpReady();
+		issueReads();
+
+		// The feed is over once every block was read and every line handed over
+		AsyncState& asr = *m_pAsync;
+		if (!asr.bStopping && asr.dqBlocks.empty() && asr.dqReady.empty() && asr.nReadOffset >= asr.nFileSize) {
+			asr.bStopping = true;
+			m_ring.close();
+		}
+	}
+	catch (const std::bad_alloc&) {
+		TracedException te(SZ_FEEDREADER_EXCEPTION, TracedException::SZ_EXCEPTION_BADALLOC, SZ_FEEDREADER_PROGRESSASYNC);
+		failAsync(te);
+	}
+	catch (...) {
+		TracedException te(SZ_FEEDREADER_EXCEPTION, TracedException::SZ_EXCEPTION_UNEXPECTED, SZ_FEEDREADER_PROGRESSASYNC);
+		failAsync(te);
+	}
+}
+
+void FeedReader::deliverBlocks() {
+
+	AsyncState& as = *m_pAsync;
+
+	// Blocks are handed over in file order, a block read ahead of the front one waits for it
+	while (!as.dqBlocks.empty() && as.dqBlocks.front().bDone) {
+
+		ReadBlock& rb = as.dqBlocks.front();
+		bool bLast = rb.nOffset + rb.pData->size() >= as.nFileSize;
+		pFeedBuffer pBuffer = rb.pData;
+		as.dqBlocks.pop_front();
+
+		// Drop what precedes the start offset and prepend the partial line of the previous block
+		if (as.nSkipHead > 0 || !as.szCarry.empty()) {
+			pBuffer->replace(0, min(as.nSkipHead, pBuffer->size()), as.szCarry);
+			as.nSkipHead = 0;
+			as.szCarry.clear();
+		}
+
+		// Only hand over whole lines so that the parser never splits a line across buffers
+		if (!bLast) {
+			size_t nEol = pBuffer->find_last_of('\n');
+
+			if (nEol == string::npos) {
+				as.szCarry.swap(*pBuffer);
+				continue;
+			}
+			as.szCarry.assign(*pBuffer, nEol + 1, string::npos);
+			pBuffer->resize(nEol + 1);
+		}
+
+		if (!pBuffer->empty())
+			as.dqReady.push_back(pBuffer);
+	}
+}
+
+void FeedReader::pumpReady() {
+
+	AsyncState& as = *m_pAsync;
+
+	// A handler can't wait for the parser, the buffers wait here and the parser resumes the reader once it made room
+	while (!as.dqReady.empty()) {
+
+		if (!m_ring.pushNoWait(as.dqReady.front())) {
+			as.bReadyWaiting.store(true, std::memory_order_release);
+
+			// The parser may have made room before it could see the flag
+			if (!m_ring.pushNoWait(as.dqReady.front()))
+				return;
+		}
+		as.dqReady.pop_front();
+	}
+}
+
+void FeedReader::issueReads() {
+
+	AsyncState& as = *m_pAsync;
+	size_t nBlockSize = (m_nBufferSize + READ_ALIGNMENT - 1) / READ_ALIGNMENT * READ_ALIGNMENT;
+
+	// Keep several blocks in flight, but none while lines wait for room in the ring
+	while (!as.bStopping && !m_ring.isCancelled() && as.dqReady.empty() && as.dqBlocks.size() < m_pIoService->getReadsInFlight()
+		&& as.nReadOffset < as.nFileSize) {
+
+		ReadBlock rb;
+		rb.nOffset = as.nReadOffset;
+		rb.pData = boost::make_shared<string>();
+		rb.pData->resize(static_cast<size_t>(min<uint64_t>(nBlockSize, as.nFileSize - as.nReadOffset)));
+		rb.nFilled = 0;
+		rb.bDone = false;
+		as.nReadOffset += rb.pData->size();
+
+		// The elements of a deque stay in place as it grows at the back, the handler keeps a reference
+		as.dqBlocks.push_back(rb);
+		readBlock(as.dqBlocks.back());
+	}
+}
+
+void FeedReader::failAsync(const TracedException& te) {
+
+	// Rethrown to the parser once the ring is drained
+	m_eei = te.getExceptionInfo();
+	m_pAsync->bStopping = true;
+	m_ring.close();
+}
+
+bool FeedReader::getBuffer(pFeedBuffer& pBuffer) {
+
+	if (!m_ring.pop(pBuffer)) {
+
+		// Rethrow on the parser thread what went wrong on the reader thread
+		if (!m_eei.szDesc.empty()) {
+			TracedException te(m_eei);
+			throw te;
+		}
+		return false;
+	}
+
+	// Resume the asynchronous reads that stopped on a full ring
+	if (m_pAsync && m_pAsync->bReadyWaiting.exchange(false, std::memory_order_acq_rel))
+		postAsync([this]() { progressAsync(); });
+
+	return true;
+}
+
+bool FeedReader::getline(string& line) {
+
+	// Move on to the next buffer once the current one is consumed
+	while (!m_pCurrent || m_nPos >= m_pCurrent->size()) {
+
+		if (m_pCurrent)
+			m_nBufferOffset += m_pCurrent->size();
+
+		if (!getBuffer(m_pCurrent)) {
+			// The next offset stays at the end of the bytes read
+			m_pCurrent.reset();
+			m_nPos = 0;
+			return false;
+		}
+		m_nPos = 0;
+	}
+	m_nLineOffset = m_nBufferOffset + m_nPos;
+
+	size_t nEol = m_pCurrent->find('\n', m_nPos);
+	size_t nNext = (nEol == string::npos) ? m_pCurrent->size() : nEol + 1;
+	size_t nEnd = (nEol == string::npos) ? m_pCurrent->size() : nEol;
+
+	// Files are read in binary mode, drop the carriage return of Windows line endings
+	if (nEnd > m_nPos && (*m_pCurrent)[nEnd - 1] == '\r')
+		--nEnd;
+
+	line.assign(*m_pCurrent, m_nPos, nEnd - m_nPos);
+	m_nPos = nNext;
+
+	return true;
+}
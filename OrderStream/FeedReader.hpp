@@ -0,0 +1,184 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <atomic>
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#if defined(BOOST_ASIO_HAS_WINDOWS_RANDOM_ACCESS_HANDLE)
+#include <boost/asio/windows/random_access_handle.hpp>
+#endif
+
+#include "TracedException.hpp"
+#include "SpscRing.hpp"
+
+using namespace std;
+
+// A block of whole feed lines handed from the reader thread to the parser
+typedef boost::shared_ptr<string>	pFeedBuffer;
+
+// Pool of a few threads running the asynchronous reads of all the plain feeds of a run on one io_context. On
+// Windows the reads are overlapped reads completed through the IOCP of the io_context, elsewhere each read is a
+// positioned read run by a thread of the pool. Either way a handful of threads keeps several reads of every open
+// feed in flight, instead of one thread blocked on each feed.
+class FeedIoService {
+
+public:
+	FeedIoService() = delete;
+	FeedIoService(const FeedIoService&) = delete;
+	FeedIoService& operator=(const FeedIoService&) = delete;
+
+	FeedIoService(size_t nThreads, size_t nReadsInFlight);
+	~FeedIoService();
+
+	boost::asio::io_context& getContext()		{ return m_ioc; }
+	size_t getReadsInFlight() const				{ return m_nReadsInFlight; }
+
+private:
+	boost::asio::io_context		m_ioc;
+	boost::asio::executor_work_guard<boost::asio::io_context::executor_type>	m_work;
+	boost::thread_group			m_threads;
+	size_t						m_nReadsInFlight;
+};
+
+// Reads a feed file on a dedicated thread and hands large buffers of whole lines to the parser through
+// a bounded lock-free ring. Archived feeds compressed as .gz or .zst are decompressed on the reader thread so that
+// decompression and parsing overlap, and the parser never has to know the file was compressed.
+// Given a FeedIoService, a plain feed is instead read by the pool with several block aligned reads in flight. The
+// blocks complete in any order on the strand of the reader, which puts them back in file order and hands the
+// lines over through the same ring, so the parser side is the same for both.
+class FeedReader {
+
+public:
+	FeedReader() = delete;
+	FeedReader(const FeedReader&) = delete;
+	FeedReader& operator=(const FeedReader&) = delete;
+
+	explicit FeedReader(const string& szFile, uint64_t nStartOffset = 0, size_t nBufferSize = DEFAULT_BUFFER_SIZE, size_t nMaxBuffers = DEFAULT_MAX_BUFFERS,
+		FeedIoService* pIoService = nullptr);
+	~FeedReader();
+
+	// Get the next line without its line terminator, return false at the end of the feed
+	bool getline(string& line);
+
+	// Byte offset in the decompressed feed of the last line returned by getline
+	uint64_t getLineOffset() const				{ return m_nLineOffset; }
+
+	// Byte offset in the decompressed feed of the line getline returns next
+	uint64_t getNextOffset() const				{ return m_nBufferOffset + m_nPos; }
+
+	// Get the next buffer of whole lines, return false at the end of the feed. Not to be mixed with getline.
+	bool getBuffer(pFeedBuffer& pBuffer);
+
+	const string& getSourceFile() const			{ return m_szFile; }
+	bool isCompressed() const					{ return m_eCompression != COMPRESSION_NONE; }
+	bool isAsync() const						{ return m_pIoService != nullptr; }
+
+	// Hand-off counters between the reader thread and the parser
+	RingStats getStats() const					{ return m_ring.getStats(); }
+
+	enum COMPRESSION_ID {
+		COMPRESSION_NONE = 0,
+		COMPRESSION_GZIP,
+		COMPRESSION_ZSTD
+	};
+
+	static COMPRESSION_ID getCompression(const string& szFile);
+
+	// Expand a list of feed files separated by ';', each of which may hold * and ? wildcards in its file name,
+	// into the matching files sorted by name. A name matching no file is kept so that opening it reports the error.
+	static vector<string> expandFiles(const string& szSpec);
+
+	static constexpr size_t DEFAULT_BUFFER_SIZE	= 1 << 20;
+	static constexpr size_t DEFAULT_MAX_BUFFERS	= 8;
+
+	static constexpr size_t READ_ALIGNMENT		= 4096;
+
+private:
+	void readFeed();
+	bool pushBuffer(pFeedBuffer& pBuffer);
+
+	// Asynchronous reads, all called on the strand of the reader
+	typedef struct ReadBlock {
+		uint64_t		nOffset;	// File offset of the block, a multiple of READ_ALIGNMENT
+		pFeedBuffer		pData;
+		size_t			nFilled;	// Bytes read so far, a short read is continued
+		bool			bDone;
+	} ReadBlock;
+
+	template <typename Handler>
+	void postAsync(Handler fnHandler);
+	void beginPending();
+	void endPending();
+	void openAsync();
+	void closeAsync();
+	void readBlock(ReadBlock& rb);
+	void onBlockRead(ReadBlock& rb, const boost::system::error_code& ec, size_t nBytes);
+	void progressAsync();
+	void deliverBlocks();
+	void pumpReady();
+	void issueReads();
+	void failAsync(const TracedException& te);
+
+private:
+	string				m_szFile;
+	uint64_t			m_nStartOffset;
+	COMPRESSION_ID		m_eCompression;
+	size_t				m_nBufferSize;
+
+	// Bounded ring of buffers between the reader thread and the parser
+	SpscRing<pFeedBuffer>	m_ring;
+
+	// Parser side cursor in the current buffer
+	pFeedBuffer			m_pCurrent;
+	size_t				m_nPos;
+	uint64_t			m_nBufferOffset;	// Feed offset of the current buffer
+	uint64_t			m_nLineOffset;		// Feed offset of the last line
+
+	// Exception caught on the reader thread and rethrown to the parser once the ring is drained
+	ErrorExceptionInfo	m_eei;
+
+	boost::thread		m_thread;
+
+	// Asynchronous reads of a plain feed through the pool of the io service, only touched on its strand
+	typedef boost::asio::strand<boost::asio::io_context::executor_type>	ioStrand;
+
+	struct AsyncState {
+
+		explicit AsyncState(boost::asio::io_context& ioc);
+
+		ioStrand			strand;
+#if defined(BOOST_ASIO_HAS_WINDOWS_RANDOM_ACCESS_HANDLE)
+		boost::asio::windows::random_access_handle	handle;
+#else
+		int					fd;
+#endif
+		uint64_t			nFileSize;
+		uint64_t			nReadOffset;	// Offset of the next block to read
+		deque<ReadBlock>	dqBlocks;		// Blocks in flight or read, in file order
+		deque<pFeedBuffer>	dqReady;		// Buffers of lines waiting for room in the ring
+		string				szCarry;		// Partial last line of the blocks handed over
+		size_t				nSkipHead;		// Bytes of the first block before the start offset
+		bool				bStopping;		// Failed or every line handed over, nothing more to read
+
+		// Reads not completed yet, waited for before the reader goes away
+		size_t				nPending;
+		boost::mutex		mtxPending;
+		boost::condition_variable	cvPending;
+
+		// Buffers wait for the parser to make room in the ring
+		std::atomic<bool>	bReadyWaiting;
+	};
+
+	FeedIoService*					m_pIoService;
+	boost::scoped_ptr<AsyncState>	m_pAsync;
+
+	static constexpr auto SZ_FEEDREADER_EXCEPTION	= "FeedReader Exception";
+	static constexpr auto SZ_FEEDREADER_OPEN		= "Unable to open feed file";
+};
@@ -0,0 +1,190 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Tests of the feed reader offsets and of the checkpoints taken on them
+//==============================================================
+#include "pch.h"
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/regex.hpp>
+
+using namespace std;
+using namespace boost;
+
+#include "FeedReader.hpp"
+#include "Checkpoint.hpp"
+#include "TestCheck.hpp"
+
+namespace {
+
+	const int64_t NS_PER_SECOND = 1000000000LL;
+
+	string getTempFile(const string& szModel) {
+
+		return (filesystem::temp_directory_path() / filesystem::unique_path(szModel)).string();
+	}
+
+	void writeFeed(const string& szFeed, size_t nRows) {
+
+		ofstream file(szFeed, ios_base::out | ios_base::binary | ios_base::trunc);
+		for (size_t i = 0; i < nRows; ++i)
+			file << i << ';' << 1000 + i << '\n';
+	}
+
+	void removeCheckpoint(const string& szCheckpoint) {
+
+		boost::system::error_code ec;
+		filesystem::remove(szCheckpoint, ec);
+		filesystem::remove(szCheckpoint + ".rows", ec);
+		filesystem::remove(szCheckpoint + ".tmp", ec);
+	}
+
+	OBRowFeed makeRow(int nRow) {
+
+		OBRowFeed obrf = OBRowFeed();
+		obrf.szInstrument		= (nRow < 3) ? "FGBL" : "FGBM";
+		obrf.szFeedStat			= (nRow == 2) ? "HALTED" : "OPEN";
+		obrf.datetime			= "20180612-06:47:0" + to_string(nRow);
+		obrf.nTimestamp			= (1528786027 + nRow) * NS_PER_SECOND;
+		obrf.nTimestampLast		= obrf.nTimestamp + nRow * 1000;
+		obrf.nRepeat			= 1 + nRow;
+		obrf.pairBidPriceSize	= make_pair(16000L - nRow, 10L + nRow);
+		obrf.pairAskPriceSize	= make_pair(16002L + nRow, 20L);
+		for (int i = 0; i < nRow; ++i) {
+			obrf.vecBidLevels.push_back(make_pair(obrf.pairBidPriceSize.first - 1 - i, 5L * (i + 1)));
+			obrf.vecAskLevels.push_back(make_pair(obrf.pairAskPriceSize.first + 2 * (i + 1), 7L));
+		}
+
+		// Only some of the rows carry a trade, the others are journaled without the trade columns
+		if (nRow % 2) {
+			obrf.pairLastTrade	= make_pair(16001L, 3L);
+			obrf.nVolume		= 100 * nRow;
+		}
+		return obrf;
+	}
+
+	bool isSameRow(const OBRowFeed& obrf1, const OBRowFeed& obrf2) {
+
+		return obrf1.szInstrument == obrf2.szInstrument && obrf1.szFeedStat == obrf2.szFeedStat && obrf1.datetime == obrf2.datetime
+			&& obrf1.nTimestamp == obrf2.nTimestamp && obrf1.nTimestampLast == obrf2.nTimestampLast && obrf1.nRepeat == obrf2.nRepeat
+			&& obrf1.pairBidPriceSize == obrf2.pairBidPriceSize && obrf1.pairAskPriceSize == obrf2.pairAskPriceSize
+			&& obrf1.vecBidLevels == obrf2.vecBidLevels && obrf1.vecAskLevels == obrf2.vecAskLevels
+			&& obrf1.pairLastTrade == obrf2.pairLastTrade && obrf1.nVolume == obrf2.nVolume;
+	}
+
+	// Journal a few rows and save the state of a stream reading a single feed file
+	bool saveCheckpoint(const string& szCheckpoint, const string& szFeed, size_t nRows) {
+
+		Checkpoint cp(szCheckpoint, 1000);
+		cp.open(false);
+		for (size_t i = 0; i < nRows; ++i)
+			cp.addRow(makeRow(static_cast<int>(i)));
+
+		CheckpointState cs;
+		cs.vSources.resize(1);
+		CheckpointSource& csrc = cs.vSources[0];
+		csrc.szFile			= szFeed;
+		csrc.nOffset		= 42;
+		csrc.nFeedRow		= 7;
+		csrc.bEndOfFeed		= false;
+		csrc.bHasNext		= true;
+		csrc.obrfNext		= makeRow(5);
+		cs.bPending			= true;
+		cs.obrfPending		= makeRow(6);
+		cs.nConflatedIn		= 9;
+		cs.nConflatedOut	= 4;
+		return cp.save(cs);
+	}
+
+	void testNextOffsetAtEnd() {
+
+		string szFeed = getTempFile("feedreader-%%%%%%%%.csv");
+		writeFeed(szFeed, 7);
+		uint64_t nSize = filesystem::file_size(szFeed);
+
+		// A checkpoint taken at the end of the feed resumes from its last byte, however often the feed is polled
+		FeedReader fr(szFeed);
+		string line;
+		while (fr.getline(line))
+			;
+		check(fr.getNextOffset() == nSize, "next offset at the end of the feed is its size");
+		check(!fr.getline(line) && fr.getNextOffset() == nSize, "next offset stays at the end of the feed");
+
+		boost::system::error_code ec;
+		filesystem::remove(szFeed, ec);
+	}
+
+	void testCheckpointRoundTrip() {
+
+		string szFeed = getTempFile("feedreader-%%%%%%%%.csv");
+		string szCheckpoint = szFeed + ".ckpt";
+		writeFeed(szFeed, 7);
+
+		const size_t JOURNAL_ROWS = 5;
+		check(saveCheckpoint(szCheckpoint, szFeed, JOURNAL_ROWS), "checkpoint of " + szFeed + " is written");
+
+		Checkpoint cp(szCheckpoint, 1000);
+		CheckpointState cs;
+		vector<OBRowFeed> vRows;
+		check(cp.load(vector<string>(1, szFeed), cs, vRows), "checkpoint of an unchanged feed loads");
+		check(cp.getRows() == JOURNAL_ROWS && vRows.size() == JOURNAL_ROWS, "checkpoint covers the journaled rows");
+
+		bool bSameRows = vRows.size() == JOURNAL_ROWS;
+		for (size_t i = 0; bSameRows && i < vRows.size(); ++i)
+			bSameRows = isSameRow(vRows[i], makeRow(static_cast<int>(i)));
+		check(bSameRows, "journaled rows read back as they were written");
+
+		check(cs.vSources.size() == 1, "checkpoint holds the single feed file");
+		if (cs.vSources.size() == 1) {
+			const CheckpointSource& csrc = cs.vSources[0];
+			check(csrc.szFile == szFeed && csrc.nOffset == 42 && csrc.nFeedRow == 7 && !csrc.bEndOfFeed, "position in the feed reads back");
+			check(csrc.bHasNext && isSameRow(csrc.obrfNext, makeRow(5)), "row read ahead of the merge reads back");
+		}
+		check(cs.bPending && isSameRow(cs.obrfPending, makeRow(6)) && cs.nConflatedIn == 9 && cs.nConflatedOut == 4, "row held by the conflator reads back");
+
+		removeCheckpoint(szCheckpoint);
+		boost::system::error_code ec;
+		filesystem::remove(szFeed, ec);
+	}
+
+	void testCheckpointStaleFeed() {
+
+		string szFeed = getTempFile("feedreader-%%%%%%%%.csv");
+		string szCheckpoint = szFeed + ".ckpt";
+		writeFeed(szFeed, 7);
+		check(saveCheckpoint(szCheckpoint, szFeed, 3), "checkpoint of " + szFeed + " is written");
+
+		CheckpointState cs;
+		vector<OBRowFeed> vRows;
+
+		// The checkpoint of one feed file says nothing about another one, or about more files
+		Checkpoint cpOther(szCheckpoint, 1000);
+		check(!cpOther.load(vector<string>(1, szFeed + ".other"), cs, vRows), "checkpoint of another feed file is ignored");
+		check(!cpOther.load(vector<string>(2, szFeed), cs, vRows), "checkpoint of a single feed file is ignored for two of them");
+
+		// A feed rewritten to the same size is only told apart by its write time
+		boost::system::error_code ec;
+		std::time_t tWrite = filesystem::last_write_time(szFeed, ec);
+		filesystem::last_write_time(szFeed, tWrite + 60, ec);
+		Checkpoint cpTouched(szCheckpoint, 1000);
+		check(!ec && !cpTouched.load(vector<string>(1, szFeed), cs, vRows), "checkpoint of a feed written since is ignored");
+
+		// A feed that grew since the checkpoint is stale too, even with its old write time
+		writeFeed(szFeed, 8);
+		filesystem::last_write_time(szFeed, tWrite, ec);
+		Checkpoint cpGrown(szCheckpoint, 1000);
+		check(!ec && !cpGrown.load(vector<string>(1, szFeed), cs, vRows), "checkpoint of a feed that changed size is ignored");
+
+		removeCheckpoint(szCheckpoint);
+		filesystem::remove(szFeed, ec);
+	}
+}
+
+void runFeedReaderTests() {
+
+	testNextOffsetAtEnd();
+	testCheckpointRoundTrip();
+	testCheckpointStaleFeed();
+}
@@ -0,0 +1,113 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Per row liquidity metrics of the order book feeds
+//==============================================================
+#include "pch.h"
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <boost/regex.hpp>
+
+using namespace std;
+using namespace boost;
+
+#include "LiquidityAnalytics.hpp"
+
+namespace {
+
+	const double NaN = numeric_limits<double>::quiet_NaN();
+}
+
+LiquidityAnalytics::LiquidityAnalytics(long nClipSize, int nMaxLevels, LiquiditySeries& ls) : m_ls(ls) {
+
+	m_nClipSize		= max(nClipSize, 1L);
+	m_nMaxLevels	= static_cast<size_t>(max(nMaxLevels, 1));
+
+	// Size the arrays once, rows never hold more than the maximum number of levels
+	for (BookSide* pbs : { &m_bsBid, &m_bsAsk }) {
+		pbs->vPrice.resize(m_nMaxLevels);
+		pbs->vSize.resize(m_nMaxLevels);
+		pbs->vCumSize.resize(m_nMaxLevels);
+		pbs->vCumNotional.resize(m_nMaxLevels);
+		pbs->nLevels = 0;
+	}
+}
+
+void LiquidityAnalytics::loadSide(const vector<pairPriceSize>& vLevels, const pairPriceSize& ppsBest, BookSide& bs) const {
+
+	// Split the levels into contiguous arrays, dropping empty ones
+	size_t n = 0;
+	for (const pairPriceSize& pps : vLevels) {
+
+		if (n == m_nMaxLevels)
+			break;
+
+		bs.vPrice[n] = pps.first;
+		bs.vSize[n] = pps.second;
+		n += (pps.first > 0 && pps.second > 0);
+	}
+
+	// Rows without book levels still have their best price and size
+	if (n == 0 && ppsBest.first > 0 && ppsBest.second > 0) {
+		bs.vPrice[0] = ppsBest.first;
+		bs.vSize[0] = ppsBest.second;
+		n = 1;
+	}
+
+	int64_t nCumSize = 0;
+	int64_t nCumNotional = 0;
+	for (size_t i = 0; i < n; ++i) {
+		nCumSize += bs.vSize[i];
+		nCumNotional += static_cast<int64_t>(bs.vPrice[i]) * bs.vSize[i];
+		bs.vCumSize[i] = nCumSize;
+		bs.vCumNotional[i] = nCumNotional;
+	}
+	bs.nLevels = n;
+}
+
+double LiquidityAnalytics::getFillPrice(const BookSide& bs) const {
+
+	// First level at which the cumulative size covers the clip
+	vector<int64_t>::const_iterator itEnd = bs.vCumSize.begin() + bs.nLevels;
+	vector<int64_t>::const_iterator it = lower_bound(bs.vCumSize.begin(), itEnd, static_cast<int64_t>(m_nClipSize));
+	if (it == itEnd)
+		return NaN;
+
+	size_t k = std::distance(bs.vCumSize.begin(), it);
+	int64_t nSizeBefore = (k > 0) ? bs.vCumSize[k - 1] : 0;
+	int64_t nNotionalBefore = (k > 0) ? bs.vCumNotional[k - 1] : 0;
+
+	// Whole levels before k and the remainder of the clip at the price of level k
+	return (nNotionalBefore + (m_nClipSize - nSizeBefore) * static_cast<double>(bs.vPrice[k])) / m_nClipSize;
+}
+
+void LiquidityAnalytics::addRow(const OBRowFeed& obrf, LiquiditySeries& ls) {
+
+	loadSide(obrf.vecBidLevels, obrf.pairBidPriceSize, m_bsBid);
+	loadSide(obrf.vecAskLevels, obrf.pairAskPriceSize, m_bsAsk);
+
+	long nBidDepth = m_bsBid.nLevels ? static_cast<long>(m_bsBid.vCumSize[m_bsBid.nLevels - 1]) : 0;
+	long nAskDepth = m_bsAsk.nLevels ? static_cast<long>(m_bsAsk.vCumSize[m_bsAsk.nLevels - 1]) : 0;
+
+	double dImbalance = (nBidDepth + nAskDepth > 0) ? static_cast<double>(nBidDepth - nAskDepth) / (nBidDepth + nAskDepth) : NaN;
+
+	// Microprice leans toward the side with less size, where the next trade is more likely to happen
+	double dMicroprice = NaN;
+	if (m_bsBid.nLevels && m_bsAsk.nLevels) {
+
+		double dBidSize = static_cast<double>(m_bsBid.vSize[0]);
+		double dAskSize = static_cast<double>(m_bsAsk.vSize[0]);
+		dMicroprice = (m_bsBid.vPrice[0] * dAskSize + m_bsAsk.vPrice[0] * dBidSize) / (dBidSize + dAskSize);
+	}
+
+	ls.nClipSize = m_nClipSize;
+	ls.vTimestamp.push_back(obrf.nTimestamp);
+	ls.vBidDepth.push_back(nBidDepth);
+	ls.vAskDepth.push_back(nAskDepth);
+	ls.vBuyFill.push_back(getFillPrice(m_bsAsk));
+	ls.vSellFill.push_back(getFillPrice(m_bsBid));
+	ls.vImbalance.push_back(dImbalance);
+	ls.vMicroprice.push_back(dMicroprice);
+}
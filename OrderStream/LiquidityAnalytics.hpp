@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+
+#include "OrderStream.hpp"
+
+// Per row liquidity metrics of a feed: cumulative depth of each side, average price to fill a clip size,
+// order book imbalance and microprice. The levels of a row are split into price and size arrays and
+// cumulative size and notional are taken as prefix sums over them, so a fill price is one binary search
+// on the cumulative sizes. The arrays are kept between rows and the metrics of each row published to the
+// sink are appended as columns to the LiquiditySeries of the order book.
+class LiquidityAnalytics : public OBSink {
+
+public:
+	LiquidityAnalytics() = delete;
+	LiquidityAnalytics(long nClipSize, int nMaxLevels, LiquiditySeries& ls);
+
+	void onRow(const OBStream& obs, const OBRowFeed& obrf, int iRow)	{ addRow(obrf, m_ls); }
+
+	// Compute the metrics of a row and append them to the series
+	void addRow(const OBRowFeed& obrf, LiquiditySeries& ls);
+
+	long getClipSize() const			{ return m_nClipSize; }
+
+private:
+	// Struct of arrays copy of one side of a row book with its prefix sums
+	typedef struct BookSide {
+
+		vector<long>	vPrice;
+		vector<long>	vSize;
+		vector<int64_t>	vCumSize;
+		vector<int64_t>	vCumNotional;
+		size_t			nLevels;
+
+	} BookSide;
+
+	void	loadSide(const vector<pairPriceSize>& vLevels, const pairPriceSize& ppsBest, BookSide& bs) const;
+	double	getFillPrice(const BookSide& bs) const;
+
+private:
+	long		m_nClipSize;
+	size_t		m_nMaxLevels;
+	LiquiditySeries&	m_ls;
+
+	BookSide	m_bsBid;
+	BookSide	m_bsAsk;
+};
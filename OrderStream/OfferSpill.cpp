@@ -0,0 +1,299 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Out of core offers of one side of the book, spilled in sorted runs
+//==============================================================
+#include "pch.h"
+#include <fstream>
+#include <algorithm>
+#include <boost/regex.hpp>
+#include <boost/filesystem.hpp>
+
+using namespace std;
+using namespace boost;
+
+#include "OfferSpill.hpp"
+
+constexpr size_t OfferSpill::SPILL_BLOCK_SIZE;
+
+OfferSpill::OfferSpill(const string& szDir, size_t nMemoryBytes) :
+	m_szDir(szDir), m_nMemoryBytes(nMemoryBytes), m_iLastRow(-1), m_iLevel(0), m_nTuples(0), m_nRuns(0), m_nPasses(0) {
+
+	// The budget holds the tuple buffer while adding, and a read block of each merged run plus an output block while merging
+	m_nBufferTuples	= max(m_nMemoryBytes / sizeof(OfferTuple), static_cast<size_t>(1));
+	m_nBlockTuples	= max(min(SPILL_BLOCK_SIZE, m_nMemoryBytes / 3) / sizeof(OfferTuple), static_cast<size_t>(1));
+	m_nFanIn		= max(m_nMemoryBytes / (m_nBlockTuples * sizeof(OfferTuple)), static_cast<size_t>(3)) - 1;
+}
+
+OfferSpill::~OfferSpill() {
+
+	removeRuns();
+}
+
+bool OfferSpill::lessTuple(const OfferTuple& ot1, const OfferTuple& ot2) {
+
+	if (ot1.nPrice != ot2.nPrice)
+		return ot1.nPrice < ot2.nPrice;
+	if (ot1.iRow != ot2.iRow)
+		return ot1.iRow < ot2.iRow;
+	return ot1.iLevel < ot2.iLevel;
+}
+
+void OfferSpill::add(long nPrice, long nSize, int iRow) {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_OFFERSPILL_ADD = "add";
+
+	try {
+		// The whole buffer is reserved once, its pages are only committed as they are written
+		if (m_vTuples.capacity() < m_nBufferTuples)
+			m_vTuples.reserve(m_nBufferTuples);
+
+		if (iRow != m_iLastRow) {
+			m_iLastRow = iRow;
+			m_iLevel = 0;
+		}
+
+		OfferTuple ot;
+		ot.nPrice	= nPrice;
+		ot.nSize	= nSize;
+		ot.iRow		= iRow;
+		ot.iLevel	= m_iLevel++;
+		m_vTuples.push_back(ot);
+		++m_nTuples;
+
+		if (m_vTuples.size() == m_nBufferTuples)
+			spill();
+	}
+	catch (const TracedException&) {
+		throw;
+	}
+	catch (const std::bad_alloc&) {
+		TracedException te(SZ_OFFERSPILL_EXCEPTION, TracedException::SZ_EXCEPTION_BADALLOC, SZ_OFFERSPILL_ADD);
+		throw te;
+	}
+	catch (...) {
+		TracedException te(SZ_OFFERSPILL_EXCEPTION, TracedException::SZ_EXCEPTION_UNEXPECTED, SZ_OFFERSPILL_ADD);
+		throw te;
+	}
+}
+
+string OfferSpill::newRunFile() const {
+
+	boost::filesystem::path pathDir = m_szDir.empty() ? boost::filesystem::temp_directory_path() : boost::filesystem::path(m_szDir);
+	return (pathDir / boost::filesystem::unique_path("offers-%%%%-%%%%-%%%%-%%%%.run")).string();
+}
+
+void OfferSpill::openRun(const string& szRun, ofstream& ofs) {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_OFFERSPILL_OPENRUN = "openRun";
+
+	ofs.open(szRun, ios_base::out | ios_base::binary | ios_base::trunc);
+	if (!ofs.is_open()) {
+		TracedException te(SZ_OFFERSPILL_EXCEPTION, "Unable to create offer run " + szRun, SZ_OFFERSPILL_OPENRUN);
+		throw te;
+	}
+	m_vszRuns.push_back(szRun);
+}
+
+void OfferSpill::writeTuples(const string& szRun, ofstream& ofs, const OfferTuple* pTuples, size_t nTuples) {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_OFFERSPILL_WRITETUPLES = "writeTuples";
+
+	ofs.write(reinterpret_cast<const char*>(pTuples), nTuples * sizeof(OfferTuple));
+	if (!ofs) {
+		TracedException te(SZ_OFFERSPILL_EXCEPTION, "Unable to write offer run " + szRun, SZ_OFFERSPILL_WRITETUPLES);
+		throw te;
+	}
+}
+
+void OfferSpill::spill() {
+
+	// Sort the buffer in place and write it as the next run
+	std::sort(m_vTuples.begin(), m_vTuples.end(), lessTuple);
+
+	string szRun = newRunFile();
+	ofstream ofs;
+	openRun(szRun, ofs);
+	writeTuples(szRun, ofs, m_vTuples.data(), m_vTuples.size());
+
+	m_vTuples.clear();
+	++m_nRuns;
+}
+
+bool OfferSpill::readNext(RunReader& rr) {
+
+	// Move to the next tuple of the run, reading the next block when the current one is done
+	if (++rr.nPos < rr.vBlock.size())
+		return true;
+
+	rr.vBlock.resize(m_nBlockTuples);
+	rr.ifs.read(reinterpret_cast<char*>(rr.vBlock.data()), m_nBlockTuples * sizeof(OfferTuple));
+	rr.vBlock.resize(static_cast<size_t>(rr.ifs.gcount()) / sizeof(OfferTuple));
+	rr.nPos = 0;
+	return !rr.vBlock.empty();
+}
+
+void OfferSpill::mergeRuns(size_t iFirst, size_t iLast, const boost::function<void(const OfferTuple&)>& fnOut) {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_OFFERSPILL_MERGERUNS = "mergeRuns";
+
+	vector<RunReader> vReaders(iLast - iFirst);
+	vector<size_t> vHeap;
+
+	// Min-heap of the readers on their current tuple
+	auto cmpReader = [&vReaders](size_t i1, size_t i2) {
+		return lessTuple(vReaders[i2].vBlock[vReaders[i2].nPos], vReaders[i1].vBlock[vReaders[i1].nPos]);
+	};
+
+	for (size_t i = 0; i < vReaders.size(); ++i) {
+		const string& szRun = m_vszRuns[iFirst + i];
+		vReaders[i].ifs.open(szRun, ios_base::in | ios_base::binary);
+		if (!vReaders[i].ifs.is_open()) {
+			TracedException te(SZ_OFFERSPILL_EXCEPTION, "Unable to read offer run " + szRun, SZ_OFFERSPILL_MERGERUNS);
+			throw te;
+		}
+
+		vReaders[i].nPos = 0;
+		if (readNext(vReaders[i]))
+			vHeap.push_back(i);
+	}
+	make_heap(vHeap.begin(), vHeap.end(), cmpReader);
+
+	while (!vHeap.empty()) {
+
+		pop_heap(vHeap.begin(), vHeap.end(), cmpReader);
+		RunReader& rr = vReaders[vHeap.back()];
+		fnOut(rr.vBlock[rr.nPos]);
+
+		if (readNext(rr))
+			push_heap(vHeap.begin(), vHeap.end(), cmpReader);
+		else
+			vHeap.pop_back();
+	}
+}
+
+void OfferSpill::removeRuns() {
+
+	boost::system::error_code ec;
+	for (const string& szRun : m_vszRuns) {
+		if (!szRun.empty())
+			boost::filesystem::remove(szRun, ec);
+	}
+	m_vszRuns.clear();
+}
+
+void OfferSpill::buildOffers(const priceSet& sPrice, mapOffers& mo) {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_OFFERSPILL_BUILDOFFERS = "buildOffers";
+
+	try {
+		// Group the sorted tuples by price, keeping the first level of each row and the size changes from row to row
+		bool bPrice = false;
+		long nPrice = 0;
+		int iLastRow = -1;
+		vSizeRow vpsr;
+
+		auto flushPrice = [&]() {
+			if (bPrice && sPrice.count(nPrice) > 0)
+				mo.insert(make_pair(nPrice, std::move(vpsr)));
+			vpsr.clear();
+		};
+
+		auto addTuple = [&](const OfferTuple& ot) {
+			if (!bPrice || ot.nPrice != nPrice) {
+				flushPrice();
+				bPrice = true;
+				nPrice = static_cast<long>(ot.nPrice);
+				iLastRow = -1;
+			}
+
+			if (ot.iRow == iLastRow)
+				return;
+			iLastRow = ot.iRow;
+
+			if (vpsr.empty() || vpsr.back().first != ot.nSize)
+				vpsr.push_back(make_pair(static_cast<long>(ot.nSize), ot.iRow));
+		};
+
+		if (m_vszRuns.empty()) {
+
+			// Everything fitted in the buffer, no run was spilled
+			std::sort(m_vTuples.begin(), m_vTuples.end(), lessTuple);
+			for (const OfferTuple& ot : m_vTuples)
+				addTuple(ot);
+			vector<OfferTuple>().swap(m_vTuples);
+		}
+		else {
+			// Spill the rest of the buffer and release it, the budget goes to the merge blocks from now on
+			if (!m_vTuples.empty())
+				spill();
+			vector<OfferTuple>().swap(m_vTuples);
+
+			// Merge consecutive runs into longer ones until a read block of each remaining run fits in the budget.
+			// The merged runs are added after the runs of the pass, whose files are removed as soon as they are merged.
+			while (m_vszRuns.size() > m_nFanIn) {
+
+				size_t nRuns = m_vszRuns.size();
+				vector<OfferTuple> vBlock;
+				vBlock.reserve(m_nBlockTuples);
+
+				for (size_t i = 0; i < nRuns; i += m_nFanIn) {
+
+					size_t iLast = min(i + m_nFanIn, nRuns);
+					string szRun = newRunFile();
+					ofstream ofs;
+					openRun(szRun, ofs);
+
+					mergeRuns(i, iLast, [&](const OfferTuple& ot) {
+						vBlock.push_back(ot);
+						if (vBlock.size() == m_nBlockTuples) {
+							writeTuples(szRun, ofs, vBlock.data(), vBlock.size());
+							vBlock.clear();
+						}
+					});
+					writeTuples(szRun, ofs, vBlock.data(), vBlock.size());
+					vBlock.clear();
+					ofs.close();
+
+					boost::system::error_code ec;
+					for (size_t j = i; j < iLast; ++j) {
+						boost::filesystem::remove(m_vszRuns[j], ec);
+						m_vszRuns[j].clear();
+					}
+				}
+
+				m_vszRuns.erase(m_vszRuns.begin(), m_vszRuns.begin() + nRuns);
+				++m_nPasses;
+			}
+
+			mergeRuns(0, m_vszRuns.size(), addTuple);
+			++m_nPasses;
+		}
+		flushPrice();
+
+		// Prices without any level on their side still have their (empty) offers
+		for (const long& kPrice : sPrice)
+			mo.insert(make_pair(kPrice, vSizeRow()));
+
+		removeRuns();
+	}
+	catch (const TracedException&) {
+		removeRuns();
+		throw;
+	}
+	catch (const std::bad_alloc&) {
+		removeRuns();
+		TracedException te(SZ_OFFERSPILL_EXCEPTION, TracedException::SZ_EXCEPTION_BADALLOC, SZ_OFFERSPILL_BUILDOFFERS);
+		throw te;
+	}
+	catch (...) {
+		removeRuns();
+		TracedException te(SZ_OFFERSPILL_EXCEPTION, TracedException::SZ_EXCEPTION_UNEXPECTED, SZ_OFFERSPILL_BUILDOFFERS);
+		throw te;
+	}
+}
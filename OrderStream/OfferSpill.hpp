@@ -0,0 +1,87 @@
+#pragma once
+
+#include <fstream>
+#include <cstdint>
+#include <boost/function.hpp>
+
+#include "OrderStream.hpp"
+
+// Level of one side of a row book, as a <price, row, size> tuple
+typedef struct OfferTuple {
+
+	int64_t		nPrice;
+	int64_t		nSize;
+	int32_t		iRow;
+	int32_t		iLevel;		// Order of the tuple among the ones added for its row
+
+} OfferTuple;
+
+// Out of core replacement of the <price, <size, row>> multimap of one side of the book, for sessions whose
+// level updates don't fit in memory. The tuples of the rows are accumulated in a buffer sized to the memory
+// budget, and each time it is full it is sorted by price then row and spilled as a run to a temporary file.
+// At the end the runs are merged k ways, in passes over consecutive runs when the budget can't hold a read
+// block for each of them, and the merged tuples are grouped by price into the same size sequences as the
+// in memory offers: one size per row, the first level of a row for its price, and a size kept only when it
+// differs from the one of the previous row. Tuples of a row are numbered in the order they are added, so the
+// sort key is unique, runs are sorted in place and the merge keeps the order of the in memory multimap.
+// The tuple buffer and the merge blocks stay within the budget, the offers built from them and the rows of the
+// stream are not counted.
+class OfferSpill {
+
+public:
+	OfferSpill() = delete;
+	OfferSpill(const OfferSpill&) = delete;
+	OfferSpill& operator=(const OfferSpill&) = delete;
+
+	// Runs are written to szDir, or to the temporary directory of the system when it is empty
+	OfferSpill(const string& szDir, size_t nMemoryBytes);
+	~OfferSpill();
+
+	void add(long nPrice, long nSize, int iRow);
+
+	// Build the offers of the prices of the set from all the tuples added, then drop the runs
+	void buildOffers(const priceSet& sPrice, mapOffers& mo);
+
+	uint64_t getTuples() const			{ return m_nTuples; }
+	size_t getRuns() const				{ return m_nRuns; }
+	size_t getPasses() const			{ return m_nPasses; }
+
+private:
+	// Sequential reader of a run through a block of tuples
+	typedef struct RunReader {
+
+		ifstream			ifs;
+		vector<OfferTuple>	vBlock;
+		size_t				nPos;
+
+	} RunReader;
+
+	void	spill();
+	string	newRunFile() const;
+	void	openRun(const string& szRun, ofstream& ofs);
+	void	writeTuples(const string& szRun, ofstream& ofs, const OfferTuple* pTuples, size_t nTuples);
+	bool	readNext(RunReader& rr);
+	void	mergeRuns(size_t iFirst, size_t iLast, const boost::function<void(const OfferTuple&)>& fnOut);
+	void	removeRuns();
+
+	static bool lessTuple(const OfferTuple& ot1, const OfferTuple& ot2);
+
+private:
+	string				m_szDir;
+	size_t				m_nMemoryBytes;
+	size_t				m_nBufferTuples;
+	size_t				m_nBlockTuples;
+	size_t				m_nFanIn;
+
+	vector<OfferTuple>	m_vTuples;
+	vector<string>		m_vszRuns;
+	int					m_iLastRow;
+	int					m_iLevel;
+
+	uint64_t			m_nTuples;
+	size_t				m_nRuns;
+	size_t				m_nPasses;
+
+	static constexpr size_t	SPILL_BLOCK_SIZE	= 256 * 1024;
+	static constexpr auto SZ_OFFERSPILL_EXCEPTION	= "OfferSpill Exception";
+};
@@ -1,5 +1,8 @@
 #pragma once
 
+#include "SeriesStore.hpp"
+#include "QuantileSketch.hpp"
+
 typedef set<long>					priceSet, sizeSet;
 typedef map<long, int>				mapPrice, mapSize;
 typedef pair<long, long>			pairPriceSize;
@@ -35,6 +38,70 @@ typedef struct PriceOffers {
 
 } PriceOffers;
 
+typedef struct LiquiditySeries {
+
+	long			nClipSize;		// Size used to price a fill against each side of the book
+
+	vector<int64_t>	vTimestamp;		// Row time in nanoseconds since epoch (UTC)
+	vector<long>	vBidDepth;		// Cumulative size of the bid levels
+	vector<long>	vAskDepth;		// Cumulative size of the ask levels
+	vector<double>	vBuyFill;		// Average price to buy the clip on the asks, NaN when the book is too thin
+	vector<double>	vSellFill;		// Average price to sell the clip on the bids, NaN when the book is too thin
+	vector<double>	vImbalance;		// (bid depth - ask depth) / (bid depth + ask depth)
+	vector<double>	vMicroprice;	// Best bid and ask weighted by the size on the opposite side
+
+} LiquiditySeries;
+
+typedef struct TradeSeries {
+
+	long			nTickSize;		// Price step of the volume profile
+	int64_t			nBucketNs;		// Length of the time buckets
+
+	uint64_t		nTrades;		// Rises of the accumulated volume of the feed
+	int64_t			nVolume;		// Volume of all the trades
+	int64_t			nPricedVolume;	// Volume of the trades with a price, the VWAP is over them
+	double			dNotional;		// Latest trade price times volume of the trades with a price
+	uint64_t		nUnpricedTrades;	// Trades of rows without a latest trade price, left out of the VWAP and the profile
+	int64_t			nUnpricedVolume;
+	uint64_t		nSplitTrades;	// Trades of more volume than the latest trade size, several prints between two rows
+	int64_t			nSplitVolume;	// Volume of the prints that were not the latest trade of their row
+	int64_t			nFirstVolume;	// Accumulated volume of the first and last rows
+	int64_t			nLastVolume;
+	uint64_t		nResets;		// Falls of the accumulated volume, each one starting a new session
+
+	long			nProfileFirst;	// Price of the first slot of the profile
+	vector<int64_t>	vProfile;		// Traded volume of each price step from nProfileFirst
+	uint64_t		nProfileOutliers;	// Priced trades too far from the profile to fit its maximum span
+	int64_t			nProfileOutlierVolume;
+
+	int64_t			nBucketFirst;	// Start of the first time bucket in nanoseconds since epoch
+	vector<int64_t>	vBucketVolume;	// Traded volume of each time bucket
+	vector<int64_t>	vBucketPricedVolume;	// Volume of the trades with a price of each time bucket
+	vector<double>	vBucketNotional;// Traded notional of each time bucket
+	vector<double>	vRunningVwap;	// VWAP of all the priced trades up to the end of each bucket, NaN before the first trade
+	uint64_t		nBucketOutliers;	// Trades too late after the first bucket to fit the maximum span of the buckets
+	int64_t			nBucketOutlierVolume;
+
+} TradeSeries;
+
+// Spread and mid price change distributions of the rows of a trading status, in ticks
+typedef struct SpreadStats {
+
+	KllSketch		kllSpread;		// Spread of each row
+	KllSketch		kllMidChange;	// Signed change of the mid price from the previous row, rows where it moved
+	uint64_t		nMidUnchanged;	// Rows where the mid price didn't move
+	SpreadHistogram	shSpread;		// Rows and time at each spread
+
+} SpreadStats;
+
+typedef struct SpreadDistribution {
+
+	long						nTickSize;
+	map<string, SpreadStats>	mapStatus;	// Distributions of each trading status of the feed
+	SpreadStats					ssAll;		// Merge of all the statuses once the book is complete
+
+} SpreadDistribution;
+
 struct OrderBook
 {
 	string			szSourceFeed;
@@ -47,11 +114,13 @@ struct OrderBook
 	priceSet		sBidSize;			// Distinct best bid size
 	priceSet		sAskSize;			// Distinct best ask size
 
-	vecBidAsk		vBidAsk;			// Best bid ask feeds for the entire session
-	vector<int>		vSpread;			// Spread on each feed for the entire session
+	SeriesStore		series;				// Best bid ask, sizes, spread and time of the valid feeds for the entire session
 
 	PriceOffers		priceOffers;		// Bid and Ask offer book
 	BidAskSizeOffer	lastOffer;			// bid and ask levels from the last feed sorted by price and quantity
+	LiquiditySeries	liquidity;			// Per row liquidity metrics, empty unless enabled
+	TradeSeries		trades;				// Trade tape analytics, empty unless enabled
+	SpreadDistribution	spreads;		// Spread and mid change distributions, empty unless enabled
 
 	string			szBidVariation;		// Bid price percentage variation
 	string			szAskVariation;		// Ask price percentage variation
@@ -0,0 +1,242 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Order flow events inferred from consecutive book snapshots
+//==============================================================
+#include "pch.h"
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+#include <boost/regex.hpp>
+
+using namespace std;
+using namespace boost;
+
+#include "OrderFlow.hpp"
+
+namespace {
+
+	// Bid levels come from the highest price, ask levels from the lowest
+	inline bool isBefore(OrderFlow::FLOW_SIDE eSide, long nPrice1, long nPrice2) {
+		return (eSide == OrderFlow::FLOW_BID) ? nPrice1 > nPrice2 : nPrice1 < nPrice2;
+	}
+}
+
+OrderFlow::OrderFlow(const string& szFlowFile, int nMaxLevels, int nMatchRows) :
+	m_szFlowFile(szFlowFile), m_nMaxLevels(static_cast<size_t>(max(nMaxLevels, 1))), m_nMatchRows(max(nMatchRows, 0)), m_bFirst(true), m_nPrevVolume(0),
+	m_nMatchedTrades(0), m_nMatchedVolume(0) {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_ORDERFLOW_CONSTRUCTOR = "OrderFlow::OrderFlow";
+
+	m_nPrevBest[FLOW_BID] = 0;
+	m_nPrevBest[FLOW_ASK] = 0;
+	memset(m_vnEvents, 0, sizeof(m_vnEvents));
+	memset(m_vnVolume, 0, sizeof(m_vnVolume));
+
+	// The events are only counted without a file
+	if (m_szFlowFile.empty())
+		return;
+
+	m_ofs.open(m_szFlowFile, ios_base::out | ios_base::trunc | ios_base::binary);
+	if (!m_ofs.is_open()) {
+		TracedException te(SZ_ORDERFLOW_EXCEPTION, "Unable to open order flow file " + m_szFlowFile, SZ_ORDERFLOW_CONSTRUCTOR);
+		throw te;
+	}
+
+	uint32_t vHeader[2] = { 1, static_cast<uint32_t>(sizeof(FlowEvent)) };
+	m_szBuffer.reserve(WRITE_BUFFER_SIZE + sizeof(FlowEvent));
+	m_szBuffer += "OSFE";
+	m_szBuffer.append(reinterpret_cast<const char*>(vHeader), sizeof(vHeader));
+}
+
+const char* OrderFlow::getEventName(FLOW_EVENT eEvent) {
+
+	static const char* const SZ_FLOW_EVENTS[FLOW_COUNT] = { "added", "removed", "increased", "decreased", "best moved", "trade" };
+	return SZ_FLOW_EVENTS[eEvent];
+}
+
+void OrderFlow::addEvent(int iRow, FLOW_EVENT eEvent, FLOW_SIDE eSide, size_t nLevel, int64_t nPrice, int64_t nSize) {
+
+	++m_vnEvents[eEvent];
+	m_vnVolume[eEvent] += static_cast<uint64_t>((nSize < 0) ? -nSize : nSize);
+
+	if (!m_ofs.is_open())
+		return;
+
+	FlowEvent fe;
+	fe.iRow		= iRow;
+	fe.nType	= static_cast<uint8_t>(eEvent);
+	fe.nSide	= static_cast<uint8_t>(eSide);
+	fe.nLevel	= static_cast<uint16_t>(nLevel);
+	fe.nPrice	= nPrice;
+	fe.nSize	= nSize;
+	m_szBuffer.append(reinterpret_cast<const char*>(&fe), sizeof(fe));
+
+	if (m_szBuffer.size() >= WRITE_BUFFER_SIZE)
+		flush();
+}
+
+void OrderFlow::flush() {
+
+	if (!m_szBuffer.empty()) {
+		m_ofs.write(m_szBuffer.data(), m_szBuffer.size());
+		m_szBuffer.clear();
+	}
+}
+
+const vector<pairPriceSize>& OrderFlow::sortedSide(FLOW_SIDE eSide, const vector<pairPriceSize>& vLevels, vector<pairPriceSize>& vScratch) const {
+
+	// Feeds list the levels from the best price, the odd row that doesn't is sorted on a copy
+	bool bSorted = std::is_sorted(vLevels.begin(), vLevels.end(), [eSide](const pairPriceSize& pps1, const pairPriceSize& pps2) {
+		return isBefore(eSide, pps1.first, pps2.first);
+	});
+	if (bSorted)
+		return vLevels;
+
+	vScratch.assign(vLevels.begin(), vLevels.end());
+	std::stable_sort(vScratch.begin(), vScratch.end(), [eSide](const pairPriceSize& pps1, const pairPriceSize& pps2) {
+		return isBefore(eSide, pps1.first, pps2.first);
+	});
+	return vScratch;
+}
+
+void OrderFlow::matchTrades(long nPrice, int64_t nSize) {
+
+	// Size out of the book at a price goes to the oldest open trades at that price first
+	for (PendingTrade& pt : m_vPendingTrades) {
+
+		if (pt.nPrice != nPrice || pt.nRemaining == 0)
+			continue;
+
+		int64_t nMatched = min(pt.nRemaining, nSize);
+		pt.nRemaining -= nMatched;
+		m_nMatchedVolume += static_cast<uint64_t>(nMatched);
+		if (!pt.bMatched) {
+			pt.bMatched = true;
+			++m_nMatchedTrades;
+		}
+
+		nSize -= nMatched;
+		if (nSize == 0)
+			break;
+	}
+}
+
+void OrderFlow::diffSide(int iRow, FLOW_SIDE eSide, const vector<pairPriceSize>& vPrev, const vector<pairPriceSize>& vNext) {
+
+	// A side showing all its levels can't see past its last price
+	bool bPrevLimit = vPrev.size() >= m_nMaxLevels;
+	bool bNextLimit = vNext.size() >= m_nMaxLevels;
+	long nPrevLast = bPrevLimit ? vPrev.back().first : 0;
+	long nNextLast = bNextLimit ? vNext.back().first : 0;
+
+	size_t i = 0;
+	size_t j = 0;
+	bool bTrades = !m_vPendingTrades.empty();
+
+	while (i < vPrev.size() || j < vNext.size()) {
+
+		if (j == vNext.size() || (i < vPrev.size() && isBefore(eSide, vPrev[i].first, vNext[j].first))) {
+
+			// Price only in the previous row, removed unless it went past the last price in view
+			const pairPriceSize& pps = vPrev[i];
+			if (!bNextLimit || !isBefore(eSide, nNextLast, pps.first)) {
+				addEvent(iRow, FLOW_REMOVED, eSide, i, pps.first, -static_cast<int64_t>(pps.second));
+				if (bTrades)
+					matchTrades(pps.first, pps.second);
+			}
+			++i;
+		}
+		else if (i == vPrev.size() || isBefore(eSide, vNext[j].first, vPrev[i].first)) {
+
+			// Price only in this row, added unless it came from past the last price in view
+			const pairPriceSize& pps = vNext[j];
+			if (!bPrevLimit || !isBefore(eSide, nPrevLast, pps.first))
+				addEvent(iRow, FLOW_ADDED, eSide, j, pps.first, pps.second);
+			++j;
+		}
+		else {
+			// Same price on both rows
+			int64_t nChange = static_cast<int64_t>(vNext[j].second) - vPrev[i].second;
+			if (nChange > 0) {
+				addEvent(iRow, FLOW_INCREASED, eSide, j, vNext[j].first, nChange);
+			}
+			else if (nChange < 0) {
+				addEvent(iRow, FLOW_DECREASED, eSide, j, vNext[j].first, nChange);
+				if (bTrades)
+					matchTrades(vNext[j].first, -nChange);
+			}
+			++i;
+			++j;
+		}
+	}
+}
+
+void OrderFlow::onRow(const OBStream& obs, const OBRowFeed& obrf, int iRow) {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_ORDERFLOW_ONROW = "onRow";
+
+	try {
+		// A trade is a rise of the accumulated volume, the first row only sets the volume of the session so far
+		if (!m_bFirst && obrf.nVolume > m_nPrevVolume) {
+			int64_t nTraded = obrf.nVolume - m_nPrevVolume;
+			addEvent(iRow, FLOW_TRADE, FLOW_NONE, 0, obrf.pairLastTrade.first, nTraded);
+
+			PendingTrade pt = { iRow, obrf.pairLastTrade.first, nTraded, false };
+			m_vPendingTrades.push_back(pt);
+		}
+
+		const vector<pairPriceSize>& vBid = sortedSide(FLOW_BID, obrf.vecBidLevels, m_vScratch[FLOW_BID]);
+		const vector<pairPriceSize>& vAsk = sortedSide(FLOW_ASK, obrf.vecAskLevels, m_vScratch[FLOW_ASK]);
+
+		diffSide(iRow, FLOW_BID, m_vPrevBid, vBid);
+		diffSide(iRow, FLOW_ASK, m_vPrevAsk, vAsk);
+
+		// Best price moves, both sides need a price on the two rows
+		const long vBest[2] = { obrf.pairBidPriceSize.first, obrf.pairAskPriceSize.first };
+		for (int s = FLOW_BID; s <= FLOW_ASK; ++s) {
+			if (vBest[s] > 0 && m_nPrevBest[s] > 0 && vBest[s] != m_nPrevBest[s])
+				addEvent(iRow, FLOW_BEST_MOVED, static_cast<FLOW_SIDE>(s), 0, vBest[s], static_cast<int64_t>(vBest[s]) - m_nPrevBest[s]);
+			m_nPrevBest[s] = vBest[s];
+		}
+
+		// Close the trades matched in full or past the rows they can be matched on
+		m_vPendingTrades.erase(std::remove_if(m_vPendingTrades.begin(), m_vPendingTrades.end(), [this, iRow](const PendingTrade& pt) {
+			return pt.nRemaining == 0 || iRow - pt.iRow >= m_nMatchRows;
+		}), m_vPendingTrades.end());
+
+		// A fall of the volume starts a new session
+		m_nPrevVolume = obrf.nVolume;
+		m_bFirst = false;
+
+		m_vPrevBid.assign(vBid.begin(), vBid.end());
+		m_vPrevAsk.assign(vAsk.begin(), vAsk.end());
+	}
+	catch (const std::bad_alloc&) {
+		TracedException te(SZ_ORDERFLOW_EXCEPTION, TracedException::SZ_EXCEPTION_BADALLOC, SZ_ORDERFLOW_ONROW);
+		throw te;
+	}
+	catch (...) {
+		TracedException te(SZ_ORDERFLOW_EXCEPTION, TracedException::SZ_EXCEPTION_UNEXPECTED, SZ_ORDERFLOW_ONROW);
+		throw te;
+	}
+}
+
+void OrderFlow::onBook(OBStream& obs) {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_ORDERFLOW_ONBOOK = "onBook";
+
+	if (m_ofs.is_open()) {
+		flush();
+		m_ofs.close();
+
+		// A write that failed, on a full disk for instance, leaves a truncated record of the events
+		if (!m_ofs) {
+			TracedException te(SZ_ORDERFLOW_EXCEPTION, "Unable to write order flow file " + m_szFlowFile, SZ_ORDERFLOW_ONBOOK);
+			throw te;
+		}
+	}
+}
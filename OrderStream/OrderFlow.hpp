@@ -0,0 +1,106 @@
+#pragma once
+
+#include <fstream>
+#include <cstdint>
+
+#include "OrderStream.hpp"
+
+// Order flow inferred from consecutive depth snapshots of a stream. Each row holds the whole visible book, so
+// the change from the previous row is diffed side by side with one linear merge over the price sorted levels:
+//   added / removed     a price appears on or leaves the side
+//   increased           more size at a price, new orders
+//   decreased           less size at a price, cancels or fills
+//   best moved          the best price of a side changed, the size of the event is the price change
+//   trade               the accumulated volume of the CSV feed grew, at its latest trade price
+// Only the prices both snapshots can see are compared: when a side shows all its nMaxLevels levels, the prices
+// past its last one are out of view and a level crossing that limit is neither added nor removed.
+// Trades are cross-checked against the book: the size that leaves the book at the price of a trade, on its row
+// or on the next matchRows rows as the levels of a feed can lag its trade columns, is matched against the trade
+// volume. The events are written as fixed width records to an optional file, "OSFE" header then
+// FlowEvent records, and counted by type. It is a sink of the stream that keeps the previous levels between
+// rows and doesn't allocate once they are sized, so it can run inline while the book is built.
+class OrderFlow : public OBSink {
+
+public:
+	enum FLOW_EVENT {
+		FLOW_ADDED = 0,
+		FLOW_REMOVED,
+		FLOW_INCREASED,
+		FLOW_DECREASED,
+		FLOW_BEST_MOVED,
+		FLOW_TRADE,
+		FLOW_COUNT
+	};
+
+	enum FLOW_SIDE {
+		FLOW_BID = 0,
+		FLOW_ASK,
+		FLOW_NONE
+	};
+
+	typedef struct FlowEvent {
+		int32_t		iRow;
+		uint8_t		nType;			// FLOW_EVENT
+		uint8_t		nSide;			// FLOW_SIDE, none for the trades
+		uint16_t	nLevel;			// Level of the price in the row (in the previous row for a removed level)
+		int64_t		nPrice;
+		int64_t		nSize;			// Signed size change, price change of a best move, size of a trade
+	} FlowEvent;
+
+	OrderFlow() = delete;
+	OrderFlow(const string& szFlowFile, int nMaxLevels, int nMatchRows);
+
+	void onRow(const OBStream& obs, const OBRowFeed& obrf, int iRow);
+	void onBook(OBStream& obs);
+
+	uint64_t getEvents(FLOW_EVENT eEvent) const		{ return m_vnEvents[eEvent]; }
+	uint64_t getVolume(FLOW_EVENT eEvent) const		{ return m_vnVolume[eEvent]; }
+	uint64_t getMatchedTrades() const				{ return m_nMatchedTrades; }
+	uint64_t getMatchedVolume() const				{ return m_nMatchedVolume; }
+	const string& getFlowFile() const				{ return m_szFlowFile; }
+
+	static const char* getEventName(FLOW_EVENT eEvent);
+
+private:
+	void	diffSide(int iRow, FLOW_SIDE eSide, const vector<pairPriceSize>& vPrev, const vector<pairPriceSize>& vNext);
+	void	matchTrades(long nPrice, int64_t nSize);
+	void	addEvent(int iRow, FLOW_EVENT eEvent, FLOW_SIDE eSide, size_t nLevel, int64_t nPrice, int64_t nSize);
+	const vector<pairPriceSize>& sortedSide(FLOW_SIDE eSide, const vector<pairPriceSize>& vLevels, vector<pairPriceSize>& vScratch) const;
+	void	flush();
+
+private:
+	// Trade still open to the size leaving the book at its price
+	typedef struct PendingTrade {
+		int			iRow;
+		long		nPrice;
+		int64_t		nRemaining;
+		bool		bMatched;
+	} PendingTrade;
+
+	string			m_szFlowFile;
+	size_t			m_nMaxLevels;
+	int				m_nMatchRows;
+
+	ofstream		m_ofs;
+	string			m_szBuffer;
+
+	// Previous row of the stream
+	bool					m_bFirst;
+	vector<pairPriceSize>	m_vPrevBid;
+	vector<pairPriceSize>	m_vPrevAsk;
+	long					m_nPrevBest[2];
+	int64_t					m_nPrevVolume;
+
+	// Levels of the current row when they come unsorted
+	vector<pairPriceSize>	m_vScratch[2];
+
+	vector<PendingTrade>	m_vPendingTrades;
+
+	uint64_t		m_vnEvents[FLOW_COUNT];
+	uint64_t		m_vnVolume[FLOW_COUNT];
+	uint64_t		m_nMatchedTrades;
+	uint64_t		m_nMatchedVolume;
+
+	static constexpr size_t WRITE_BUFFER_SIZE	= 1 << 20;
+	static constexpr auto SZ_ORDERFLOW_EXCEPTION = "OrderFlow Exception";
+};
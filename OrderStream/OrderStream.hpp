@@ -2,11 +2,27 @@
 
 #include "TracedException.hpp"
 #include "OrderBook.hpp"
+#include "SpscRing.hpp"
+#include "FeedClock.hpp"
+#include "AllocProfiler.hpp"
+
+class FeedReader;
+class FeedIoService;
+class FeedIndex;
+class Conflator;
+class Checkpoint;
+class LiquidityAnalytics;
+class TradeAnalytics;
+class SpreadAnalytics;
+class OfferSpill;
 
 struct OBRowFeed
 {
 	string						szInstrument;
 	string						datetime;
+	int64_t						nTimestamp;		// Nanoseconds since epoch (UTC) parsed from datetime
+	int64_t						nTimestampLast;	// Time of the last feed row conflated into this row
+	int							nRepeat;		// Number of feed rows conflated into this row
 	string						szFeedStat;
 
 	pairPriceSize				pairBidPriceSize;
@@ -14,53 +30,229 @@ struct OBRowFeed
 
 	vector<pairPriceSize>		vecBidLevels;
 	vector<pairPriceSize>		vecAskLevels;
+
+	// Trades of the CSV feed when its trade columns are decoded, zero otherwise
+	pairPriceSize				pairLastTrade;	// Latest trade <price, size>
+	int64_t						nVolume;		// Volume traded in the session up to this row
 };
 
+typedef vector<OBRowFeed>	vRowBatch;
+
+class OBStream;
+class OBStreamCSV;
+class OBStreamLog;
+
+// Receiver of the rows of a stream as they are folded into its order book, and of the book once it is complete.
+// The sinks of a stream are called on the thread building its book in the order they were added, and see each
+// row in place without a copy, so any number of analyses share one parse and one pass over the rows.
+class OBSink {
+
+public:
+	virtual ~OBSink() {}
+
+	// Row iRow of the stream was just added to its order book
+	virtual void onRow(const OBStream& obs, const OBRowFeed& obrf, int iRow) {}
+
+	// The order book of the stream is complete and no row will follow
+	virtual void onBook(OBStream& obs) {}
+};
+
+typedef struct StreamParams {
+
+	int		nMaxBookLevels;		// Maximum number of levels kept on each side of a row book
+	int		nMaxBookDepth;		// Maximum number of offers plotted for each price
+	bool	bPipeline;			// Read, parse and build the order book on three concurrent stages
+	int		nBatchRows;			// Rows handed over at once from the parser to the builder stage
+	int		nUtcOffsetMinutes;	// Offset of the feed clock from UTC
+
+	// Pool reading the plain feeds of all the streams asynchronously, a reader thread per feed when null
+	boost::shared_ptr<FeedIoService>	pFeedIo;
+
+	bool	bIndex;				// Build and use a sparse time index sidecar of the feed
+	int		nIndexRows;			// Index a row at least every N rows
+	int		nIndexMs;			// Index a row at least every M milliseconds of feed time
+	int64_t	nWindowFrom;		// Only keep rows in the [from, to) time window, in nanoseconds since epoch
+	int64_t	nWindowTo;
+
+	int		nConflation;		// Conflator::CONFLATION_ID applied to the rows before book building
+	int		nConflationMs;		// Interval of the time based conflation
+
+	bool	bLiquidity;			// Compute the liquidity metrics of every row
+	long	nClipSize;			// Size priced against each side of the book for the fill metrics
+
+	bool	bCheckpoint;		// Journal the rows and checkpoint the parse state every N rows
+	int		nCheckpointRows;
+	bool	bResume;			// Resume from the last checkpoint of the stream
+	string	szCheckpointDir;	// Directory of the <stream>.ckpt files
+
+	string	szStreamName;		// Name of the stream in checkpoints and reports, the object name when empty
+
+	bool	bTrades;			// Decode the trade columns of the feeds that have them
+
+	bool	bTradeTape;			// Trade tape analytics of the feeds that carry their trades
+	long	nTickSize;			// Price step of the volume profile
+	int		nMaxProfileSlots;	// Maximum span of the volume profile in price steps
+	int		nTapeBucketMs;		// Length of the time buckets of the traded volume
+	int		nMaxTapeBuckets;	// Maximum span of the time buckets
+
+	bool	bSpreads;			// Spread and mid change distributions of each trading status
+	long	nSpreadTickSize;	// Price step the spreads and mid changes are counted in
+	int		nSketchK;			// Size of the quantile sketches, rank error about 1.7/k
+
+	bool	bSpillOffers;		// Build the offers out of core from sorted runs of the level updates
+	size_t	nSpillBytes;		// Share of the spill budget of this stream, for the level updates of both sides
+	string	szSpillDir;			// Directory of the runs, the temporary directory of the system when empty
+
+} StreamParams;
+
+// One feed file of a stream, with its reader, time index and position. A stream made of several
+// files keeps the next parsed row of each one to merge them in time order.
+typedef struct FeedSource {
+
+	size_t							iSource;
+	string							szFile;
+	boost::shared_ptr<FeedReader>	pFile;
+
+	// Sparse time index of the feed and position of the next row in the feed
+	boost::shared_ptr<FeedIndex>	pIndex;
+	bool							bIndexing;
+	bool							bEndOfFeed;
+	int64_t							nFeedRow;
+
+	OBRowFeed						obrfNext;
+
+} FeedSource;
+
+typedef struct PipelineStats {
+
+	RingStats	rsBuffers;		// Reader to parser hand-off of file buffers
+	RingStats	rsRows;			// Parser to builder hand-off of row batches
+
+} PipelineStats;
+
 class OBStream
 {
 private:
-	int		m_id;
-	string	m_szFile;
-	int		m_nMaxBookLevels;
-	int		m_nMaxBookDepth;
+	int				m_id;
+	string			m_szFile;
+	StreamParams	m_sp;
+	PipelineStats	m_ps;
+
+	// Feed files of the stream and the heap of <next row time, source> used to merge them
+	vector<FeedSource>				m_vSources;
+	vector<pair<int64_t, size_t>>	m_vMergeHeap;
+	bool							m_bMergePrimed;
+
+	// Optional conflation of the parsed rows and the next row it is given
+	boost::shared_ptr<Conflator>	m_pConflator;
+	OBRowFeed						m_obrfNext;
+
+	// Optional checkpoint of the parse state to resume a long run
+	boost::shared_ptr<Checkpoint>	m_pCheckpoint;
 
-	// Keeps valid bid ask feeds in order
-	vector<long>	m_vBids;
-	vector<long>	m_vAsks;
+	// Optional per row liquidity metrics
+	boost::shared_ptr<LiquidityAnalytics>	m_pLiquidity;
+
+	// Optional trade tape analytics
+	boost::shared_ptr<TradeAnalytics>		m_pTrades;
+
+	// Optional spread distributions
+	boost::shared_ptr<SpreadAnalytics>		m_pSpreads;
 
 	// Map of <price, <row,size>>
 	multimap<long, pairSizeRow>	m_mapBidFeed;
 	multimap<long, pairSizeRow>	m_mapAskFeed;
 
+	// Out of core replacement of the maps above when the offers are spilled
+	boost::shared_ptr<OfferSpill>	m_pBidSpill;
+	boost::shared_ptr<OfferSpill>	m_pAskSpill;
+
+	// Hash of the book of each row and prefix-combined hash of the rows up to it, aligned with the rows
+	vector<uint64_t>				m_vBookHash;
+	vector<uint64_t>				m_vRollingHash;
+
+	// Sinks published to on each row and on the complete book, not owned
+	vector<OBSink*>					m_vpSinks;
+
 protected:
 	vector<OBRowFeed>				m_vobrf;
 	boost::shared_ptr<OrderBook>	m_pOrderBook;
 
+	// Converts the feed clock to nanoseconds since epoch, only used by the parser
+	FeedClock						m_clock;
+
 	// Trace any exception that might occur
 	ErrorExceptionInfo m_eei;
 
 public:
-	OBStream(const string& szFile, const int& nMaxBookLevels, const int& nMaxBookDepth);
+	OBStream(const string& szFile, const StreamParams& sp);
 
 	const string& getSourceFile() const					{ return m_szFile; }
 
-	const OBRowFeed& getRowFeedAt(int i)				{ return m_vobrf.at(i); }
+	const OBRowFeed& getRowFeedAt(int i) const			{ return m_vobrf.at(i); }
 	int getNumRows() const								{ return m_vobrf.size(); }
 
+	// Hash of the normalized book of a row, and combined hash of the books of the rows [nFrom, nTo)
+	uint64_t getBookHash(int i) const					{ return m_vBookHash.at(i); }
+	uint64_t getRangeHash(int nFrom, int nTo) const;
+
+	// First row from nFrom at which the books of two aligned streams differ, found by binary search on the
+	// range hashes. Return -1 when the books match up to the end of the shorter stream.
+	static int findDivergence(const OBStream& obs1, const OBStream& obs2, int nFrom = 0);
+
 	operator boost::shared_ptr<OrderBook>()				{ return m_pOrderBook; }
 	boost::shared_ptr<OrderBook> getOrderBook()			{ return m_pOrderBook; }
 	const bool IsCaughtException() const				{ return !m_eei.szDesc.empty(); }
 	void setExceptionInfo(const TracedException& te)	{ m_eei = te.getExceptionInfo(); }
 
+	// Stage counters of the last pipelined run
+	const PipelineStats& getPipelineStats() const		{ return m_ps; }
+	const boost::shared_ptr<Conflator>& getConflator() const { return m_pConflator; }
+	const boost::shared_ptr<OfferSpill>& getBidSpill() const { return m_pBidSpill; }
+	const boost::shared_ptr<OfferSpill>& getAskSpill() const { return m_pAskSpill; }
+	bool isPipelined() const							{ return m_sp.bPipeline; }
+
+	// Publish the rows and the book of the stream to a sink, which must outlive the processing
+	void addSink(OBSink& sink)							{ m_vpSinks.push_back(&sink); }
+
 	void buildOrderBook();
 	void addPriceSizeLevels(vector<pairPriceSize>& vp, const string& szLevel, const regex& re);
+	void addPriceSizeLevels(vector<pairPriceSize>& vp, const char* pszBegin, const char* pszEnd, const regex& re);
 
-	
-	virtual void processFeeds() = 0;
+	// Read, parse and build the order book either in sequence or on a three stage pipeline
+	virtual void processFeeds();
 	virtual const string getObjectName() const = 0;
 	virtual void CheckNotifyException() const;
 
+protected:
+	// Feed specific parsing of one line into a standardized row feed
+	virtual bool hasHeader() const = 0;
+	// Each feed file of the stream can have its own header, selected before parsing its rows
+	virtual void parseHeader(size_t iSource, const string& line) {}
+	virtual void selectSource(size_t iSource) {}
+	virtual void parseRow(const string& line, OBRowFeed& obrf) = 0;
+	// Stage the heap traffic of reading and parsing the feed is charged to
+	virtual AllocProfiler::ALLOC_STAGE getParseStage() const = 0;
+
 private:
+	void openFeeds();
+	void openSource(FeedSource& fs, size_t nMaxBuffers, size_t nBufferSize, bool bResume = false, uint64_t nResumeOffset = 0);
+	bool readRow(string& line, OBRowFeed& obrf);
+	bool readConflatedRow(string& line, OBRowFeed& obrf);
+	bool readMergedRow(string& line, OBRowFeed& obrf);
+	bool readFeedRow(FeedSource& fs, string& line, OBRowFeed& obrf);
+	void closeFeeds();
+	RingStats getReaderStats() const;
+	bool resumeFeeds(const vector<string>& vFiles, size_t nMaxBuffers, size_t nBufferSize);
+	void saveCheckpoint();
+
+	void processSerial();
+	void processPipelined();
+	void parseStage(SpscRing<vRowBatch>& ringRows, ErrorExceptionInfo& eei);
+
+	void addRowToBook(const OBRowFeed& obrf, int iRow);
+	void finalizeOrderBook();
+
 	//void buildWall(const priceSet& ps, const mapLevels& ml, mapBook& mPrice, mapBook& mSize);
 	void addMapSizeOnRowChange(const long& kPrice, mapRowSize& mrs, mapOffers& mo);
 	void buildOffers();
@@ -68,14 +260,18 @@ private:
 	void setVariation();	// Set bid and ask price variations
 
 	static constexpr auto SZ_OBSTREAM_EXCEPTION	= "OBStream Exception";
+	static constexpr size_t ROW_RING_SIZE		= 64;
+	static constexpr size_t HEADER_BUFFER_SIZE	= 64 * 1024;
+	static constexpr size_t MERGE_BUFFER_SIZE	= 256 * 1024;
+	static constexpr size_t MERGE_MAX_BUFFERS	= 2;
+	static constexpr uint64_t ROLLING_HASH_BASE	= 0x100000001b3ULL;
 };
 
 class OBStreamCSV : public OBStream {
 public:
 	OBStreamCSV() = delete;
-	OBStreamCSV(const string& szFile, int& nMaxBookLevels, int& nMaxBookDepth) : OBStream(szFile, nMaxBookLevels, nMaxBookDepth) {}
+	OBStreamCSV(const string& szFile, const StreamParams& sp);
 
-	void processFeeds();
 	const string getObjectName() const { return "OBStreamCSV"; }
 
 	enum CSVFEED_ROW_ID {	
@@ -91,18 +287,44 @@ public:
 		CSVFEED_BID_PRICE, 
 		CSVFEED_BID_SIZE, 
 		CSVFEED_BID_LEVELS, 
-		CSVFEED_ASK_LEVELS };
+		CSVFEED_ASK_LEVELS,
+		CSVFEED_COUNT };
+
+protected:
+	bool hasHeader() const { return true; }
+	void parseHeader(size_t iSource, const string& line);
+	void selectSource(size_t iSource)		{ m_pLayout = &m_vLayouts.at(iSource); }
+	void parseRow(const string& line, OBRowFeed& obrf);
+	AllocProfiler::ALLOC_STAGE getParseStage() const	{ return AllocProfiler::STAGE_PARSE_CSV; }
 
 private:
+	typedef pair<const char*, size_t> FieldRef;
+
+	// Column of each quoted field of a file header (-1 for fields that are skipped) up to the last field to decode
+	typedef struct CsvLayout {
+		vector<int>		vFieldColumn;
+		int				nLastField;
+	} CsvLayout;
+
+	regex	m_rePriceQty;
+
+	// Columns decoded on each row as a mask of CSVFEED_ROW_ID bits, and the layout of each feed file
+	unsigned			m_nColumnMask;
+	vector<CsvLayout>	m_vLayouts;
+	const CsvLayout*	m_pLayout;
+	FieldRef			m_fields[CSVFEED_COUNT];
+
+	// Header names of the columns in CSVFEED_ROW_ID order
+	static const char* const SZ_CSVFEED_COLUMNS[CSVFEED_COUNT];
+
 	static constexpr auto SZ_OBSTREAMCSV_EXCEPTION = "OBStreamCSV Exception";
 };
 
 class OBStreamLog : public OBStream {
 public:
 	OBStreamLog() = delete;
-	OBStreamLog(const string& szFile, int& nMaxBookLevels, int& nMaxBookDepth) : OBStream(szFile, nMaxBookLevels, nMaxBookDepth) {}
+	OBStreamLog(const string& szFile, const StreamParams& sp);
 
-	void processFeeds();
 	const string getObjectName() const { return "OBStreamLog"; }
 
 	enum LOGFEED_ROW_ID {
@@ -115,9 +337,36 @@ public:
 		LOGFEED_ASK_BOOK
 	};
 
+protected:
+	bool hasHeader() const { return false; }
+	void parseRow(const string& line, OBRowFeed& obrf);
+	AllocProfiler::ALLOC_STAGE getParseStage() const	{ return AllocProfiler::STAGE_PARSE_LOG; }
+
 private:
+	regex	m_reDate;
+	regex	m_reEllipsis;
+	regex	m_rePriceQty;
+
 	static constexpr auto SZ_OBSTREAMLOG_EXCEPTION = "OBStreamLog Exception";
 };
 
+// Sink comparing the CSV and LOG streams of an instrument. It is added to both streams, which are processed
+// concurrently, and onBooks is called once on the thread of the last stream to complete its book.
+class OBPairSink : public OBSink {
+
+public:
+	OBPairSink() : m_pobsCsv(nullptr), m_pobsLog(nullptr) {}
+
+	void onBook(OBStream& obs);
+
+protected:
+	virtual void onBooks(OBStreamCSV& obsCsv, OBStreamLog& obsLog) = 0;
+
+private:
+	boost::mutex	m_mtxPair;
+	OBStreamCSV*	m_pobsCsv;
+	OBStreamLog*	m_pobsLog;
+};
+
 
 
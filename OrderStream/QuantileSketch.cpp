@@ -0,0 +1,197 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Mergeable quantile sketch and exact histogram of the spreads
+//==============================================================
+#include "pch.h"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+using namespace std;
+
+#include "QuantileSketch.hpp"
+
+constexpr int KllSketch::DEFAULT_K;
+
+KllSketch::KllSketch(int k) : m_k(max(k, 8)), m_vvLevels(1), m_nRetained(0), m_nCount(0), m_dMin(numeric_limits<double>::quiet_NaN()),
+	m_dMax(numeric_limits<double>::quiet_NaN()), m_nSeed(0x9e3779b9u) {
+
+	setCapacity();
+}
+
+void KllSketch::setCapacity() {
+
+	// The top level holds k values, each level below 2/3 of the one above it and at least 2
+	m_vnCapacity.resize(m_vvLevels.size());
+	m_nCapacity = 0;
+	for (size_t h = 0; h < m_vvLevels.size(); ++h) {
+		size_t nDepth = m_vvLevels.size() - h - 1;
+		m_vnCapacity[h] = max(static_cast<size_t>(ceil(m_k * pow(2.0 / 3.0, static_cast<double>(nDepth)))), static_cast<size_t>(2));
+		m_nCapacity += m_vnCapacity[h];
+	}
+}
+
+bool KllSketch::flipCoin() {
+
+	// xorshift32
+	m_nSeed ^= m_nSeed << 13;
+	m_nSeed ^= m_nSeed >> 17;
+	m_nSeed ^= m_nSeed << 5;
+	return (m_nSeed & 1) != 0;
+}
+
+void KllSketch::compress() {
+
+	while (m_nRetained > m_nCapacity) {
+
+		// Compact the lowest level over its capacity into the level above it
+		for (size_t h = 0; h < m_vvLevels.size(); ++h) {
+
+			if (m_vvLevels[h].size() < m_vnCapacity[h])
+				continue;
+
+			if (h + 1 == m_vvLevels.size()) {
+				m_vvLevels.emplace_back();
+				setCapacity();
+			}
+
+			vector<double>& vLevel = m_vvLevels[h];
+			vector<double>& vUp = m_vvLevels[h + 1];
+			sort(vLevel.begin(), vLevel.end());
+
+			// An odd value out stays on its level
+			double dOdd = 0;
+			bool bOdd = (vLevel.size() % 2) != 0;
+			if (bOdd) {
+				dOdd = vLevel.back();
+				vLevel.pop_back();
+			}
+
+			for (size_t i = flipCoin() ? 1 : 0; i < vLevel.size(); i += 2)
+				vUp.push_back(vLevel[i]);
+
+			m_nRetained -= vLevel.size() / 2;
+			vLevel.clear();
+			if (bOdd)
+				vLevel.push_back(dOdd);
+			break;
+		}
+	}
+}
+
+void KllSketch::add(double dValue) {
+
+	if (std::isnan(dValue))
+		return;
+
+	if (m_nCount == 0) {
+		m_dMin = dValue;
+		m_dMax = dValue;
+	}
+	else {
+		m_dMin = min(m_dMin, dValue);
+		m_dMax = max(m_dMax, dValue);
+	}
+	++m_nCount;
+
+	m_vvLevels[0].push_back(dValue);
+	if (++m_nRetained > m_nCapacity)
+		compress();
+}
+
+void KllSketch::merge(const KllSketch& kll) {
+
+	if (kll.m_nCount == 0)
+		return;
+
+	if (m_nCount == 0) {
+		m_dMin = kll.m_dMin;
+		m_dMax = kll.m_dMax;
+	}
+	else {
+		m_dMin = min(m_dMin, kll.m_dMin);
+		m_dMax = max(m_dMax, kll.m_dMax);
+	}
+	m_nCount += kll.m_nCount;
+
+	if (m_vvLevels.size() < kll.m_vvLevels.size()) {
+		m_vvLevels.resize(kll.m_vvLevels.size());
+		setCapacity();
+	}
+	for (size_t h = 0; h < kll.m_vvLevels.size(); ++h)
+		m_vvLevels[h].insert(m_vvLevels[h].end(), kll.m_vvLevels[h].begin(), kll.m_vvLevels[h].end());
+	m_nRetained += kll.m_nRetained;
+
+	compress();
+}
+
+double KllSketch::getQuantile(double q) const {
+
+	if (m_nCount == 0)
+		return numeric_limits<double>::quiet_NaN();
+	if (q <= 0)
+		return m_dMin;
+	if (q >= 1)
+		return m_dMax;
+
+	// Weighted values sorted, a value of level h weighs 2^h
+	vector<pair<double, uint64_t>> vWeighted;
+	vWeighted.reserve(getRetained());
+	uint64_t nTotal = 0;
+	for (size_t h = 0; h < m_vvLevels.size(); ++h) {
+		for (double d : m_vvLevels[h]) {
+			vWeighted.push_back(make_pair(d, static_cast<uint64_t>(1) << h));
+			nTotal += static_cast<uint64_t>(1) << h;
+		}
+	}
+	sort(vWeighted.begin(), vWeighted.end());
+
+	double dRank = q * nTotal;
+	uint64_t nCumulative = 0;
+	for (const pair<double, uint64_t>& pw : vWeighted) {
+		nCumulative += pw.second;
+		if (nCumulative >= dRank)
+			return pw.first;
+	}
+	return m_dMax;
+}
+
+size_t SpreadHistogram::getBucket(long nValue) {
+
+	// Locked and crossed books go to the first bucket, the widest spreads to the last one
+	size_t iBucket = min(static_cast<size_t>(max(nValue, 0L)), MAX_BUCKETS - 1);
+	if (iBucket >= m_vnRows.size()) {
+		m_vnRows.resize(iBucket + 1, 0);
+		m_vnTimeNs.resize(iBucket + 1, 0);
+	}
+	return iBucket;
+}
+
+void SpreadHistogram::addRow(long nValue) {
+
+	++m_vnRows[getBucket(nValue)];
+	++m_nRows;
+}
+
+void SpreadHistogram::addTime(long nValue, int64_t nTimeNs) {
+
+	m_vnTimeNs[getBucket(nValue)] += nTimeNs;
+	m_nTimeNs += nTimeNs;
+}
+
+void SpreadHistogram::merge(const SpreadHistogram& sh) {
+
+	if (sh.m_vnRows.size() > m_vnRows.size()) {
+		m_vnRows.resize(sh.m_vnRows.size(), 0);
+		m_vnTimeNs.resize(sh.m_vnTimeNs.size(), 0);
+	}
+
+	for (size_t i = 0; i < sh.m_vnRows.size(); ++i) {
+		m_vnRows[i] += sh.m_vnRows[i];
+		m_vnTimeNs[i] += sh.m_vnTimeNs[i];
+	}
+	m_nRows += sh.m_nRows;
+	m_nTimeNs += sh.m_nTimeNs;
+}
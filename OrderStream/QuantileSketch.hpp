@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+// KLL quantile sketch of a stream of values. The values are kept in levels of compactors, a value of level h
+// standing for 2^h values of the stream. When the sketch holds more than its capacity, the lowest level over
+// its own capacity is sorted and every other value of it, starting at a random one, moves up a level. The
+// capacity of a level shrinks by 2/3 from the top level down, so the sketch keeps about 3k values whatever
+// the length of the stream and a quantile is within about 1.7/k of its rank. Two sketches merge by appending
+// their levels and compacting, so partial sketches of chunks of a stream can be computed apart and merged.
+// The coin is a fixed seed generator, the same stream always gives the same sketch.
+class KllSketch {
+
+public:
+	explicit KllSketch(int k = DEFAULT_K);
+
+	void add(double dValue);
+	void merge(const KllSketch& kll);
+
+	// Value at rank q of [0, 1] of the stream, NaN when the sketch is empty
+	double getQuantile(double q) const;
+
+	uint64_t getCount() const			{ return m_nCount; }
+	double getMin() const				{ return m_dMin; }
+	double getMax() const				{ return m_dMax; }
+	size_t getRetained() const			{ return m_nRetained; }
+
+	static constexpr int DEFAULT_K	= 200;
+
+private:
+	void	setCapacity();
+	void	compress();
+	bool	flipCoin();
+
+private:
+	int						m_k;
+	vector<vector<double>>	m_vvLevels;
+	vector<size_t>			m_vnCapacity;	// Capacity of each level, they change as levels are added
+	size_t					m_nCapacity;
+	size_t					m_nRetained;
+	uint64_t				m_nCount;
+	double					m_dMin;
+	double					m_dMax;
+	uint32_t				m_nSeed;
+};
+
+// Exact histogram of integer values from 0, the spreads in ticks, counting rows and the time spent at each
+// value. Values past the last bucket go to it so that the memory doesn't grow with the session.
+class SpreadHistogram {
+
+public:
+	SpreadHistogram() : m_nRows(0), m_nTimeNs(0) {}
+
+	// A row at a value, and the time until the next row spent at that value
+	void addRow(long nValue);
+	void addTime(long nValue, int64_t nTimeNs);
+	void merge(const SpreadHistogram& sh);
+
+	size_t size() const								{ return m_vnRows.size(); }
+	uint64_t getRows(size_t i) const				{ return m_vnRows[i]; }
+	int64_t getTimeNs(size_t i) const				{ return m_vnTimeNs[i]; }
+	uint64_t getRows() const						{ return m_nRows; }
+	int64_t getTimeNs() const						{ return m_nTimeNs; }
+
+	static constexpr size_t MAX_BUCKETS	= 1024;
+
+private:
+	size_t	getBucket(long nValue);
+
+private:
+	vector<uint64_t>	m_vnRows;
+	vector<int64_t>		m_vnTimeNs;
+	uint64_t			m_nRows;
+	int64_t				m_nTimeNs;
+};
@@ -0,0 +1,495 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Loopback HTTP query service over the books of a loaded session
+//==============================================================
+#include "pch.h"
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <boost/regex.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/thread.hpp>
+#include <boost/make_shared.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/asio/read_until.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/asio/streambuf.hpp>
+
+using namespace std;
+using namespace boost;
+
+#include "QueryService.hpp"
+
+namespace {
+
+	using boost::asio::ip::tcp;
+
+	const size_t MAX_REQUEST_SIZE = 8192;
+
+	const char* getStatusText(int nStatus) {
+		switch (nStatus) {
+		case 200: return "OK";
+		case 400: return "Bad Request";
+		case 404: return "Not Found";
+		case 405: return "Method Not Allowed";
+		default: return "Internal Server Error";
+		}
+	}
+
+	// Decode the %XX escapes and '+' of a query string value
+	string decodeUrl(const string& sz) {
+
+		string szOut;
+		szOut.reserve(sz.size());
+		for (size_t i = 0; i < sz.size(); ++i) {
+
+			if (sz[i] == '+') {
+				szOut += ' ';
+			}
+			else if (sz[i] == '%' && i + 2 < sz.size() && isxdigit(static_cast<unsigned char>(sz[i + 1])) && isxdigit(static_cast<unsigned char>(sz[i + 2]))) {
+				szOut += static_cast<char>(stoi(sz.substr(i + 1, 2), nullptr, 16));
+				i += 2;
+			}
+			else {
+				szOut += sz[i];
+			}
+		}
+		return szOut;
+	}
+
+	void writeString(ostream& os, const string& sz) {
+
+		os << '"';
+		for (char c : sz) {
+			if (c == '"' || c == '\\')
+				os << '\\' << c;
+			else if (static_cast<unsigned char>(c) < 0x20)
+				os << ' ';
+			else
+				os << c;
+		}
+		os << '"';
+	}
+
+	void writeLevels(ostream& os, const vector<pairPriceSize>& vp) {
+
+		os << '[';
+		for (size_t i = 0; i < vp.size(); ++i)
+			os << (i ? "," : "") << '[' << vp[i].first << ',' << vp[i].second << ']';
+		os << ']';
+	}
+
+	// One client connection, requests are read and answered in turn while the client keeps it alive
+	class QuerySession : public boost::enable_shared_from_this<QuerySession> {
+
+	public:
+		QuerySession(tcp::socket socket, const QueryService& qs) : m_socket(std::move(socket)), m_sbRequest(MAX_REQUEST_SIZE), m_qs(qs) {}
+
+		void readRequest() {
+
+			boost::shared_ptr<QuerySession> pSelf = shared_from_this();
+			boost::asio::async_read_until(m_socket, m_sbRequest, "\r\n\r\n", [this, pSelf](const boost::system::error_code& ec, size_t nBytes) {
+
+				if (ec)
+					return;
+
+				// Only take the header of this request, a pipelined one may follow in the buffer
+				string szHeader(boost::asio::buffers_begin(m_sbRequest.data()), boost::asio::buffers_begin(m_sbRequest.data()) + nBytes);
+				m_sbRequest.consume(nBytes);
+
+				vector<string> vRequest;
+				string szLine = szHeader.substr(0, szHeader.find("\r\n"));
+				boost::split(vRequest, szLine, boost::is_any_of(" "), boost::token_compress_on);
+
+				bool bHttp11 = vRequest.size() > 2 && vRequest[2] == "HTTP/1.1";
+				bool bKeepAlive = bHttp11 ? !boost::ifind_first(szHeader, "connection: close") : static_cast<bool>(boost::ifind_first(szHeader, "connection: keep-alive"));
+
+				string szBody;
+				int nStatus = 405;
+				if (vRequest.size() > 1 && vRequest[0] == "GET")
+					nStatus = m_qs.handleRequest(vRequest[1], szBody);
+				else
+					szBody = "{\"error\":\"Only GET requests are served\"}";
+
+				ostringstream oss;
+				oss << "HTTP/1.1 " << nStatus << ' ' << getStatusText(nStatus) << "\r\n"
+					<< "Content-Type: application/json\r\n"
+					<< "Content-Length: " << szBody.size() << "\r\n"
+					<< (bKeepAlive ? "Connection: keep-alive\r\n" : "Connection: close\r\n") << "\r\n"
+					<< szBody;
+				m_szResponse = oss.str();
+
+				boost::asio::async_write(m_socket, boost::asio::buffer(m_szResponse), [this, pSelf, bKeepAlive](const boost::system::error_code& ec, size_t) {
+
+					if (!ec && bKeepAlive) {
+						readRequest();
+					}
+					else {
+						boost::system::error_code ecShutdown;
+						m_socket.shutdown(tcp::socket::shutdown_both, ecShutdown);
+					}
+				});
+			});
+		}
+
+	private:
+		tcp::socket				m_socket;
+		boost::asio::streambuf	m_sbRequest;
+		string					m_szResponse;
+		const QueryService&		m_qs;
+	};
+}
+
+QueryService::QueryService(const string& szAddress, unsigned short nPort, int nThreads) :
+	m_szAddress(szAddress), m_nPort(nPort), m_acceptor(m_ioc) {
+
+	m_nThreads = (nThreads > 0) ? nThreads : max(static_cast<int>(boost::thread::hardware_concurrency()), 1);
+}
+
+void QueryService::addSource(const string& szName, const OBStream& obs) {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_QUERYSERVICE_ADDSOURCE = "addSource";
+
+	try {
+		boost::shared_ptr<QuerySource> pqs = boost::make_shared<QuerySource>();
+		pqs->szName = szName;
+		pqs->pStream = &obs;
+		pqs->pBook = const_cast<OBStream&>(obs).getOrderBook();
+
+		// Index the rows on their time, a feed out of time order is sorted once here
+		vector<pair<int64_t, int>> vTimes;
+		vTimes.reserve(obs.getNumRows());
+		for (int i = 0; i < obs.getNumRows(); ++i) {
+			int64_t nTime = obs.getRowFeedAt(i).nTimestamp;
+			if (nTime != FeedClock::TIME_INVALID)
+				vTimes.push_back(make_pair(nTime, i));
+		}
+		if (!is_sorted(vTimes.begin(), vTimes.end()))
+			stable_sort(vTimes.begin(), vTimes.end(), [](const pair<int64_t, int>& p1, const pair<int64_t, int>& p2) { return p1.first < p2.first; });
+
+		pqs->vRowTime.reserve(vTimes.size());
+		pqs->vRow.reserve(vTimes.size());
+		for (const pair<int64_t, int>& p : vTimes) {
+			pqs->vRowTime.push_back(p.first);
+			pqs->vRow.push_back(p.second);
+		}
+
+		// Decode the series times once and keep the running sum of the spread for the window means
+		const SeriesStore& series = pqs->pBook->series;
+		pqs->vSeriesTime.reserve(series.size());
+		series.column(SeriesStore::SERIES_TIMESTAMP).forEach([&pqs](size_t, int64_t nTime) { pqs->vSeriesTime.push_back(nTime); });
+
+		pqs->vSpreadSum.reserve(series.size() + 1);
+		pqs->vSpreadSum.push_back(0);
+		series.column(SeriesStore::SERIES_SPREAD).forEach([&pqs](size_t, int64_t nSpread) { pqs->vSpreadSum.push_back(pqs->vSpreadSum.back() + nSpread); });
+
+		// Rows without a valid time or out of time order leave the rows of a window scattered in the series
+		pqs->bSeriesOrdered = is_sorted(pqs->vSeriesTime.begin(), pqs->vSeriesTime.end()) &&
+			(pqs->vSeriesTime.empty() || pqs->vSeriesTime.front() != FeedClock::TIME_INVALID);
+
+		m_vSources.push_back(pqs);
+	}
+	catch (const std::bad_alloc&) {
+		TracedException te(SZ_QUERYSERVICE_EXCEPTION, TracedException::SZ_EXCEPTION_BADALLOC, SZ_QUERYSERVICE_ADDSOURCE);
+		throw te;
+	}
+	catch (...) {
+		TracedException te(SZ_QUERYSERVICE_EXCEPTION, TracedException::SZ_EXCEPTION_UNEXPECTED, SZ_QUERYSERVICE_ADDSOURCE);
+		throw te;
+	}
+}
+
+void QueryService::startAccept() {
+
+	m_acceptor.async_accept([this](const boost::system::error_code& ec, tcp::socket socket) {
+
+		if (!ec) {
+			boost::system::error_code ecOption;
+			socket.set_option(tcp::no_delay(true), ecOption);
+			boost::make_shared<QuerySession>(std::move(socket), *this)->readRequest();
+		}
+		startAccept();
+	});
+}
+
+void QueryService::run() {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_QUERYSERVICE_RUN = "run";
+
+	try {
+		tcp::endpoint endpoint(boost::asio::ip::make_address(m_szAddress), m_nPort);
+		m_acceptor.open(endpoint.protocol());
+		m_acceptor.set_option(tcp::acceptor::reuse_address(true));
+		m_acceptor.bind(endpoint);
+		m_acceptor.listen();
+	}
+	catch (const boost::system::system_error& se) {
+		TracedException te(SZ_QUERYSERVICE_EXCEPTION, "Unable to listen on " + m_szAddress + ":" + to_string(m_nPort) + ", " + se.what(), SZ_QUERYSERVICE_RUN);
+		throw te;
+	}
+
+	cout << " Serving queries on http://" << m_szAddress << ":" << m_nPort << " with " << m_nThreads << " threads" << endl;
+	startAccept();
+
+	// The workers share the event loop, this thread is one of them
+	boost::thread_group ths;
+	for (int i = 1; i < m_nThreads; ++i)
+		ths.create_thread([this]() { m_ioc.run(); });
+	m_ioc.run();
+	ths.join_all();
+}
+
+int QueryService::handleRequest(const string& szTarget, string& szBody) const {
+
+	// Split the path from its query parameters
+	size_t nQuery = szTarget.find('?');
+	string szPath = szTarget.substr(0, nQuery);
+	mapParams mp;
+	if (nQuery != string::npos) {
+
+		vector<string> vParams;
+		string szQuery = szTarget.substr(nQuery + 1);
+		boost::split(vParams, szQuery, boost::is_any_of("&"), boost::token_compress_on);
+		for (const string& szParam : vParams) {
+			size_t nEqual = szParam.find('=');
+			if (nEqual != string::npos)
+				mp[decodeUrl(szParam.substr(0, nEqual))] = decodeUrl(szParam.substr(nEqual + 1));
+		}
+	}
+
+	ostringstream oss;
+	int nStatus = 404;
+	try {
+		if (szPath == "/quote")
+			nStatus = queryQuote(mp, oss);
+		else if (szPath == "/book")
+			nStatus = queryBook(mp, oss);
+		else if (szPath == "/spread")
+			nStatus = querySpread(mp, oss);
+		else if (szPath == "/diff")
+			nStatus = queryDiff(mp, oss);
+		else
+			writeError(oss, "Unknown query " + szPath + ", use /quote, /book, /spread or /diff");
+	}
+	catch (...) {
+		oss.str(string());
+		writeError(oss, "Query failed");
+		nStatus = 500;
+	}
+
+	szBody = oss.str();
+	return nStatus;
+}
+
+const QuerySource* QueryService::findSource(const mapParams& mp) const {
+
+	mapParams::const_iterator it = mp.find("source");
+	if (it == mp.end())
+		return nullptr;
+
+	for (const boost::shared_ptr<const QuerySource>& pqs : m_vSources) {
+		if (boost::iequals(pqs->szName, it->second))
+			return pqs.get();
+	}
+	return nullptr;
+}
+
+bool QueryService::getTime(const mapParams& mp, const string& szKey, int64_t& nTime) {
+
+	mapParams::const_iterator it = mp.find(szKey);
+	if (it == mp.end())
+		return false;
+
+	// Times are UTC in the gateway log format, each request has its own clock since it caches the date
+	FeedClock fc(0);
+	nTime = fc.parseLog(it->second.c_str(), it->second.size());
+	return nTime != FeedClock::TIME_INVALID;
+}
+
+int QueryService::findRowAt(const QuerySource& qs, int64_t nTime) {
+
+	// Last row at or before the time
+	vector<int64_t>::const_iterator it = upper_bound(qs.vRowTime.begin(), qs.vRowTime.end(), nTime);
+	if (it == qs.vRowTime.begin())
+		return -1;
+	return qs.vRow[it - qs.vRowTime.begin() - 1];
+}
+
+void QueryService::writeRow(ostream& os, const QuerySource& qs, int iRow, bool bLevels) {
+
+	os << "{\"source\":";
+	writeString(os, qs.szName);
+	if (iRow < 0) {
+		os << ",\"row\":null}";
+		return;
+	}
+
+	const OBRowFeed& obrf = qs.pStream->getRowFeedAt(iRow);
+	os << ",\"row\":" << iRow << ",\"time\":";
+	writeString(os, obrf.datetime);
+	os << ",\"status\":";
+	writeString(os, obrf.szFeedStat);
+	os << ",\"bid\":" << obrf.pairBidPriceSize.first << ",\"bidSize\":" << obrf.pairBidPriceSize.second
+		<< ",\"ask\":" << obrf.pairAskPriceSize.first << ",\"askSize\":" << obrf.pairAskPriceSize.second;
+
+	if (bLevels) {
+		os << ",\"bidBook\":";
+		writeLevels(os, obrf.vecBidLevels);
+		os << ",\"askBook\":";
+		writeLevels(os, obrf.vecAskLevels);
+	}
+	os << '}';
+}
+
+void QueryService::writeError(ostream& os, const string& szError) {
+
+	os << "{\"error\":";
+	writeString(os, szError);
+	os << '}';
+}
+
+int QueryService::queryQuote(const mapParams& mp, ostream& os) const {
+
+	int64_t nTime;
+	if (!getTime(mp, "t", nTime)) {
+		writeError(os, "Missing or invalid time t, expected YYYYMMDD-HH:MM:SS[.mmm]");
+		return 400;
+	}
+
+	os << "{\"t\":";
+	writeString(os, FeedClock::format(nTime));
+	os << ",\"sources\":[";
+	for (size_t i = 0; i < m_vSources.size(); ++i) {
+		os << (i ? "," : "");
+		writeRow(os, *m_vSources[i], findRowAt(*m_vSources[i], nTime), false);
+	}
+	os << "]}";
+	return 200;
+}
+
+int QueryService::queryBook(const mapParams& mp, ostream& os) const {
+
+	const QuerySource* pqs = findSource(mp);
+	mapParams::const_iterator it = mp.find("row");
+	if (pqs == nullptr || it == mp.end()) {
+		writeError(os, "Expected a known source and a row");
+		return 400;
+	}
+
+	int iRow = -1;
+	try {
+		iRow = stoi(it->second);
+	}
+	catch (...) {
+	}
+
+	if (iRow < 0 || iRow >= pqs->pStream->getNumRows()) {
+		writeError(os, "Row out of range [0, " + to_string(pqs->pStream->getNumRows()) + ")");
+		return 404;
+	}
+
+	writeRow(os, *pqs, iRow, true);
+	return 200;
+}
+
+int QueryService::querySpread(const mapParams& mp, ostream& os) const {
+
+	// The whole session unless a window is given
+	int64_t nFrom = INT64_MIN;
+	int64_t nTo = INT64_MAX;
+	if ((mp.count("from") && !getTime(mp, "from", nFrom)) || (mp.count("to") && !getTime(mp, "to", nTo))) {
+		writeError(os, "Invalid window time, expected YYYYMMDD-HH:MM:SS[.mmm]");
+		return 400;
+	}
+
+	const QuerySource* pqsOnly = findSource(mp);
+	os << "{\"sources\":[";
+	bool bFirst = true;
+	for (const boost::shared_ptr<const QuerySource>& pqs : m_vSources) {
+
+		if (pqsOnly != nullptr && pqsOnly != pqs.get())
+			continue;
+
+		int64_t nMin, nMax, nSum;
+		size_t nCount = getSpreadWindow(*pqs, nFrom, nTo, nMin, nMax, nSum);
+
+		os << (bFirst ? "" : ",") << "{\"source\":";
+		writeString(os, pqs->szName);
+		os << ",\"count\":" << nCount;
+		if (nCount > 0)
+			os << ",\"min\":" << nMin << ",\"max\":" << nMax << ",\"mean\":" << static_cast<double>(nSum) / nCount;
+		os << '}';
+		bFirst = false;
+	}
+	os << "]}";
+	return 200;
+}
+
+size_t QueryService::getSpreadWindow(const QuerySource& qs, int64_t nFrom, int64_t nTo, int64_t& nMin, int64_t& nMax, int64_t& nSum) {
+
+	// Rows of an ordered series in the window are a range, min and max come from the block ranges of the spread column
+	if (qs.bSeriesOrdered) {
+		size_t nBegin = lower_bound(qs.vSeriesTime.begin(), qs.vSeriesTime.end(), nFrom) - qs.vSeriesTime.begin();
+		size_t nEnd = lower_bound(qs.vSeriesTime.begin(), qs.vSeriesTime.end(), nTo) - qs.vSeriesTime.begin();
+
+		if (nEnd <= nBegin || !qs.pBook->series.column(SeriesStore::SERIES_SPREAD).getRange(nBegin, nEnd, nMin, nMax))
+			return 0;
+
+		nSum = qs.vSpreadSum[nEnd] - qs.vSpreadSum[nBegin];
+		return nEnd - nBegin;
+	}
+
+	// Otherwise every row with a valid time is checked against the window
+	size_t nCount = 0;
+	nMin = INT64_MAX;
+	nMax = INT64_MIN;
+	nSum = 0;
+	for (size_t i = 0; i < qs.vSeriesTime.size(); ++i) {
+
+		int64_t nTime = qs.vSeriesTime[i];
+		if (nTime == FeedClock::TIME_INVALID || nTime < nFrom || nTime >= nTo)
+			continue;
+
+		int64_t nSpread = qs.vSpreadSum[i + 1] - qs.vSpreadSum[i];
+		nMin = min(nMin, nSpread);
+		nMax = max(nMax, nSpread);
+		nSum += nSpread;
+		++nCount;
+	}
+	return nCount;
+}
+
+int QueryService::queryDiff(const mapParams& mp, ostream& os) const {
+
+	int64_t nTime;
+	if (!getTime(mp, "t", nTime)) {
+		writeError(os, "Missing or invalid time t, expected YYYYMMDD-HH:MM:SS[.mmm]");
+		return 400;
+	}
+
+	// The books match when every source has a row and all the book hashes are equal
+	vector<int> vRows;
+	for (const boost::shared_ptr<const QuerySource>& pqs : m_vSources)
+		vRows.push_back(findRowAt(*pqs, nTime));
+
+	// Without a row of the first source at t there is no reference book, so no match
+	bool bMatch = !vRows.empty() && vRows[0] >= 0;
+	if (bMatch) {
+		uint64_t nHash = m_vSources[0]->pStream->getBookHash(vRows[0]);
+		for (size_t i = 1; i < m_vSources.size() && bMatch; ++i)
+			bMatch = vRows[i] >= 0 && m_vSources[i]->pStream->getBookHash(vRows[i]) == nHash;
+	}
+
+	os << "{\"t\":";
+	writeString(os, FeedClock::format(nTime));
+	os << ",\"match\":" << (bMatch ? "true" : "false") << ",\"sources\":[";
+	for (size_t i = 0; i < m_vSources.size(); ++i) {
+		os << (i ? "," : "");
+		writeRow(os, *m_vSources[i], vRows[i], true);
+	}
+	os << "]}";
+	return 200;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <map>
+#include <cstdint>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+
+#include "OrderStream.hpp"
+
+// Read-only view of a loaded stream with the indexes the queries search. It is built once before serving
+// and shared by all the workers without locking.
+typedef struct QuerySource {
+
+	string							szName;
+	const OBStream*					pStream;
+	boost::shared_ptr<const OrderBook>	pBook;
+
+	vector<int64_t>		vRowTime;		// Time of each row with a valid time, in row order
+	vector<int>			vRow;			// Row of each of those times
+	vector<int64_t>		vSeriesTime;	// Time of each row of the best bid/ask series
+	vector<int64_t>		vSpreadSum;		// Prefix sums of the series spread, vSpreadSum[i] is the sum of the first i
+	bool				bSeriesOrdered;	// Series times all valid and in time order, a window is then a range of rows
+
+} QuerySource;
+
+// Long running query service over the books of a session loaded once. Requests are plain HTTP GET on a
+// loopback address, answered in JSON:
+//   /quote?t=YYYYMMDD-HH:MM:SS.mmm				best bid/ask of each source at time t
+//   /book?source=name&row=i					row i of a source with its book levels
+//   /spread?from=time&to=time[&source=name]	count, min, max and mean spread over the [from, to) window
+//   /diff?t=time								book of each source at time t and whether they match
+// The connections are served by a small event loop run by a pool of worker threads, each request only
+// reads the immutable sources so no lock is taken.
+class QueryService {
+
+public:
+	QueryService() = delete;
+	QueryService(const string& szAddress, unsigned short nPort, int nThreads);
+
+	void addSource(const string& szName, const OBStream& obs);
+
+	// Serve the queries until the process is stopped
+	void run();
+
+	// Answer the target of a request, return the HTTP status and fill the JSON body
+	int handleRequest(const string& szTarget, string& szBody) const;
+
+private:
+	typedef map<string, string> mapParams;
+
+	void startAccept();
+
+	int queryQuote(const mapParams& mp, ostream& os) const;
+	int queryBook(const mapParams& mp, ostream& os) const;
+	int querySpread(const mapParams& mp, ostream& os) const;
+	int queryDiff(const mapParams& mp, ostream& os) const;
+
+	const QuerySource* findSource(const mapParams& mp) const;
+	static bool getTime(const mapParams& mp, const string& szKey, int64_t& nTime);
+	static int findRowAt(const QuerySource& qs, int64_t nTime);
+	static size_t getSpreadWindow(const QuerySource& qs, int64_t nFrom, int64_t nTo, int64_t& nMin, int64_t& nMax, int64_t& nSum);
+	static void writeRow(ostream& os, const QuerySource& qs, int iRow, bool bLevels);
+	static void writeError(ostream& os, const string& szError);
+
+private:
+	string			m_szAddress;
+	unsigned short	m_nPort;
+	int				m_nThreads;
+
+	vector<boost::shared_ptr<const QuerySource>>	m_vSources;
+
+	boost::asio::io_context			m_ioc;
+	boost::asio::ip::tcp::acceptor	m_acceptor;
+
+	static constexpr auto SZ_QUERYSERVICE_EXCEPTION = "QueryService Exception";
+};
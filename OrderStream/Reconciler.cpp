@@ -0,0 +1,233 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// N-way reconciliation of feed sources against their consensus
+//==============================================================
+#include "pch.h"
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <functional>
+#include <boost/regex.hpp>
+
+using namespace std;
+using namespace boost;
+
+#include "Reconciler.hpp"
+#include "Conflator.hpp"
+
+Reconciler::Reconciler(int nToleranceMs) : m_nUpdates(0), m_nNoConsensus(0) {
+
+	m_nToleranceNs = static_cast<int64_t>(max(nToleranceMs, 0)) * FeedClock::NS_PER_MS;
+}
+
+void Reconciler::addSource(const string& szName, const OBStream& obs) {
+
+	ReconcileSource rs = { szName, 0, 0, 0, 0 };
+	m_vSources.push_back(rs);
+
+	SourceCursor sc = { &obs, 0, -1, 0, FeedClock::TIME_INVALID };
+	m_vCursors.push_back(sc);
+}
+
+bool Reconciler::nextTimedRow(SourceCursor& sc) {
+
+	// Rows without a valid time can't be placed against the other sources
+	while (sc.iNext < sc.pStream->getNumRows()) {
+		if (sc.pStream->getRowFeedAt(sc.iNext).nTimestamp != FeedClock::TIME_INVALID)
+			return true;
+		++sc.iNext;
+	}
+	return false;
+}
+
+void Reconciler::writeLevels(ostream& os, const vector<pairPriceSize>& vp) {
+
+	for (size_t i = 0; i < vp.size(); ++i) {
+		if (i > 0)
+			os << ';';
+		os << vp[i].first << 'x' << vp[i].second;
+	}
+}
+
+void Reconciler::writeQuoted(ostream& os, const string& sz) {
+
+	// A quote inside a quoted field is doubled
+	for (char c : sz) {
+		if (c == '"')
+			os << '"';
+		os << c;
+	}
+}
+
+void Reconciler::closeDeviation(ReconcileSource& rs, SourceCursor& sc, int64_t nTimestamp) {
+
+	int64_t nAwayNs = nTimestamp - sc.nAwaySince;
+	if (nAwayNs > m_nToleranceNs) {
+		++rs.nDeviations;
+		rs.nDeviationNs += nAwayNs;
+	}
+	sc.nAwaySince = FeedClock::TIME_INVALID;
+}
+
+void Reconciler::voteUpdate(int64_t nTimestamp, ostream& os) {
+
+	// Majority vote on the book hashes in a single pass, the candidate is only a majority if it is verified
+	uint64_t nCandidate = 0;
+	size_t nVotes = 0;
+	size_t nPresent = 0;
+	for (const SourceCursor& sc : m_vCursors) {
+
+		if (sc.iCurrent < 0)
+			continue;
+
+		++nPresent;
+		if (nVotes == 0) {
+			nCandidate = sc.nHash;
+			nVotes = 1;
+		}
+		else if (sc.nHash == nCandidate) {
+			++nVotes;
+		}
+		else {
+			--nVotes;
+		}
+	}
+
+	size_t nAgreeing = 0;
+	const OBRowFeed* pobrfConsensus = nullptr;
+	for (const SourceCursor& sc : m_vCursors) {
+
+		if (sc.iCurrent >= 0 && sc.nHash == nCandidate) {
+			if (nAgreeing++ == 0)
+				pobrfConsensus = &sc.pStream->getRowFeedAt(sc.iCurrent);
+		}
+	}
+
+	bool bConsensus = nPresent > 0 && nAgreeing * 2 > nPresent;
+	++m_nUpdates;
+	if (!bConsensus)
+		++m_nNoConsensus;
+
+	os << FeedClock::format(nTimestamp) << ',' << nPresent << ',' << (bConsensus ? nAgreeing : 0) << ',';
+	if (bConsensus) {
+		os << pobrfConsensus->pairBidPriceSize.first << ',' << pobrfConsensus->pairBidPriceSize.second << ','
+			<< pobrfConsensus->pairAskPriceSize.first << ',' << pobrfConsensus->pairAskPriceSize.second << ',';
+		writeLevels(os, pobrfConsensus->vecBidLevels);
+		os << ',';
+		writeLevels(os, pobrfConsensus->vecAskLevels);
+	}
+	else {
+		os << ",,,,,";
+	}
+
+	// Compare each source with the consensus only
+	for (size_t i = 0; i < m_vCursors.size(); ++i) {
+
+		SourceCursor& sc = m_vCursors[i];
+		ReconcileSource& rs = m_vSources[i];
+		os << ',';
+
+		if (sc.iCurrent < 0)
+			continue;
+
+		if (!bConsensus) {
+			os << '?';
+			continue;
+		}
+
+		++rs.nUpdates;
+		if (sc.nHash == nCandidate) {
+			++rs.nAgreed;
+			if (sc.nAwaySince != FeedClock::TIME_INVALID)
+				closeDeviation(rs, sc, nTimestamp);
+			os << '=';
+		}
+		else {
+			if (sc.nAwaySince == FeedClock::TIME_INVALID)
+				sc.nAwaySince = nTimestamp;
+			os << ((nTimestamp - sc.nAwaySince > m_nToleranceNs) ? 'x' : '~');
+		}
+	}
+	os << '\n';
+}
+
+void Reconciler::reconcile(const string& szReportFile) {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_RECONCILER_RECONCILE = "reconcile";
+
+	ofstream ofs(szReportFile, ios_base::out | ios_base::trunc);
+	if (!ofs.is_open()) {
+		TracedException te(SZ_RECONCILER_EXCEPTION, "Unable to open reconciliation report " + szReportFile, SZ_RECONCILER_RECONCILE);
+		throw te;
+	}
+
+	try {
+		// The levels of a book are written as price x size pairs and the source names are quoted, so that
+		// only the separators of the report are commas
+		ofs << "TimeUtc,Sources,Agreeing,BestBidPrice,BestBidSize,BestAskPrice,BestAskSize,BidOrderBook,AskOrderBook";
+		for (const ReconcileSource& rs : m_vSources) {
+			ofs << ",\"";
+			writeQuoted(ofs, rs.szName);
+			ofs << '"';
+		}
+		ofs << '\n';
+
+		// Min-heap on the time of the next row of each source
+		typedef pair<int64_t, size_t> MergeKey;
+		greater<MergeKey> cmpMerge;
+		vector<MergeKey> vHeap;
+
+		for (size_t i = 0; i < m_vCursors.size(); ++i) {
+			SourceCursor& sc = m_vCursors[i];
+			sc.iNext = 0;
+			sc.iCurrent = -1;
+			sc.nAwaySince = FeedClock::TIME_INVALID;
+			if (nextTimedRow(sc))
+				vHeap.push_back(MergeKey(sc.pStream->getRowFeedAt(sc.iNext).nTimestamp, i));
+		}
+		make_heap(vHeap.begin(), vHeap.end(), cmpMerge);
+
+		int64_t nTimestamp = FeedClock::TIME_INVALID;
+		while (!vHeap.empty()) {
+
+			// Apply every row of this time to its source, the last one of a source wins
+			nTimestamp = vHeap.front().first;
+			while (!vHeap.empty() && vHeap.front().first == nTimestamp) {
+
+				pop_heap(vHeap.begin(), vHeap.end(), cmpMerge);
+				size_t iSource = vHeap.back().second;
+				SourceCursor& sc = m_vCursors[iSource];
+				vHeap.pop_back();
+
+				sc.iCurrent = sc.iNext++;
+				sc.nHash = Conflator::hashBook(sc.pStream->getRowFeedAt(sc.iCurrent));
+
+				if (nextTimedRow(sc)) {
+					vHeap.push_back(MergeKey(sc.pStream->getRowFeedAt(sc.iNext).nTimestamp, iSource));
+					push_heap(vHeap.begin(), vHeap.end(), cmpMerge);
+				}
+			}
+
+			voteUpdate(nTimestamp, ofs);
+		}
+
+		// Sources still away from the consensus at the end of the session
+		for (size_t i = 0; i < m_vCursors.size(); ++i) {
+			if (m_vCursors[i].nAwaySince != FeedClock::TIME_INVALID)
+				closeDeviation(m_vSources[i], m_vCursors[i], nTimestamp);
+		}
+	}
+	catch (const TracedException&) {
+		throw;
+	}
+	catch (const std::bad_alloc&) {
+		TracedException te(SZ_RECONCILER_EXCEPTION, TracedException::SZ_EXCEPTION_BADALLOC, SZ_RECONCILER_RECONCILE);
+		throw te;
+	}
+	catch (...) {
+		TracedException te(SZ_RECONCILER_EXCEPTION, TracedException::SZ_EXCEPTION_UNEXPECTED, SZ_RECONCILER_RECONCILE);
+		throw te;
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+
+#include "OrderStream.hpp"
+
+// Agreement of one source with the consensus over a reconciliation
+typedef struct ReconcileSource {
+
+	string		szName;
+	uint64_t	nUpdates;		// Updates with a consensus at which the source had a book
+	uint64_t	nAgreed;		// Updates at which its book was the consensus book
+	uint64_t	nDeviations;	// Times it stayed away from the consensus longer than the tolerance
+	int64_t		nDeviationNs;	// Time spent away from the consensus over those deviations
+
+} ReconcileSource;
+
+// Reconciles any number of streams of the same instrument. The rows of all the sources are merged in time
+// order through a heap, and at each update the current book of every source is hashed and a majority vote
+// (Boyer-Moore) picks the consensus book in one pass over the sources. Each source is then compared once with
+// the consensus, never with the other sources, so an update costs O(N) for N sources. A source away from the
+// consensus for longer than the tolerance, a feed lagging the others for instance, is flagged as deviating.
+class Reconciler {
+
+public:
+	Reconciler() = delete;
+	explicit Reconciler(int nToleranceMs);
+
+	void addSource(const string& szName, const OBStream& obs);
+
+	// Vote the consensus book of every update and write them to a CSV report with the state of each source:
+	//   =  agrees with the consensus
+	//   ~  away from the consensus within the tolerance
+	//   x  away from the consensus for longer than the tolerance
+	//   ?  no majority among the sources at this update
+	// A source without a book yet has an empty state. The levels of the consensus book are written as
+	// price x size pairs separated by ';' and the source names are quoted, so that no field holds a comma.
+	void reconcile(const string& szReportFile);
+
+	const vector<ReconcileSource>& getSources() const	{ return m_vSources; }
+	uint64_t getUpdates() const							{ return m_nUpdates; }
+	uint64_t getNoConsensus() const						{ return m_nNoConsensus; }
+
+private:
+	// Position of a source in its rows and its book at the current update
+	typedef struct SourceCursor {
+		const OBStream*	pStream;
+		int				iNext;			// Next row to apply
+		int				iCurrent;		// Row holding the current book, -1 before the first row
+		uint64_t		nHash;			// Hash of the current book
+		int64_t			nAwaySince;		// Time the source left the consensus, TIME_INVALID while it agrees
+	} SourceCursor;
+
+	bool nextTimedRow(SourceCursor& sc);
+	void voteUpdate(int64_t nTimestamp, ostream& os);
+	void closeDeviation(ReconcileSource& rs, SourceCursor& sc, int64_t nTimestamp);
+	void writeLevels(ostream& os, const vector<pairPriceSize>& vp);
+	void writeQuoted(ostream& os, const string& sz);
+
+private:
+	int64_t					m_nToleranceNs;
+	vector<ReconcileSource>	m_vSources;
+	vector<SourceCursor>	m_vCursors;
+	uint64_t				m_nUpdates;
+	uint64_t				m_nNoConsensus;
+
+	static constexpr auto SZ_RECONCILER_EXCEPTION = "Reconciler Exception";
+};
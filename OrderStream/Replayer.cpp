@@ -0,0 +1,156 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Timed replay of recorded feeds to a downstream consumer
+//==============================================================
+#include "pch.h"
+#include <algorithm>
+#include <functional>
+#include <boost/regex.hpp>
+#include <boost/thread.hpp>
+
+using namespace std;
+using namespace boost;
+
+#include "Replayer.hpp"
+
+void LatencyHistogram::add(int64_t nNs) {
+
+	uint64_t n = (nNs > 0) ? static_cast<uint64_t>(nNs) : 0;
+
+	int b = 0;
+	for (uint64_t v = n; v != 0; v >>= 1)
+		++b;
+
+	++vnCount[min(b, BUCKETS - 1)];
+	++nSamples;
+	nSumNs += n;
+	nMaxNs = max(nMaxNs, n);
+}
+
+uint64_t LatencyHistogram::getQuantile(double q) const {
+
+	if (nSamples == 0)
+		return 0;
+
+	uint64_t nRank = static_cast<uint64_t>(q * (nSamples - 1)) + 1;
+	uint64_t nSeen = 0;
+	for (int b = 0; b < BUCKETS; ++b) {
+		nSeen += vnCount[b];
+		if (nSeen >= nRank)
+			return (b == 0) ? 0 : (b == BUCKETS - 1) ? nMaxNs : min((uint64_t(1) << b) - 1, nMaxNs);
+	}
+	return nMaxNs;
+}
+
+Replayer::Replayer(double dSpeed, int nSpinUs) :
+	m_dSpeed(max(dSpeed, 0.0)), m_nsSpin(boost::chrono::microseconds(max(nSpinUs, 0))), m_nRows(0), m_nSessionNs(0), m_nElapsedNs(0) {
+}
+
+void Replayer::addSource(const string& szName, const OBStream& obs) {
+
+	m_vszSources.push_back(szName);
+	m_vpStreams.push_back(&obs);
+}
+
+int64_t Replayer::elapsedNs(const time_point& tpFrom, const time_point& tpTo) {
+
+	return boost::chrono::duration_cast<boost::chrono::nanoseconds>(tpTo - tpFrom).count();
+}
+
+void Replayer::waitUntil(const time_point& tp) const {
+
+	// Sleep through most of the wait, the scheduler wakes us up late by up to its granularity
+	time_point tpNow = boost::chrono::steady_clock::now();
+	if (tp - tpNow > m_nsSpin)
+		boost::this_thread::sleep_until(tp - m_nsSpin);
+
+	// Then spin on the clock for the rest
+	while (boost::chrono::steady_clock::now() < tp)
+		;
+}
+
+void Replayer::replay() {
+
+	// Stub to allocate function name at compile time
+	static const string SZ_REPLAYER_REPLAY = "replay";
+
+	if (!m_fnConsumer) {
+		TracedException te(SZ_REPLAYER_EXCEPTION, "No consumer to replay the feeds to", SZ_REPLAYER_REPLAY);
+		throw te;
+	}
+
+	try {
+		// Min-heap on the time of the next timed row of each source, the next row index is kept with it
+		typedef pair<int64_t, pair<size_t, int>> ReplayKey;
+		greater<ReplayKey> cmpReplay;
+		vector<ReplayKey> vHeap;
+
+		auto pushNext = [&](size_t iSource, int iRow) {
+			const OBStream& obs = *m_vpStreams[iSource];
+			for (; iRow < obs.getNumRows(); ++iRow) {
+				int64_t nTime = obs.getRowFeedAt(iRow).nTimestamp;
+				if (nTime != FeedClock::TIME_INVALID) {
+					vHeap.push_back(ReplayKey(nTime, make_pair(iSource, iRow)));
+					push_heap(vHeap.begin(), vHeap.end(), cmpReplay);
+					return;
+				}
+			}
+		};
+
+		for (size_t i = 0; i < m_vpStreams.size(); ++i)
+			pushNext(i, 0);
+
+		m_nRows = 0;
+		m_lhSlip = LatencyHistogram();
+		m_lhLatency = LatencyHistogram();
+		if (vHeap.empty())
+			return;
+
+		// The schedule starts with the first row of the session
+		int64_t nSessionStart = vHeap.front().first;
+		int64_t nSessionTime = nSessionStart;
+		time_point tpStart = boost::chrono::steady_clock::now();
+
+		while (!vHeap.empty()) {
+
+			pop_heap(vHeap.begin(), vHeap.end(), cmpReplay);
+			ReplayKey rk = vHeap.back();
+			vHeap.pop_back();
+
+			nSessionTime = rk.first;
+			size_t iSource = rk.second.first;
+			int iRow = rk.second.second;
+
+			time_point tpDue = tpStart;
+			if (m_dSpeed > 0) {
+				tpDue += boost::chrono::nanoseconds(static_cast<int64_t>((nSessionTime - nSessionStart) / m_dSpeed));
+				waitUntil(tpDue);
+			}
+
+			time_point tpConsume = boost::chrono::steady_clock::now();
+			if (m_dSpeed > 0)
+				m_lhSlip.add(elapsedNs(tpDue, tpConsume));
+
+			m_fnConsumer(iSource, m_vpStreams[iSource]->getRowFeedAt(iRow));
+			m_lhLatency.add(elapsedNs(tpConsume, boost::chrono::steady_clock::now()));
+			++m_nRows;
+
+			pushNext(iSource, iRow + 1);
+		}
+
+		m_nSessionNs = nSessionTime - nSessionStart;
+		m_nElapsedNs = elapsedNs(tpStart, boost::chrono::steady_clock::now());
+	}
+	catch (const std::bad_alloc&) {
+		TracedException te(SZ_REPLAYER_EXCEPTION, TracedException::SZ_EXCEPTION_BADALLOC, SZ_REPLAYER_REPLAY);
+		throw te;
+	}
+	catch (const TracedException&) {
+		throw;
+	}
+	catch (...) {
+		TracedException te(SZ_REPLAYER_EXCEPTION, TracedException::SZ_EXCEPTION_UNEXPECTED, SZ_REPLAYER_REPLAY);
+		throw te;
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <boost/function.hpp>
+#include <boost/chrono.hpp>
+
+#include "OrderStream.hpp"
+
+// Histogram of durations in power of two buckets of nanoseconds, bucket b counts the durations in
+// [2^(b-1), 2^b) and bucket 0 the zero durations. Adding a sample is a few instructions.
+typedef struct LatencyHistogram {
+
+	static const int BUCKETS = 64;
+
+	uint64_t	vnCount[BUCKETS];
+	uint64_t	nSamples;
+	uint64_t	nSumNs;
+	uint64_t	nMaxNs;
+
+	LatencyHistogram() : vnCount(), nSamples(0), nSumNs(0), nMaxNs(0) {}
+
+	void add(int64_t nNs);
+
+	// Upper bound of the bucket holding the quantile q of the samples, 0 when there are none
+	uint64_t getQuantile(double q) const;
+	uint64_t getMean() const		{ return nSamples ? nSumNs / nSamples : 0; }
+
+} LatencyHistogram;
+
+// Replays the rows of loaded streams to a consumer in time order, to load test downstream consumers with a
+// recorded session. The rows of all the sources are merged through a heap on their time and each one is handed
+// to the consumer at its time in the session scaled by the speed: 1 is real time, N is N times faster and 0 is
+// as fast as possible. Waits sleep until close to the due time then spin on the clock for the last microseconds,
+// the sleep alone is off by the scheduler granularity. Each row records how late it was handed over (schedule
+// slip) and how long the consumer took, a consumer that can't keep up shows as a growing slip.
+class Replayer {
+
+public:
+	typedef boost::function<void(size_t iSource, const OBRowFeed& obrf)> ReplayConsumer;
+
+	Replayer() = delete;
+	Replayer(double dSpeed, int nSpinUs);
+
+	void addSource(const string& szName, const OBStream& obs);
+	void setConsumer(const ReplayConsumer& fnConsumer)	{ m_fnConsumer = fnConsumer; }
+
+	// Replay all the rows with a valid time, return when the last one has been consumed
+	void replay();
+
+	const vector<string>& getSources() const			{ return m_vszSources; }
+	double getSpeed() const								{ return m_dSpeed; }
+	uint64_t getRows() const							{ return m_nRows; }
+	int64_t getSessionNs() const						{ return m_nSessionNs; }
+	int64_t getElapsedNs() const						{ return m_nElapsedNs; }
+	const LatencyHistogram& getSlip() const				{ return m_lhSlip; }
+	const LatencyHistogram& getLatency() const			{ return m_lhLatency; }
+
+private:
+	typedef boost::chrono::steady_clock::time_point time_point;
+
+	void waitUntil(const time_point& tp) const;
+	static int64_t elapsedNs(const time_point& tpFrom, const time_point& tpTo);
+
+private:
+	double					m_dSpeed;
+	boost::chrono::nanoseconds	m_nsSpin;
+	vector<string>			m_vszSources;
+	vector<const OBStream*>	m_vpStreams;
+	ReplayConsumer			m_fnConsumer;
+
+	uint64_t				m_nRows;
+	int64_t					m_nSessionNs;		// Session time between the first and last rows replayed
+	int64_t					m_nElapsedNs;		// Wall time of the replay
+	LatencyHistogram		m_lhSlip;
+	LatencyHistogram		m_lhLatency;
+
+	static constexpr auto SZ_REPLAYER_EXCEPTION = "Replayer Exception";
+};
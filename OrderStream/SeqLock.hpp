@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Single writer sequence lock over a small trivially copyable value. The writer makes the sequence odd,
+// stores the value and makes the sequence even again, it never waits. A reader copies the value between two
+// reads of the sequence and retries when a write overlapped the copy, so it never blocks the writer and
+// always returns a value written as a whole. The value is held in atomic words so that the racing copy is
+// well defined, and it sits on its own cache lines away from the other members of the owner.
+template <typename T>
+class SeqLock {
+
+	static_assert(std::is_trivially_copyable<T>::value, "SeqLock value must be trivially copyable");
+
+public:
+	SeqLock(const SeqLock&) = delete;
+	SeqLock& operator=(const SeqLock&) = delete;
+
+	SeqLock() : m_nSeq(0) {
+		for (std::atomic<uint64_t>& aw : m_vWords)
+			aw.store(0, std::memory_order_relaxed);
+	}
+
+	// Writer side, only one thread may write
+	void store(const T& value) {
+
+		uint64_t vWords[WORDS] = {};
+		memcpy(vWords, &value, sizeof(T));
+
+		uint64_t nSeq = m_nSeq.load(std::memory_order_relaxed);
+		m_nSeq.store(nSeq + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		for (size_t i = 0; i < WORDS; ++i)
+			m_vWords[i].store(vWords[i], std::memory_order_relaxed);
+
+		m_nSeq.store(nSeq + 2, std::memory_order_release);
+	}
+
+	// Reader side, any number of threads, return the number of writes so far
+	uint64_t load(T& value) const {
+
+		uint64_t vWords[WORDS];
+		for (;;) {
+
+			uint64_t nSeq = m_nSeq.load(std::memory_order_acquire);
+			if (nSeq & 1)
+				continue;
+
+			for (size_t i = 0; i < WORDS; ++i)
+				vWords[i] = m_vWords[i].load(std::memory_order_relaxed);
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (m_nSeq.load(std::memory_order_relaxed) == nSeq) {
+				memcpy(&value, vWords, sizeof(T));
+				return nSeq / 2;
+			}
+		}
+	}
+
+private:
+	static constexpr size_t	CACHE_LINE	= 64;
+	static constexpr size_t	WORDS		= (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+	alignas(CACHE_LINE) std::atomic<uint64_t>	m_nSeq;
+	std::atomic<uint64_t>						m_vWords[WORDS];
+	char										m_padding[CACHE_LINE];
+};
@@ -0,0 +1,89 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Delta encoded columnar store of the session series
+//==============================================================
+#include "pch.h"
+#include <vector>
+
+using namespace std;
+
+#include "SeriesStore.hpp"
+
+constexpr size_t SeriesColumn::BLOCK_ROWS;
+
+void SeriesColumn::append(int64_t nValue) {
+
+	// Start a new block with the plain value
+	if (m_nRows % BLOCK_ROWS == 0) {
+		SeriesBlock sb = { nValue, nValue, nValue, static_cast<uint32_t>(m_vBytes.size()) };
+		m_vBlocks.push_back(sb);
+	}
+	else {
+		SeriesBlock& sb = m_vBlocks.back();
+		sb.nMin = min(sb.nMin, nValue);
+		sb.nMax = max(sb.nMax, nValue);
+
+		// Zigzag keeps small negative deltas small, then 7 bits per byte. The difference wraps around
+		// so that invalid times far from the others still round trip.
+		int64_t nDelta = static_cast<int64_t>(static_cast<uint64_t>(nValue) - static_cast<uint64_t>(m_nLast));
+		uint64_t u = (static_cast<uint64_t>(nDelta) << 1) ^ static_cast<uint64_t>(nDelta >> 63);
+		while (u >= 0x80) {
+			m_vBytes.push_back(static_cast<uint8_t>(u | 0x80));
+			u >>= 7;
+		}
+		m_vBytes.push_back(static_cast<uint8_t>(u));
+	}
+
+	m_nLast = nValue;
+	++m_nRows;
+}
+
+bool SeriesColumn::getRange(size_t nFrom, size_t nTo, int64_t& nMin, int64_t& nMax) const {
+
+	nTo = min(nTo, m_nRows);
+	if (nFrom >= nTo)
+		return false;
+
+	nMin = INT64_MAX;
+	nMax = INT64_MIN;
+
+	size_t b = nFrom / BLOCK_ROWS;
+	size_t bEnd = (nTo + BLOCK_ROWS - 1) / BLOCK_ROWS;
+	for (; b < bEnd; ++b) {
+
+		size_t nBlockFrom = b * BLOCK_ROWS;
+		size_t nBlockTo = nBlockFrom + BLOCK_ROWS;
+
+		// Whole blocks come from their header, only the partial ones at both ends are decoded
+		if (nBlockFrom >= nFrom && nBlockTo <= nTo) {
+			nMin = min(nMin, m_vBlocks[b].nMin);
+			nMax = max(nMax, m_vBlocks[b].nMax);
+		}
+		else {
+			forEach(max(nFrom, nBlockFrom), min(nTo, nBlockTo), [&](size_t, int64_t nValue) {
+				nMin = min(nMin, nValue);
+				nMax = max(nMax, nValue);
+			});
+		}
+	}
+	return true;
+}
+
+void SeriesStore::append(int64_t nTimestamp, long lBid, long lBidSize, long lAsk, long lAskSize) {
+
+	m_columns[SERIES_TIMESTAMP].append(nTimestamp);
+	m_columns[SERIES_BID].append(lBid);
+	m_columns[SERIES_ASK].append(lAsk);
+	m_columns[SERIES_BIDSIZE].append(lBidSize);
+	m_columns[SERIES_ASKSIZE].append(lAskSize);
+	m_columns[SERIES_SPREAD].append(static_cast<int64_t>(lAsk) - lBid);
+}
+
+size_t SeriesStore::getBytes() const {
+
+	size_t nBytes = 0;
+	for (const SeriesColumn& sc : m_columns)
+		nBytes += sc.getBytes();
+	return nBytes;
+}
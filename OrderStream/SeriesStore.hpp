@@ -0,0 +1,112 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+using namespace std;
+
+// Block of consecutive rows of a column. The first value is kept as is and the following rows are stored
+// as zigzag varint deltas from their previous row, starting at nOffset in the bytes of the column.
+struct SeriesBlock {
+	int64_t		nFirst;
+	int64_t		nMin;
+	int64_t		nMax;
+	uint32_t	nOffset;
+};
+
+// One delta encoded column of a session series. Prices, sizes and times move by small steps from one row
+// to the next, so most rows take a single byte instead of a full integer. Every block of BLOCK_ROWS rows
+// starts from a plain value and keeps its minimum and maximum, so a range read seeks to its first block
+// without decoding the rows before it and min/max queries only decode the partial blocks at both ends.
+class SeriesColumn {
+
+public:
+	SeriesColumn() : m_nRows(0), m_nLast(0) {}
+
+	void append(int64_t nValue);
+
+	size_t size() const						{ return m_nRows; }
+	bool empty() const						{ return m_nRows == 0; }
+	int64_t front() const					{ return m_vBlocks.front().nFirst; }
+	int64_t back() const					{ return m_nLast; }
+
+	// Bytes held by the encoded rows and the block headers
+	size_t getBytes() const					{ return m_vBytes.capacity() + m_vBlocks.capacity() * sizeof(SeriesBlock); }
+
+	// Decode the rows [nFrom, nTo) in order and hand each one to f(row, value)
+	template <typename F>
+	void forEach(size_t nFrom, size_t nTo, F f) const {
+
+		nTo = min(nTo, m_nRows);
+		for (size_t b = nFrom / BLOCK_ROWS; b * BLOCK_ROWS < nTo; ++b) {
+
+			const SeriesBlock& sb = m_vBlocks[b];
+			const uint8_t* p = m_vBytes.data() + sb.nOffset;
+			size_t nRow = b * BLOCK_ROWS;
+			size_t nEnd = min(nRow + BLOCK_ROWS, nTo);
+			int64_t nValue = sb.nFirst;
+
+			for (;;) {
+				if (nRow >= nFrom)
+					f(nRow, nValue);
+				if (++nRow == nEnd)
+					break;
+				nValue = static_cast<int64_t>(static_cast<uint64_t>(nValue) + static_cast<uint64_t>(readDelta(p)));
+			}
+		}
+	}
+
+	template <typename F>
+	void forEach(F f) const					{ forEach(0, m_nRows, f); }
+
+	// Minimum and maximum of the rows [nFrom, nTo), return false when the range is empty
+	bool getRange(size_t nFrom, size_t nTo, int64_t& nMin, int64_t& nMax) const;
+
+	static constexpr size_t BLOCK_ROWS = 256;
+
+private:
+	static int64_t readDelta(const uint8_t*& p) {
+
+		uint64_t u = 0;
+		int nShift = 0;
+		while (*p & 0x80) {
+			u |= static_cast<uint64_t>(*p++ & 0x7f) << nShift;
+			nShift += 7;
+		}
+		u |= static_cast<uint64_t>(*p++) << nShift;
+		return static_cast<int64_t>(u >> 1) ^ -static_cast<int64_t>(u & 1);
+	}
+
+private:
+	vector<SeriesBlock>	m_vBlocks;
+	vector<uint8_t>		m_vBytes;
+	size_t				m_nRows;
+	int64_t				m_nLast;
+};
+
+// Columnar store of the best bid/ask series of a stream, one row per valid feed
+class SeriesStore {
+
+public:
+	enum SERIES_ID {
+		SERIES_TIMESTAMP = 0,
+		SERIES_BID,
+		SERIES_ASK,
+		SERIES_BIDSIZE,
+		SERIES_ASKSIZE,
+		SERIES_SPREAD,
+		SERIES_COUNT
+	};
+
+	void append(int64_t nTimestamp, long lBid, long lBidSize, long lAsk, long lAskSize);
+
+	const SeriesColumn& column(SERIES_ID id) const	{ return m_columns[id]; }
+	size_t size() const								{ return m_columns[SERIES_TIMESTAMP].size(); }
+	bool empty() const								{ return m_columns[SERIES_TIMESTAMP].empty(); }
+
+	size_t getBytes() const;
+
+private:
+	SeriesColumn	m_columns[SERIES_COUNT];
+};
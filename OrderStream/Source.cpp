@@ -9,12 +9,15 @@
 #include <iostream>
 #include <vector>
 #include <fstream>
+#include <algorithm>
 #include <boost/regex.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/range/irange.hpp>
 #include <boost/format.hpp>
 #include <boost/thread.hpp>
+#include <boost/chrono.hpp>
+#include <boost/make_shared.hpp>
 #include <boost/asio/thread_pool.hpp>
 #include <boost/foreach.hpp>
 #include <boost/property_tree/ptree.hpp>
@@ -24,9 +27,260 @@ using namespace std;
 using namespace boost;
 
 #include "OrderStream.hpp"
+#include "FeedReader.hpp"
 #include "TradePlot.hpp"
+#include "DiffWriter.hpp"
+#include "Conflator.hpp"
+#include "Reconciler.hpp"
+#include "QueryService.hpp"
+#include "Replayer.hpp"
+#include "BookPublisher.hpp"
+#include "OfferSpill.hpp"
+#include "OrderFlow.hpp"
+#include "TradeAnalytics.hpp"
+#include "SpreadAnalytics.hpp"
 
 const string szSessionFeed("task1.sessionfeed.");
+const string szTradePlot("task1.tradeplot.");
+
+void coutLiveBook(const string& szName, const BookPublisher& bp)
+{
+	// The top of book of the last row and the depth of the last snapshot, read without stopping the builder
+	TopOfBook tob;
+	bp.getTopOfBook(tob);
+	boost::shared_ptr<const BookSnapshot> pbs = bp.getSnapshot();
+
+	cout << " " << szName << " row " << tob.nRow << " bid " << tob.nBidPrice << "x" << tob.nBidSize << " ask " << tob.nAskPrice << "x" << tob.nAskSize;
+	if (pbs)
+		cout << ", book of row " << pbs->iRow << " " << pbs->obrf.vecBidLevels.size() << "/" << pbs->obrf.vecAskLevels.size() << " levels";
+	cout << ";";
+}
+
+void coutConflationStats(const OBStream& obs)
+{
+	const boost::shared_ptr<Conflator>& pConflator = obs.getConflator();
+	if (pConflator)
+		cout << " Conflation " << obs.getObjectName() << ": " << pConflator->getRowsIn() << " feed rows conflated into " << pConflator->getRowsOut() << " rows" << endl;
+}
+
+void coutOfferSpillStats(const OBStream& obs)
+{
+	const boost::shared_ptr<OfferSpill>& pBid = obs.getBidSpill();
+	const boost::shared_ptr<OfferSpill>& pAsk = obs.getAskSpill();
+	if (pBid && pAsk)
+		cout << " Offers " << obs.getObjectName() << ": " << pBid->getTuples() << " bid and " << pAsk->getTuples() << " ask level updates, spilled to "
+			<< pBid->getRuns() << " and " << pAsk->getRuns() << " runs merged in " << pBid->getPasses() << " and " << pAsk->getPasses() << " passes" << endl;
+}
+
+void coutOrderFlowStats(const OBStream& obs, const OrderFlow& of)
+{
+	cout << " Order flow " << obs.getObjectName() << ":";
+	for (int i = 0; i < OrderFlow::FLOW_COUNT; ++i)
+		cout << (i ? ", " : " ") << of.getEvents(static_cast<OrderFlow::FLOW_EVENT>(i)) << " " << OrderFlow::getEventName(static_cast<OrderFlow::FLOW_EVENT>(i));
+	cout << endl;
+
+	// Trades whose price lost size in the book within the matching rows, and how much of their volume it covers
+	uint64_t nTrades = of.getEvents(OrderFlow::FLOW_TRADE);
+	if (nTrades > 0)
+		cout << "   trades matched by the book " << of.getMatchedTrades() << " of " << nTrades << ", volume " << of.getMatchedVolume() << " of " << of.getVolume(OrderFlow::FLOW_TRADE) << endl;
+	if (!of.getFlowFile().empty())
+		cout << "   events written to " << of.getFlowFile() << endl;
+}
+
+void coutTradeStats(OBStream& obs)
+{
+	const TradeSeries& ts = obs.getOrderBook()->trades;
+	if (ts.nTrades == 0)
+		return;
+
+	// The tape reconciles when the trades add up to the rise of the accumulated volume over the session
+	cout << " Trades " << obs.getObjectName() << ": " << ts.nTrades << " trades of volume " << ts.nVolume << ", VWAP " << TradeAnalytics::getVwap(ts)
+		<< ", accumulated volume " << ts.nFirstVolume << " to " << ts.nLastVolume;
+	if (ts.nResets > 0)
+		cout << " after " << ts.nResets << " resets";
+	cout << endl;
+	if (ts.nSplitTrades > 0)
+		cout << "   " << ts.nSplitTrades << " trades hold " << ts.nSplitVolume << " volume of prints between rows, priced at the latest trade of their row" << endl;
+	if (ts.nUnpricedTrades > 0)
+		cout << "   " << ts.nUnpricedTrades << " trades of volume " << ts.nUnpricedVolume << " have no trade price, left out of the VWAP and the volume profile" << endl;
+	if (ts.nProfileOutliers > 0)
+		cout << "   " << ts.nProfileOutliers << " trades of volume " << ts.nProfileOutlierVolume << " are priced too far from the others for the volume profile" << endl;
+	if (ts.nBucketOutliers > 0)
+		cout << "   " << ts.nBucketOutliers << " trades of volume " << ts.nBucketOutlierVolume << " are timed too far after the others for the time buckets" << endl;
+}
+
+void coutSpreadStats(const string& szStatus, const SpreadStats& ss)
+{
+	if (ss.kllSpread.getCount() == 0)
+		return;
+
+	cout << boost::format("   %1% %|16t|%2% rows") % (szStatus.empty() ? "(none)" : szStatus) % ss.kllSpread.getCount() << ", spread p50 "
+		<< ss.kllSpread.getQuantile(0.5) << " p90 " << ss.kllSpread.getQuantile(0.9) << " p99 " << ss.kllSpread.getQuantile(0.99) << " max " << ss.kllSpread.getMax();
+
+	// Mid moves both ways, the rows where it stayed put are only counted
+	if (ss.kllMidChange.getCount() > 0)
+		cout << ", mid moves p1 " << ss.kllMidChange.getQuantile(0.01) << " p50 " << ss.kllMidChange.getQuantile(0.5) << " p99 " << ss.kllMidChange.getQuantile(0.99);
+	cout << ", " << ss.nMidUnchanged << " unchanged" << endl;
+
+	// Spreads the feed spent the most time at
+	const SpreadHistogram& sh = ss.shSpread;
+	if (sh.getTimeNs() > 0) {
+		vector<size_t> viSpread;
+		for (size_t i = 0; i < sh.size(); ++i) {
+			if (sh.getTimeNs(i) > 0)
+				viSpread.push_back(i);
+		}
+		size_t nTop = min(viSpread.size(), static_cast<size_t>(3));
+		partial_sort(viSpread.begin(), viSpread.begin() + nTop, viSpread.end(), [&sh](size_t i1, size_t i2) { return sh.getTimeNs(i1) > sh.getTimeNs(i2); });
+
+		cout << "   " << string(13, ' ') << "time at spread";
+		for (size_t i = 0; i < nTop; ++i)
+			cout << (i ? ", " : " ") << viSpread[i] << (viSpread[i] + 1 == SpreadHistogram::MAX_BUCKETS ? "+" : "")
+				<< boost::format(": %.1f%%") % (100.0 * sh.getTimeNs(viSpread[i]) / sh.getTimeNs());
+		cout << endl;
+	}
+}
+
+void coutSpreadStats(OBStream& obs)
+{
+	const SpreadDistribution& sd = obs.getOrderBook()->spreads;
+	cout << " Spreads " << obs.getObjectName() << " in ticks of " << sd.nTickSize << " by trading status:" << endl;
+	for (const pair<const string, SpreadStats>& kv : sd.mapStatus)
+		coutSpreadStats(kv.first, kv.second);
+	if (sd.mapStatus.size() > 1)
+		coutSpreadStats("all", sd.ssAll);
+}
+
+void coutPipelineStats(const OBStream& obs)
+{
+	const PipelineStats& ps = obs.getPipelineStats();
+
+	// A stage waiting on a full ring is held back by the next stage, a stage waiting on an empty ring is starved by the previous one
+	cout << " Pipeline " << obs.getObjectName() << ": " << ps.rsBuffers.nItems << " buffers, " << ps.rsRows.nItems << " row batches" << endl;
+	cout << "   reader  waited " << ps.rsBuffers.nFullStalls << "x (" << ps.rsBuffers.nFullStallUs << " us) on the parser" << endl;
+	cout << "   parser  waited " << ps.rsBuffers.nEmptyStalls << "x (" << ps.rsBuffers.nEmptyStallUs << " us) on the reader, "
+		<< ps.rsRows.nFullStalls << "x (" << ps.rsRows.nFullStallUs << " us) on the builder" << endl;
+	cout << "   builder waited " << ps.rsRows.nEmptyStalls << "x (" << ps.rsRows.nEmptyStallUs << " us) on the parser" << endl;
+}
+
+void coutLatency(const string& szName, const LatencyHistogram& lh)
+{
+	cout << "   " << szName << " p50 " << lh.getQuantile(0.5) / 1000 << " us, p99 " << lh.getQuantile(0.99) / 1000 << " us, p99.9 " << lh.getQuantile(0.999) / 1000
+		<< " us, max " << lh.nMaxNs / 1000 << " us, mean " << lh.getMean() / 1000 << " us" << endl;
+}
+
+void coutReplayStats(const Replayer& rp)
+{
+	// The session time replayed over the wall time is the speed the consumer actually kept up with
+	double dAchieved = rp.getElapsedNs() ? static_cast<double>(rp.getSessionNs()) / rp.getElapsedNs() : 0;
+	cout << " Replay: " << rp.getRows() << " rows in " << rp.getElapsedNs() / FeedClock::NS_PER_MS << " ms for " << rp.getSessionNs() / FeedClock::NS_PER_MS
+		<< " ms of session, x" << dAchieved << " achieved";
+	if (rp.getSpeed() > 0)
+		cout << " for x" << rp.getSpeed() << " asked";
+	cout << endl;
+	if (rp.getSpeed() > 0)
+		coutLatency("schedule slip   ", rp.getSlip());
+	coutLatency("consumer latency", rp.getLatency());
+}
+
+bool getWindowTime(const boost::property_tree::ptree& pt, const string& szKey, int64_t nDefault, int64_t& nTime)
+{
+	// A missing or empty key leaves the window open on that side, a time that doesn't parse is a config error
+	string szTime = pt.get<string>(szSessionFeed + szKey, "");
+	boost::trim(szTime);
+	if (szTime.empty()) {
+		nTime = nDefault;
+		return true;
+	}
+
+	FeedClock fcWindow;
+	nTime = fcWindow.parseLog(szTime);
+	if (nTime != FeedClock::TIME_INVALID)
+		return true;
+
+	cout << "Invalid " << szKey << " \"" << szTime << "\", expected a UTC time such as 20180612-06:47:07.111" << endl;
+	return false;
+}
+
+int reconcileFeeds(const boost::property_tree::ptree& pt, const StreamParams& sp)
+{
+	const string szReconcile = szSessionFeed + "reconcile.";
+
+	// The spill budget is shared by all the sources, that are built concurrently
+	const boost::property_tree::ptree& ptSources = pt.get_child(szSessionFeed + "reconcile", boost::property_tree::ptree());
+	size_t nSources = 0;
+	for (const auto& kv : ptSources) {
+		if (kv.first == "source" && (!kv.second.get<string>("csv", "").empty() || !kv.second.get<string>("log", "").empty()))
+			++nSources;
+	}
+
+	// Every source of the reconciliation is a CSV or a LOG feed with its own clock offset
+	vector<boost::shared_ptr<OBStream>> vStreams;
+	vector<string> vNames;
+	for (const auto& kv : ptSources) {
+
+		if (kv.first != "source")
+			continue;
+
+		string szCsvFile = kv.second.get<string>("csv", "");
+		string szLogFile = kv.second.get<string>("log", "");
+		string szName = kv.second.get<string>("name", szCsvFile.empty() ? szLogFile : szCsvFile);
+
+		StreamParams spSource(sp);
+		spSource.szStreamName = szName;
+		spSource.nSpillBytes = sp.nSpillBytes / max(nSources, static_cast<size_t>(1));
+
+		if (!szCsvFile.empty()) {
+			spSource.nUtcOffsetMinutes = kv.second.get<int>("utcOffset", pt.get<int>(szSessionFeed + "csvUtcOffset", 0));
+			vStreams.push_back(boost::make_shared<OBStreamCSV>(szCsvFile, spSource));
+		}
+		else if (!szLogFile.empty()) {
+			spSource.nUtcOffsetMinutes = kv.second.get<int>("utcOffset", pt.get<int>(szSessionFeed + "logUtcOffset", 0));
+			vStreams.push_back(boost::make_shared<OBStreamLog>(szLogFile, spSource));
+		}
+		else {
+			continue;
+		}
+		vNames.push_back(szName);
+	}
+
+	if (vStreams.size() < 2) {
+		cout << "Reconciliation needs at least two sources, " << vStreams.size() << " configured." << endl;
+		return (0);
+	}
+
+	// Evaluate all the sources concurrently
+	boost::thread_group ths;
+	for (auto& pStream : vStreams)
+		ths.create_thread(boost::bind(&OBStream::processFeeds, pStream.get()));
+	ths.join_all();
+
+	try {
+		for (auto& pStream : vStreams)
+			pStream->CheckNotifyException();
+
+		Reconciler rec(pt.get<int>(szReconcile + "toleranceMs", 1000));
+		for (size_t i = 0; i < vStreams.size(); ++i)
+			rec.addSource(vNames[i], *vStreams[i]);
+
+		string szReport = pt.get<string>(szReconcile + "report", "reconcile.csv");
+		rec.reconcile(szReport);
+
+		// Show how far each source strayed from the consensus
+		cout << " Reconciliation of " << vStreams.size() << " sources over " << rec.getUpdates() << " updates, "
+			<< rec.getNoConsensus() << " without a majority, written to " << szReport << endl;
+		for (const ReconcileSource& rs : rec.getSources()) {
+			cout << boost::format("   %1% %|24t|agreed %2%/%3% updates, %4% deviations (%5% ms)")
+				% rs.szName % rs.nAgreed % rs.nUpdates % rs.nDeviations % (rs.nDeviationNs / FeedClock::NS_PER_MS) << endl;
+		}
+	}
+	catch (const TracedException& te) {
+		te.coutException();
+		cout << "Reconciliation of source feeds was not generated." << endl;
+	}
+
+	return (0);
+}
 
 int main(int argc, char *argv[])
 {
@@ -48,8 +302,77 @@ int main(int argc, char *argv[])
 
 	// Extract the source feeds to evaluate
 	string szFeed = pt.get<string>(szSessionFeed + "sourcefeed");
-	int nMaxBookLevels = pt.get<int>(szSessionFeed + "maxBookLevels", 5);
-	int nMaxBookDepth  = pt.get<int>(szSessionFeed + "maxBookDepth", 5);
+
+	StreamParams sp;
+	sp.nMaxBookLevels	= pt.get<int>(szSessionFeed + "maxBookLevels", 5);
+	sp.nMaxBookDepth	= pt.get<int>(szSessionFeed + "maxBookDepth", 5);
+	sp.bPipeline		= pt.get<bool>(szSessionFeed + "pipeline.enabled", false);
+	sp.nBatchRows		= pt.get<int>(szSessionFeed + "pipeline.batchRows", 256);
+
+	// Optional asynchronous reads of the plain feeds of all the streams on a few shared threads
+	if (pt.get<bool>(szSessionFeed + "asyncio.enabled", false)) {
+		sp.pFeedIo = boost::make_shared<FeedIoService>(pt.get<size_t>(szSessionFeed + "asyncio.threads", 2),
+			pt.get<size_t>(szSessionFeed + "asyncio.readsInFlight", 4));
+	}
+	sp.nUtcOffsetMinutes	= 0;
+
+	// Optional sparse time index and time window, window times are UTC in the LOG clock format
+	sp.bIndex		= pt.get<bool>(szSessionFeed + "index.enabled", false);
+	sp.nIndexRows	= pt.get<int>(szSessionFeed + "index.everyRows", 10000);
+	sp.nIndexMs		= pt.get<int>(szSessionFeed + "index.everyMs", 1000);
+	if (!getWindowTime(pt, "window.from", FeedClock::TIME_INVALID, sp.nWindowFrom) || !getWindowTime(pt, "window.to", INT64_MAX, sp.nWindowTo))
+		return (0);
+
+	// Optional conflation of the rows before book building
+	sp.nConflation		= Conflator::getMode(pt.get<string>(szSessionFeed + "conflation.mode", "none"));
+	sp.nConflationMs	= pt.get<int>(szSessionFeed + "conflation.intervalMs", 100);
+
+	// Optional per row liquidity metrics
+	sp.bLiquidity		= pt.get<bool>(szSessionFeed + "liquidity.enabled", false);
+	sp.nClipSize		= pt.get<long>(szSessionFeed + "liquidity.clipSize", 10000);
+
+	// Optional checkpoints to resume a long run, "-resume" after the xml file resumes from the last ones
+	sp.bCheckpoint		= pt.get<bool>(szSessionFeed + "checkpoint.enabled", false);
+	sp.nCheckpointRows	= pt.get<int>(szSessionFeed + "checkpoint.everyRows", 100000);
+	sp.szCheckpointDir	= pt.get<string>(szSessionFeed + "checkpoint.dir", ".");
+	sp.bResume			= pt.get<bool>(szSessionFeed + "checkpoint.resume", false);
+
+	// Optional out of core offers for sessions whose level updates don't fit in memory, memoryMB is shared by all the streams
+	sp.bSpillOffers		= pt.get<bool>(szSessionFeed + "spill.enabled", false);
+	sp.nSpillBytes		= static_cast<size_t>(max(pt.get<int>(szSessionFeed + "spill.memoryMB", 256), 1)) * 1024 * 1024;
+	sp.szSpillDir		= pt.get<string>(szSessionFeed + "spill.dir", "");
+
+	// Optional order flow events inferred from the book changes, the CSV trade columns are decoded to cross-check them
+	bool bOrderFlow		= pt.get<bool>(szSessionFeed + "orderflow.enabled", false);
+
+	// Optional trade tape analytics, VWAP, volume profile and traded volume per time bucket
+	sp.bTradeTape		= pt.get<bool>(szSessionFeed + "tape.enabled", false);
+	sp.nTickSize		= pt.get<long>(szSessionFeed + "tape.tickSize", 1);
+	sp.nMaxProfileSlots	= pt.get<int>(szSessionFeed + "tape.maxProfileSlots", 100000);
+	sp.nTapeBucketMs	= pt.get<int>(szSessionFeed + "tape.bucketMs", 60000);
+	sp.nMaxTapeBuckets	= pt.get<int>(szSessionFeed + "tape.maxBuckets", 10000);
+	sp.bTrades			= bOrderFlow || sp.bTradeTape;
+
+	// Optional spread and mid change distributions of each trading status
+	sp.bSpreads			= pt.get<bool>(szSessionFeed + "spreads.enabled", false);
+	sp.nSpreadTickSize	= pt.get<long>(szSessionFeed + "spreads.tickSize", 1);
+	sp.nSketchK			= pt.get<int>(szSessionFeed + "spreads.sketchK", KllSketch::DEFAULT_K);
+
+	// Optional query service on the loaded books, "-serve" after the xml file enables it
+	bool bServe = pt.get<bool>(szSessionFeed + "server.enabled", false);
+	bool bReplay = pt.get<bool>(szSessionFeed + "replay.enabled", false);
+	for (int i = 2; i < argc; ++i) {
+		if (boost::iequals(argv[i], "-resume"))
+			sp.bResume = true;
+		else if (boost::iequals(argv[i], "-serve"))
+			bServe = true;
+		else if (boost::iequals(argv[i], "-replay"))
+			bReplay = true;
+	}
+
+	// Reconcile any number of sources against their consensus instead of plotting two of them
+	if (pt.get<bool>(szSessionFeed + "reconcile.enabled", false))
+		return reconcileFeeds(pt, sp);
 
 	string szSelCsv = szSessionFeed + szFeed + ".csv";
 	string szSelLog = szSessionFeed + szFeed + ".log";
@@ -60,8 +383,63 @@ int main(int argc, char *argv[])
 	assert(szLogFile.empty() == false);
 
 	// Create both source feeds to compare
-	OBStreamCSV obsCsv(szCsvFile, nMaxBookLevels, nMaxBookDepth);
-	OBStreamLog obsLog(szLogFile, nMaxBookLevels, nMaxBookDepth);
+	// Each source has its own clock, shift both to UTC
+	StreamParams spCsv(sp), spLog(sp);
+	spCsv.nSpillBytes = spLog.nSpillBytes = sp.nSpillBytes / 2;
+	spCsv.nUtcOffsetMinutes = pt.get<int>(szSessionFeed + szFeed + ".csvUtcOffset", pt.get<int>(szSessionFeed + "csvUtcOffset", 0));
+	spLog.nUtcOffsetMinutes = pt.get<int>(szSessionFeed + szFeed + ".logUtcOffset", pt.get<int>(szSessionFeed + "logUtcOffset", 0));
+
+	OBStreamCSV obsCsv(szCsvFile, spCsv);
+	OBStreamLog obsLog(szLogFile, spLog);
+
+	boost::shared_ptr<OrderFlow> pFlowCsv, pFlowLog;
+	if (bOrderFlow) {
+		int nMatchRows = pt.get<int>(szSessionFeed + "orderflow.matchRows", 3);
+		pFlowCsv = boost::make_shared<OrderFlow>(pt.get<string>(szSessionFeed + "orderflow.csvFile", ""), sp.nMaxBookLevels, nMatchRows);
+		pFlowLog = boost::make_shared<OrderFlow>(pt.get<string>(szSessionFeed + "orderflow.logFile", ""), sp.nMaxBookLevels, nMatchRows);
+		obsCsv.addSink(*pFlowCsv);
+		obsLog.addSink(*pFlowLog);
+	}
+
+	// Optional live view of both books while they are built, published before the other sinks run on the books
+	boost::shared_ptr<BookPublisher> pLiveCsv, pLiveLog;
+	boost::thread thLive;
+	if (pt.get<bool>(szSessionFeed + "live.enabled", false)) {
+
+		int nSnapshotRows = pt.get<int>(szSessionFeed + "live.snapshotRows", 1000);
+		int nEveryMs = max(pt.get<int>(szSessionFeed + "live.everyMs", 1000), 1);
+		pLiveCsv = boost::make_shared<BookPublisher>(nSnapshotRows);
+		pLiveLog = boost::make_shared<BookPublisher>(nSnapshotRows);
+		obsCsv.addSink(*pLiveCsv);
+		obsLog.addSink(*pLiveLog);
+
+		thLive = boost::thread([pLiveCsv, pLiveLog, nEveryMs]() {
+			while (!pLiveCsv->isComplete() || !pLiveLog->isComplete()) {
+				boost::this_thread::sleep_for(boost::chrono::milliseconds(nEveryMs));
+				cout << " Live:";
+				coutLiveBook("csv", *pLiveCsv);
+				coutLiveBook("log", *pLiveLog);
+				cout << endl;
+			}
+		});
+	}
+
+	// The console diff and the plot are sinks of both streams, they run as soon as both books are complete
+	boost::shared_ptr<DiffWriter> pDiff;
+	boost::shared_ptr<TradePlot> pPlot;
+	if (!bServe) {
+		if (pt.get<bool>(szTradePlot + "console.output", false)) {
+			pDiff = boost::make_shared<DiffWriter>(pt.get<string>(szTradePlot + "console.diff", "feeddiff.log"),
+				DiffWriter::getMode(pt.get<string>(szTradePlot + "console.mode", "text")), pt.get<bool>(szTradePlot + "console.mismatchOnly", false),
+				sp.nMaxBookLevels, pt.get<int>(szTradePlot + "console.echoRows", 100), pt.get<int>(szTradePlot + "console.echoEvery", 1));
+			obsCsv.addSink(*pDiff);
+			obsLog.addSink(*pDiff);
+		}
+
+		pPlot = boost::make_shared<TradePlot>(szXml);
+		obsCsv.addSink(*pPlot);
+		obsLog.addSink(*pPlot);
+	}
 
 	// Evaluate both files concurrently and wait for both threds to complete
 	boost::thread_group ths;
@@ -69,16 +447,92 @@ int main(int argc, char *argv[])
 	ths.create_thread(boost::bind(&OBStreamLog::processFeeds, boost::ref(obsLog)));
 	ths.join_all();
 
+	// The live view also stops when a stream failed before completing its book
+	if (thLive.joinable()) {
+		thLive.interrupt();
+		thLive.join();
+	}
+
 	try {
 		// Check whether exception was caught while processing feeds
 		obsCsv.CheckNotifyException();
 		obsLog.CheckNotifyException();
 
-		// There was no exception. Plot the result to html and console optionally
-		TradePlot tp(szXml, obsCsv, obsLog);
+		// Locate where the books of both streams first differ, row by row
+		boost::chrono::steady_clock::time_point tpDivergence = boost::chrono::steady_clock::now();
+		int nDivergence = OBStream::findDivergence(obsCsv, obsLog);
+		int64_t nDivergenceUs = boost::chrono::duration_cast<boost::chrono::microseconds>(boost::chrono::steady_clock::now() - tpDivergence).count();
+		if (nDivergence < 0)
+			cout << " Books of both streams match over their " << min(obsCsv.getNumRows(), obsLog.getNumRows()) << " common rows";
+		else
+			cout << " Books of both streams first diverge at row " << nDivergence << " (" << obsCsv.getRowFeedAt(nDivergence).datetime << " / " << obsLog.getRowFeedAt(nDivergence).datetime << ")";
+		cout << ", found in " << nDivergenceUs << " us" << endl;
+
+		// Show how much the conflation saved on each stream
+		if (sp.nConflation != Conflator::CONFLATION_NONE) {
+			coutConflationStats(obsCsv);
+			coutConflationStats(obsLog);
+		}
+
+		// Show the order flow of each stream
+		if (bOrderFlow) {
+			coutOrderFlowStats(obsCsv, *pFlowCsv);
+			coutOrderFlowStats(obsLog, *pFlowLog);
+		}
+
+		// Show the trade tape of each stream
+		if (sp.bTradeTape) {
+			coutTradeStats(obsCsv);
+			coutTradeStats(obsLog);
+		}
+
+		// Show the spread distributions of each stream
+		if (sp.bSpreads) {
+			coutSpreadStats(obsCsv);
+			coutSpreadStats(obsLog);
+		}
+
+		// Show how the offers were built out of core
+		if (sp.bSpillOffers) {
+			coutOfferSpillStats(obsCsv);
+			coutOfferSpillStats(obsLog);
+		}
+
+		// Show which stage held back each pipelined stream
+		if (sp.bPipeline) {
+			coutPipelineStats(obsCsv);
+			coutPipelineStats(obsLog);
+		}
+
+		// Replay both streams merged in time order, the consumer here only reads the top of book of each row
+		if (bReplay) {
+			Replayer rp(pt.get<double>(szSessionFeed + "replay.speed", 10), pt.get<int>(szSessionFeed + "replay.spinUs", 100));
+			rp.addSource("csv", obsCsv);
+			rp.addSource("log", obsLog);
+
+			vector<uint64_t> vnRows(2, 0);
+			vector<int64_t> vnMid(2, 0);
+			rp.setConsumer([&vnRows, &vnMid](size_t iSource, const OBRowFeed& obrf) {
+				++vnRows[iSource];
+				vnMid[iSource] = (obrf.pairBidPriceSize.first + obrf.pairAskPriceSize.first) / 2;
+			});
+
+			rp.replay();
+			coutReplayStats(rp);
+		}
+
+		// Keep the books in memory and answer queries on them instead of plotting
+		if (bServe) {
+			QueryService qs(pt.get<string>(szSessionFeed + "server.address", "127.0.0.1"), pt.get<unsigned short>(szSessionFeed + "server.port", 8080), pt.get<int>(szSessionFeed + "server.threads", 0));
+			qs.addSource("csv", obsCsv);
+			qs.addSource("log", obsLog);
+			qs.run();
+			return (0);
+		}
 
-		cout << " Plot of source feeds have been generated in webpage file " << tp.getPlotFile() << endl;
-		cout << " Note: " << tp.getPlotFile() << " includes Google Charts to show source feeds differences and should be open with Chrome." << endl;
+		// There was no exception, the result was plotted to html and console optionally
+		cout << " Plot of source feeds have been generated in webpage file " << pPlot->getPlotFile() << endl;
+		cout << " Note: " << pPlot->getPlotFile() << " includes Google Charts to show source feeds differences and should be open with Chrome." << endl;
 	}
 	catch (const TracedException& te) {
 		te.coutException();
@@ -0,0 +1,90 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Spread and mid price change distributions of the order book feeds
+//==============================================================
+#include "pch.h"
+#include <vector>
+#include <algorithm>
+#include <boost/regex.hpp>
+
+using namespace std;
+using namespace boost;
+
+#include "SpreadAnalytics.hpp"
+
+SpreadAnalytics::SpreadAnalytics(long nTickSize, int nSketchK, SpreadDistribution& sd) : m_nSketchK(nSketchK), m_sd(sd),
+	m_bPrev(false), m_nPrevSpread(0), m_dPrevMid(0), m_nPrevTimestamp(FeedClock::TIME_INVALID), m_pssPrev(nullptr) {
+
+	sd.nTickSize = max(nTickSize, 1L);
+	sd.mapStatus.clear();
+	sd.ssAll = newStats();
+}
+
+SpreadStats SpreadAnalytics::newStats() const {
+
+	SpreadStats ss = { KllSketch(m_nSketchK), KllSketch(m_nSketchK), 0, SpreadHistogram() };
+	return ss;
+}
+
+SpreadStats& SpreadAnalytics::getStats(const string& szStatus, SpreadDistribution& sd) {
+
+	// Rows mostly keep the status of the previous row
+	if (m_pssPrev != nullptr && szStatus == m_szPrevStatus)
+		return *m_pssPrev;
+
+	map<string, SpreadStats>::iterator it = sd.mapStatus.find(szStatus);
+	if (it == sd.mapStatus.end())
+		it = sd.mapStatus.insert(make_pair(szStatus, newStats())).first;
+	return it->second;
+}
+
+void SpreadAnalytics::addRow(const OBRowFeed& obrf, SpreadDistribution& sd) {
+
+	// Only the rows with both sides have a spread
+	long nBid = obrf.pairBidPriceSize.first;
+	long nAsk = obrf.pairAskPriceSize.first;
+	if (nBid <= 0 || nAsk <= 0)
+		return;
+
+	long nSpread = (nAsk - nBid) / sd.nTickSize;
+	double dMid = (static_cast<double>(nBid) + nAsk) / (2.0 * sd.nTickSize);
+
+	SpreadStats& ss = getStats(obrf.szFeedStat, sd);
+	ss.kllSpread.add(static_cast<double>(nSpread));
+	ss.shSpread.addRow(nSpread);
+
+	if (m_bPrev) {
+
+		// The previous row held its spread until this one
+		if (m_nPrevTimestamp != FeedClock::TIME_INVALID && obrf.nTimestamp != FeedClock::TIME_INVALID && obrf.nTimestamp > m_nPrevTimestamp)
+			m_pssPrev->shSpread.addTime(m_nPrevSpread, obrf.nTimestamp - m_nPrevTimestamp);
+
+		double dChange = dMid - m_dPrevMid;
+		if (dChange != 0)
+			ss.kllMidChange.add(dChange);
+		else
+			++ss.nMidUnchanged;
+	}
+
+	m_bPrev = true;
+	m_nPrevSpread = nSpread;
+	m_dPrevMid = dMid;
+	m_nPrevTimestamp = obrf.nTimestamp;
+	if (&ss != m_pssPrev) {
+		m_szPrevStatus = obrf.szFeedStat;
+		m_pssPrev = &ss;
+	}
+}
+
+void SpreadAnalytics::onBook(OBStream& obs) {
+
+	// The distributions of the statuses merge into the one of the whole feed
+	m_sd.ssAll = newStats();
+	for (const pair<const string, SpreadStats>& kv : m_sd.mapStatus) {
+		m_sd.ssAll.kllSpread.merge(kv.second.kllSpread);
+		m_sd.ssAll.kllMidChange.merge(kv.second.kllMidChange);
+		m_sd.ssAll.nMidUnchanged += kv.second.nMidUnchanged;
+		m_sd.ssAll.shSpread.merge(kv.second.shSpread);
+	}
+}
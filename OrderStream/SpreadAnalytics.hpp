@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+
+#include "OrderStream.hpp"
+
+// Distributions of the spread and of the mid price changes of a feed, kept apart for each trading status.
+// Each row with both sides adds its spread in ticks to a KLL sketch and to an exact histogram, and the
+// change of the mid price from the previous row to a second sketch. The time until the next row is spent at
+// the spread of the row, so the histogram also gives the share of the session at each spread. Sketches
+// and histograms stay bounded whatever the length of the session and merge, the distributions of all the
+// statuses are merged into one when the book is complete. It is a sink of the stream and the distributions
+// it fills are in the SpreadDistribution of the order book.
+class SpreadAnalytics : public OBSink {
+
+public:
+	SpreadAnalytics() = delete;
+	SpreadAnalytics(long nTickSize, int nSketchK, SpreadDistribution& sd);
+
+	void onRow(const OBStream& obs, const OBRowFeed& obrf, int iRow)	{ addRow(obrf, m_sd); }
+	void onBook(OBStream& obs);
+
+	// Add the spread and mid change of a row to the distributions of its status
+	void addRow(const OBRowFeed& obrf, SpreadDistribution& sd);
+
+	// Empty distributions with the size of sketch of this analysis
+	SpreadStats newStats() const;
+
+private:
+	SpreadStats&	getStats(const string& szStatus, SpreadDistribution& sd);
+
+private:
+	int					m_nSketchK;
+	SpreadDistribution&	m_sd;
+
+	// Previous row with both sides, and the distributions of its status
+	bool			m_bPrev;
+	long			m_nPrevSpread;
+	double			m_dPrevMid;
+	int64_t			m_nPrevTimestamp;
+	string			m_szPrevStatus;
+	SpreadStats*	m_pssPrev;
+};
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <boost/thread.hpp>
+#include <boost/chrono.hpp>
+
+// Counters of a ring hand-off between two pipeline stages. A producer that often waits on a full ring is
+// held back by a slower consumer, and a consumer that often waits on an empty ring is starved by its producer.
+struct RingStats {
+	uint64_t	nItems;			// Items handed over through the ring
+	uint64_t	nFullStalls;	// Times the producer waited for a free slot (back pressure)
+	uint64_t	nEmptyStalls;	// Times the consumer waited for an item (starvation)
+	uint64_t	nFullStallUs;	// Time the producer spent waiting
+	uint64_t	nEmptyStallUs;	// Time the consumer spent waiting
+};
+
+// Bounded lock-free single-producer/single-consumer ring. Each side owns one index and only reads the other
+// side's index when its cached copy says the ring looks full or empty, so the hand-off costs a couple of
+// uncontended atomic operations. Items are moved in and out, which makes whole batches cheap to hand over.
+template <typename T>
+class SpscRing {
+
+public:
+	SpscRing() = delete;
+	SpscRing(const SpscRing&) = delete;
+	SpscRing& operator=(const SpscRing&) = delete;
+
+	explicit SpscRing(size_t nCapacity) : m_nHead(0), m_nCachedTail(0), m_nTail(0), m_nCachedHead(0), m_bClosed(false), m_bCancelled(false) {
+
+		// Round the capacity up to a power of two so that slots are addressed with a mask
+		size_t nSize = 1;
+		while (nSize < nCapacity)
+			nSize <<= 1;
+
+		m_vSlots.resize(nSize);
+		m_nMask = nSize - 1;
+
+		m_nItems = m_nFullStalls = m_nEmptyStalls = m_nFullStallUs = m_nEmptyStallUs = 0;
+	}
+
+	// Producer side, return false when the ring is full
+	bool tryPush(T& item) {
+
+		size_t nTail = m_nTail.load(std::memory_order_relaxed);
+
+		if (nTail - m_nCachedHead > m_nMask) {
+			m_nCachedHead = m_nHead.load(std::memory_order_acquire);
+			if (nTail - m_nCachedHead > m_nMask)
+				return false;
+		}
+
+		m_vSlots[nTail & m_nMask] = std::move(item);
+		m_nTail.store(nTail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side, return false when the ring is empty
+	bool tryPop(T& item) {
+
+		size_t nHead = m_nHead.load(std::memory_order_relaxed);
+
+		if (nHead == m_nCachedTail) {
+			m_nCachedTail = m_nTail.load(std::memory_order_acquire);
+			if (nHead == m_nCachedTail)
+				return false;
+		}
+
+		item = std::move(m_vSlots[nHead & m_nMask]);
+		m_nHead.store(nHead + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Wait for a free slot, return false if the consumer cancelled the hand-off
+	bool push(T& item) {
+
+		if (tryPush(item)) {
+			m_nItems.fetch_add(1, std::memory_order_relaxed);
+			return true;
+		}
+
+		boost::chrono::steady_clock::time_point tpStall = boost::chrono::steady_clock::now();
+		m_nFullStalls.fetch_add(1, std::memory_order_relaxed);
+
+		bool bPushed = false;
+		for (int nSpins = 0; !m_bCancelled.load(std::memory_order_acquire); ++nSpins) {
+
+			if (tryPush(item)) {
+				bPushed = true;
+				break;
+			}
+			backoff(nSpins);
+		}
+
+		m_nFullStallUs.fetch_add(elapsedUs(tpStall), std::memory_order_relaxed);
+
+		if (bPushed)
+			m_nItems.fetch_add(1, std::memory_order_relaxed);
+		return bPushed;
+	}
+
+	// Push without waiting for a producer that can't block, a full ring is counted as back pressure
+	bool pushNoWait(T& item) {
+
+		if (!tryPush(item)) {
+			m_nFullStalls.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		m_nItems.fetch_add(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// Consumer side that was cancelled, for the producer to stop early
+	bool isCancelled() const				{ return m_bCancelled.load(std::memory_order_acquire); }
+
+	// Wait for an item, return false once the producer closed the ring and it is drained, or on cancel
+	bool pop(T& item) {
+
+		if (tryPop(item))
+			return true;
+
+		boost::chrono::steady_clock::time_point tpStall = boost::chrono::steady_clock::now();
+		m_nEmptyStalls.fetch_add(1, std::memory_order_relaxed);
+
+		bool bPopped = false;
+		for (int nSpins = 0; !m_bCancelled.load(std::memory_order_acquire); ++nSpins) {
+
+			// Check the close flag before the last attempt so that no item pushed before close is missed
+			bool bClosed = m_bClosed.load(std::memory_order_acquire);
+
+			if (tryPop(item)) {
+				bPopped = true;
+				break;
+			}
+			if (bClosed)
+				break;
+			backoff(nSpins);
+		}
+
+		m_nEmptyStallUs.fetch_add(elapsedUs(tpStall), std::memory_order_relaxed);
+		return bPopped;
+	}
+
+	// Producer signals that no more items will be pushed
+	void close()							{ m_bClosed.store(true, std::memory_order_release); }
+
+	// Either side abandons the hand-off, blocked calls on the other side return false
+	void cancel()							{ m_bCancelled.store(true, std::memory_order_release); }
+
+	size_t capacity() const					{ return m_vSlots.size(); }
+
+	RingStats getStats() const {
+
+		RingStats rs;
+		rs.nItems			= m_nItems.load(std::memory_order_relaxed);
+		rs.nFullStalls		= m_nFullStalls.load(std::memory_order_relaxed);
+		rs.nEmptyStalls		= m_nEmptyStalls.load(std::memory_order_relaxed);
+		rs.nFullStallUs		= m_nFullStallUs.load(std::memory_order_relaxed);
+		rs.nEmptyStallUs	= m_nEmptyStallUs.load(std::memory_order_relaxed);
+		return rs;
+	}
+
+private:
+	static constexpr size_t	CACHE_LINE	= 64;
+	static constexpr int	SPIN_LIMIT	= 64;
+	static constexpr int	YIELD_LIMIT	= 128;
+	static constexpr int	SLEEP_US	= 50;
+
+	// Spin briefly, then yield, then sleep so that a stalled stage does not burn a core
+	static void backoff(int nSpins) {
+
+		if (nSpins < SPIN_LIMIT)
+			return;
+
+		if (nSpins < YIELD_LIMIT)
+			boost::this_thread::yield();
+		else
+			boost::this_thread::sleep_for(boost::chrono::microseconds(SLEEP_US));
+	}
+
+	static uint64_t elapsedUs(const boost::chrono::steady_clock::time_point& tp) {
+		return boost::chrono::duration_cast<boost::chrono::microseconds>(boost::chrono::steady_clock::now() - tp).count();
+	}
+
+private:
+	std::vector<T>			m_vSlots;
+	size_t					m_nMask;
+
+	// Keep the consumer and producer indexes on separate cache lines to avoid false sharing
+	char					m_pad0[CACHE_LINE];
+	std::atomic<size_t>		m_nHead;			// Next slot to pop, written by the consumer
+	size_t					m_nCachedTail;		// Consumer copy of the producer index
+	char					m_pad1[CACHE_LINE];
+	std::atomic<size_t>		m_nTail;			// Next slot to push, written by the producer
+	size_t					m_nCachedHead;		// Producer copy of the consumer index
+	char					m_pad2[CACHE_LINE];
+
+	std::atomic<bool>		m_bClosed;
+	std::atomic<bool>		m_bCancelled;
+
+	std::atomic<uint64_t>	m_nItems;
+	std::atomic<uint64_t>	m_nFullStalls;
+	std::atomic<uint64_t>	m_nEmptyStalls;
+	std::atomic<uint64_t>	m_nFullStallUs;
+	std::atomic<uint64_t>	m_nEmptyStallUs;
+};
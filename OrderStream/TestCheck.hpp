@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+
+// Failed checks of the test run, each test file adds to them and the runner reports the total
+extern int g_nFailures;
+
+void check(bool bPassed, const std::string& szWhat);
+
+void runFeedIndexTests();
+void runFeedReaderTests();
@@ -0,0 +1,31 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Runner of the engine tests
+//==============================================================
+#include "pch.h"
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+#include "TestCheck.hpp"
+
+int g_nFailures = 0;
+
+void check(bool bPassed, const string& szWhat) {
+
+	if (!bPassed) {
+		cout << "FAILED: " << szWhat << endl;
+		++g_nFailures;
+	}
+}
+
+int main() {
+
+	runFeedIndexTests();
+	runFeedReaderTests();
+
+	cout << (g_nFailures == 0 ? "OrderStream tests passed" : "OrderStream tests failed") << endl;
+	return g_nFailures == 0 ? 0 : 1;
+}
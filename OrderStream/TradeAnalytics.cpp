@@ -0,0 +1,156 @@
+//==============================================================
+// Copyright Bruno Kieba - 2018
+//
+// Trade tape analytics of the feeds that carry their trades
+//==============================================================
+#include "pch.h"
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <boost/regex.hpp>
+
+using namespace std;
+using namespace boost;
+
+#include "TradeAnalytics.hpp"
+
+constexpr size_t TradeAnalytics::PROFILE_MIN_SLOTS;
+
+namespace {
+
+	const double NaN = numeric_limits<double>::quiet_NaN();
+}
+
+TradeAnalytics::TradeAnalytics(long nTickSize, int nBucketMs, size_t nMaxProfileSlots, size_t nMaxBuckets, TradeSeries& ts)
+	: m_ts(ts), m_nMaxProfileSlots(max(nMaxProfileSlots, PROFILE_MIN_SLOTS)), m_nMaxBuckets(max(nMaxBuckets, static_cast<size_t>(1))),
+	m_bFirst(true), m_nPrevVolume(0) {
+
+	ts = TradeSeries();
+	ts.nTickSize	= max(nTickSize, 1L);
+	ts.nBucketNs	= static_cast<int64_t>(max(nBucketMs, 1)) * 1000000;
+	ts.nBucketFirst	= FeedClock::TIME_INVALID;
+}
+
+void TradeAnalytics::addToProfile(long nPrice, int64_t nVolume, TradeSeries& ts) {
+
+	long nSlot = (nPrice - ts.nProfileFirst) / ts.nTickSize;
+	if (ts.vProfile.empty()) {
+
+		// Center the first price in a few slots
+		ts.nProfileFirst = nPrice - static_cast<long>(PROFILE_MIN_SLOTS / 2) * ts.nTickSize;
+		ts.vProfile.assign(PROFILE_MIN_SLOTS, 0);
+		nSlot = static_cast<long>(PROFILE_MIN_SLOTS / 2);
+	}
+	else if (nPrice < ts.nProfileFirst) {
+
+		// A price that would stretch the profile past its maximum span, a bad print far from the traded range, is
+		// only counted
+		uint64_t nNeed = static_cast<uint64_t>((ts.nProfileFirst - nPrice + ts.nTickSize - 1) / ts.nTickSize);
+		size_t nRoom = m_nMaxProfileSlots - ts.vProfile.size();
+		if (nNeed > nRoom) {
+			++ts.nProfileOutliers;
+			ts.nProfileOutlierVolume += nVolume;
+			return;
+		}
+
+		// Grow the front by at least the current size, so that shifting the slots stays rare
+		size_t nGrow = min(max(static_cast<size_t>(nNeed), ts.vProfile.size()), nRoom);
+		ts.vProfile.insert(ts.vProfile.begin(), nGrow, 0);
+		ts.nProfileFirst -= static_cast<long>(nGrow) * ts.nTickSize;
+		nSlot = (nPrice - ts.nProfileFirst) / ts.nTickSize;
+	}
+	else if (static_cast<size_t>(nSlot) >= ts.vProfile.size()) {
+
+		if (static_cast<size_t>(nSlot) >= m_nMaxProfileSlots) {
+			++ts.nProfileOutliers;
+			ts.nProfileOutlierVolume += nVolume;
+			return;
+		}
+		ts.vProfile.resize(min(max(static_cast<size_t>(nSlot) + 1, ts.vProfile.size() * 2), m_nMaxProfileSlots), 0);
+	}
+
+	ts.vProfile[nSlot] += nVolume;
+}
+
+void TradeAnalytics::addToBucket(int64_t nTimestamp, int64_t nVolume, int64_t nPricedVolume, double dNotional, TradeSeries& ts) {
+
+	if (nTimestamp == FeedClock::TIME_INVALID)
+		return;
+
+	// Buckets start on a multiple of their length since epoch
+	if (ts.nBucketFirst == FeedClock::TIME_INVALID)
+		ts.nBucketFirst = nTimestamp - nTimestamp % ts.nBucketNs;
+
+	// A row earlier than the first bucket, out of the order of the merge, goes to the first bucket
+	uint64_t nBucket = (nTimestamp > ts.nBucketFirst) ? static_cast<uint64_t>((nTimestamp - ts.nBucketFirst) / ts.nBucketNs) : 0;
+
+	// A time past the maximum span, a corrupt clock far from the session, is only counted
+	if (nBucket >= m_nMaxBuckets) {
+		++ts.nBucketOutliers;
+		ts.nBucketOutlierVolume += nVolume;
+		return;
+	}
+	size_t iBucket = static_cast<size_t>(nBucket);
+
+	// The buckets without trades since the last one carry its running VWAP
+	if (iBucket >= ts.vBucketVolume.size()) {
+		double dLastVwap = ts.vRunningVwap.empty() ? NaN : ts.vRunningVwap.back();
+		ts.vBucketVolume.resize(iBucket + 1, 0);
+		ts.vBucketPricedVolume.resize(iBucket + 1, 0);
+		ts.vBucketNotional.resize(iBucket + 1, 0);
+		ts.vRunningVwap.resize(iBucket + 1, dLastVwap);
+	}
+
+	ts.vBucketVolume[iBucket] += nVolume;
+	ts.vBucketPricedVolume[iBucket] += nPricedVolume;
+	ts.vBucketNotional[iBucket] += dNotional;
+	if (ts.nPricedVolume > 0)
+		ts.vRunningVwap[iBucket] = getVwap(ts);
+}
+
+void TradeAnalytics::addRow(const OBRowFeed& obrf, TradeSeries& ts) {
+
+	// The first row only sets the volume traded before the feed starts
+	if (m_bFirst) {
+		m_bFirst = false;
+		m_nPrevVolume = obrf.nVolume;
+		ts.nFirstVolume = obrf.nVolume;
+		ts.nLastVolume = obrf.nVolume;
+		return;
+	}
+
+	// A fall of the accumulated volume starts a new session, the volume of the row was traded since its start
+	int64_t nTraded = obrf.nVolume - m_nPrevVolume;
+	m_nPrevVolume = obrf.nVolume;
+	ts.nLastVolume = obrf.nVolume;
+	if (nTraded < 0) {
+		++ts.nResets;
+		nTraded = obrf.nVolume;
+	}
+	if (nTraded <= 0)
+		return;
+
+	++ts.nTrades;
+	ts.nVolume += nTraded;
+
+	if (nTraded > obrf.pairLastTrade.second) {
+		++ts.nSplitTrades;
+		ts.nSplitVolume += nTraded - obrf.pairLastTrade.second;
+	}
+
+	// A row without a trade price still counts in the volume, but it can't be priced in the VWAP or the profile
+	long nPrice = obrf.pairLastTrade.first;
+	if (nPrice <= 0) {
+		++ts.nUnpricedTrades;
+		ts.nUnpricedVolume += nTraded;
+		addToBucket(obrf.nTimestamp, nTraded, 0, 0, ts);
+		return;
+	}
+
+	double dNotional = static_cast<double>(nPrice) * nTraded;
+	ts.nPricedVolume += nTraded;
+	ts.dNotional += dNotional;
+
+	addToProfile(nPrice, nTraded, ts);
+	addToBucket(obrf.nTimestamp, nTraded, nTraded, dNotional, ts);
+}
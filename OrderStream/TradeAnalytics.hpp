@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+
+#include "OrderStream.hpp"
+
+// Trade tape of a feed that carries its trades, the CSV feed: a trade is a rise of the accumulated volume from
+// one row to the next, of that volume at the latest trade price of the row. A rise larger than the latest trade
+// size means several prints went by between the two rows, they are counted to reconcile the tape with the
+// accumulated volume. Each trade updates in constant time the running VWAP, the volume profile, a dense array
+// with one slot per price step grown at either end when a price falls out of it, and the volume and notional
+// of its time bucket, buckets being aligned on the epoch so that the buckets of two feeds line up. The profile
+// never spans more than its maximum number of slots, a trade priced further away is counted as an outlier, and
+// likewise the buckets never span more than their maximum number.
+// It is a sink of the stream and the series it fills are in the TradeSeries of the order book.
+class TradeAnalytics : public OBSink {
+
+public:
+	TradeAnalytics() = delete;
+	TradeAnalytics(long nTickSize, int nBucketMs, size_t nMaxProfileSlots, size_t nMaxBuckets, TradeSeries& ts);
+
+	void onRow(const OBStream& obs, const OBRowFeed& obrf, int iRow)	{ addRow(obrf, m_ts); }
+
+	// Detect the trade of a row and add it to the series
+	void addRow(const OBRowFeed& obrf, TradeSeries& ts);
+
+	static double getVwap(const TradeSeries& ts)	{ return (ts.nPricedVolume > 0) ? ts.dNotional / ts.nPricedVolume : 0; }
+
+private:
+	void	addToProfile(long nPrice, int64_t nVolume, TradeSeries& ts);
+	void	addToBucket(int64_t nTimestamp, int64_t nVolume, int64_t nPricedVolume, double dNotional, TradeSeries& ts);
+
+private:
+	TradeSeries&	m_ts;
+	size_t			m_nMaxProfileSlots;
+	size_t			m_nMaxBuckets;
+	bool			m_bFirst;
+	int64_t			m_nPrevVolume;
+
+	static constexpr size_t PROFILE_MIN_SLOTS	= 64;
+};
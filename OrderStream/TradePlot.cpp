@@ -11,6 +11,9 @@
 #include <vector>
 #include <set>
 #include <fstream>
+#include <cmath>
+#include <limits>
+#include <algorithm>
 #include <boost/regex.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/foreach.hpp>
@@ -22,6 +25,10 @@
 #include <boost/multiprecision/cpp_dec_float.hpp>
 #include <boost/format.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include <boost/asio/post.hpp>
 
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/xml_parser.hpp>
@@ -32,13 +39,30 @@ using namespace boost;
 #include "OrderBook.hpp"
 #include "OrderStream.hpp"
 #include "TradePlot.hpp"
+#include "AllocProfiler.hpp"
 
 using boost::lexical_cast;
 using boost::bad_lexical_cast;
 
 const string szTradePlot("task1.tradeplot.");
 
-TradePlot::TradePlot(const string& szXml, OBStreamCSV& obsCsv, OBStreamLog& obsLog) {
+TradePlot::TradePlot(const string& szXml) {
+
+	// Setup the tree to parse the xml file
+	using namespace boost::property_tree::xml_parser;
+	read_xml(szXml, m_pt, trim_whitespace | no_comments);
+	const boost::property_tree::ptree& pt = m_pt;
+
+	m_szPlotFile	= pt.get<string>(szTradePlot + "file", "tradebar.htm");
+
+	// Sidecar file name defaults to the plot file name with a mode specific extension
+	m_eDataMode		= ChartDataWriter::getMode(pt.get<string>(szTradePlot + "data.mode", "inline"));
+	m_szDataFile	= pt.get<string>(szTradePlot + "data.file", "");
+	if (m_szDataFile.empty() && m_eDataMode != ChartDataWriter::DATA_INLINE)
+		m_szDataFile = m_szPlotFile.substr(0, m_szPlotFile.find_last_of('.')) + (m_eDataMode == ChartDataWriter::DATA_JSON ? ".data.js" : ".data.bin");
+}
+
+void TradePlot::onBooks(OBStreamCSV& obsCsv, OBStreamLog& obsLog) {
 
 	// Mke sure there is data to work with
 	m_pCsvBook = obsCsv.getOrderBook();
@@ -47,76 +71,166 @@ TradePlot::TradePlot(const string& szXml, OBStreamCSV& obsCsv, OBStreamLog& obsL
 	assert(m_pCsvBook);
 	assert(m_pLogBook);
 
-	// Setup the tree to parse the xml file
-	using namespace boost::property_tree::xml_parser;
-	using boost::property_tree::ptree;
-	ptree pt;
-	read_xml(szXml, pt, trim_whitespace | no_comments);
-
-	m_bConsoleOut	= pt.get<bool>(szTradePlot   + "console.output", false);
-	m_szConsoleLog	= pt.get<string>(szTradePlot + "console.diff", "feeddiff.log");
-	m_szPlotFile	= pt.get<string>(szTradePlot + "file", "tradebar.htm");
+	const boost::property_tree::ptree& pt = m_pt;
 
-	// Console out if needed
-	if (m_bConsoleOut) {
-		consoleOut(obsCsv, obsLog);
-	}
+	// Charts only read the two order books, compute them concurrently into html fragments
+	int nThreads = pt.get<int>(szTradePlot + "threads", 0);
+	if (nThreads <= 0)
+		nThreads = max(static_cast<int>(boost::thread::hardware_concurrency()), 1);
+	boost::asio::thread_pool tpCharts(nThreads);
 
 	InjectParams ijParams;
 	ijParams.szInstrCsv = m_pCsvBook->szInstrument;
 	ijParams.szInstrLog = m_pLogBook->szInstrument;
 	ijParams.szHtml = m_szPlotFile;
 
+	// Tell the page where its per row series are
+	ijParams.szHeader = "";
+	ijParams.szMarkerBegin = pt.get<string>(szTradePlot + "markers.begin_data_source", "begin chart data source");
+	ijParams.szMarkerEnd = pt.get<string>(szTradePlot + "markers.end_data_source", "end chart data source");
+	injectHtml(ijParams, vstring(1, string("\t\tvar chartDataSource = { mode: '") + ChartDataWriter::getModeName(m_eDataMode) + "', file: '" + m_szDataFile + "' };"));
+
 	// Plot the bid ask percentage variation from the CSV feed
 	ijParams.szHeader = "";
 	ijParams.szAny = "CSV";
 	ijParams.szMarkerBegin = pt.get<string>(szTradePlot + "markers.begin_csv_variation", "begin_h2_p_csv");
 	ijParams.szMarkerEnd = pt.get<string>(szTradePlot + "markers.markers.end_csv_variation", "end_h2_p_csv");
-	plotVariation(m_pCsvBook->szBidVariation, m_pCsvBook->szAskVariation, ijParams);
+	postChart(tpCharts, AllocProfiler::STAGE_PLOT_VARIATION, [this, ijParams]() mutable { plotVariation(m_pCsvBook->szBidVariation, m_pCsvBook->szAskVariation, ijParams); });
 
 	// Plot the bid ask percentage variation from the LOG feed
 	ijParams.szAny = "LOG";
 	ijParams.szMarkerBegin = pt.get<string>(szTradePlot + "markers.begin_log_variation", "begin_h2_p_log");
 	ijParams.szMarkerEnd = pt.get<string>(szTradePlot + "markers.markers.end_log_variation", "end_h2_p_log");
-	plotVariation(m_pLogBook->szBidVariation, m_pLogBook->szAskVariation, ijParams);
+	postChart(tpCharts, AllocProfiler::STAGE_PLOT_VARIATION, [this, ijParams]() mutable { plotVariation(m_pLogBook->szBidVariation, m_pLogBook->szAskVariation, ijParams); });
 
 	// Plot the CSV book order of bid ask offers as a stacked bar chart
 	ijParams.szHeader = "";
 	ijParams.nOfferDepth	= m_pCsvBook->nBookDepth;
 	ijParams.szMarkerBegin	= pt.get<string>(szTradePlot + "markers.begin_stackbar_csv_data_array", "begin stackbar csv data array");
 	ijParams.szMarkerEnd	= pt.get<string>(szTradePlot + "markers.end_stackbar_csv_data_array", "end stackbar csv order data array");
-	plotOrderBook(m_pCsvBook->priceOffers.bidOffers, m_pCsvBook->priceOffers.askOffers, ijParams);
+	postChart(tpCharts, AllocProfiler::STAGE_PLOT_ORDERBOOK, [this, ijParams]() mutable { plotOrderBook(m_pCsvBook->priceOffers.bidOffers, m_pCsvBook->priceOffers.askOffers, ijParams); });
 
 	// Plot the LOG book order of bid ask offers as a stacked bar chart
 	ijParams.szHeader = "";
 	ijParams.nOfferDepth = m_pCsvBook->nBookDepth;
 	ijParams.szMarkerBegin = pt.get<string>(szTradePlot + "markers.begin_stackbar_log_data_array", "begin stackbar log data array");
 	ijParams.szMarkerEnd = pt.get<string>(szTradePlot + "markers.end_stackbar_log_data_array", "end stackbar log data array");
-	plotOrderBook(m_pLogBook->priceOffers.bidOffers, m_pLogBook->priceOffers.askOffers, ijParams);
+	postChart(tpCharts, AllocProfiler::STAGE_PLOT_ORDERBOOK, [this, ijParams]() mutable { plotOrderBook(m_pLogBook->priceOffers.bidOffers, m_pLogBook->priceOffers.askOffers, ijParams); });
 
 	// Plot the order difference
 	ijParams.szHeader = "";
 	ijParams.szMarkerBegin = pt.get<string>(szTradePlot + "markers.begin_order_diff_data_array", "begin order diff data array");
 	ijParams.szMarkerEnd = pt.get<string>(szTradePlot + "markers.end_order_diff_data_array", "end order diff data array");
-	plotOrderDiff(m_pCsvBook->priceOffers.bidOffers, m_pLogBook->priceOffers.bidOffers, m_pCsvBook->priceOffers.askOffers, m_pLogBook->priceOffers.askOffers, ijParams);
+	postChart(tpCharts, AllocProfiler::STAGE_PLOT_ORDERDIFF, [this, ijParams]() mutable { plotOrderDiff(m_pCsvBook->priceOffers.bidOffers, m_pLogBook->priceOffers.bidOffers, m_pCsvBook->priceOffers.askOffers, m_pLogBook->priceOffers.askOffers, ijParams); });
 
 	// Plot the spread
 	ijParams.szHeader = "";
 	ijParams.szMarkerBegin = pt.get<string>(szTradePlot + "markers.begin_spread_data_array", "begin spread data array");
 	ijParams.szMarkerEnd = pt.get<string>(szTradePlot + "markers.end_spread_data_array", "end spread data array");
-	plotSpread(m_pCsvBook->vSpread, m_pLogBook->vSpread, ijParams);
+	postChart(tpCharts, AllocProfiler::STAGE_PLOT_SPREAD, [this, ijParams]() mutable { plotSpread(m_pCsvBook->series.column(SeriesStore::SERIES_SPREAD), m_pLogBook->series.column(SeriesStore::SERIES_SPREAD), ijParams); });
 
 	// Plot the price variation
 	ijParams.szHeader = "Bid Ask Price Percentage";
 	ijParams.szMarkerBegin = pt.get<string>(szTradePlot + "markers.begin_pie_diff_data_array", "begin pie diff data array");
 	ijParams.szMarkerEnd = pt.get<string>(szTradePlot + "markers.end_pie_diff_data_array", "end pie diff data array");
-	plotPriceDiff(m_pCsvBook->vBidAsk, m_pLogBook->vBidAsk, ijParams);
+	postChart(tpCharts, AllocProfiler::STAGE_PLOT_PRICEDIFF, [this, ijParams]() mutable { plotPriceDiff(m_pCsvBook->series, m_pLogBook->series, ijParams); });
 
 	// Plot the last order feed
 	ijParams.szHeader = "Size";
 	ijParams.szMarkerBegin	= pt.get<string>(szTradePlot + "markers.begin_bar_size_data_array", "begin bar size data array");
 	ijParams.szMarkerEnd	= pt.get<string>(szTradePlot + "markers.end_bar_size_data_array", "end bar size data array");
-	plotWall(m_pCsvBook->lastOffer.mapBidSize, m_pCsvBook->lastOffer.mapAskSize, m_pLogBook->lastOffer.mapBidSize, m_pLogBook->lastOffer.mapAskSize, ijParams);
+	postChart(tpCharts, AllocProfiler::STAGE_PLOT_WALL, [this, ijParams]() mutable { plotWall(m_pCsvBook->lastOffer.mapBidSize, m_pCsvBook->lastOffer.mapAskSize, m_pLogBook->lastOffer.mapBidSize, m_pLogBook->lastOffer.mapAskSize, ijParams); });
+
+	// Plot and export the per row liquidity metrics when they were computed
+	if (!m_pCsvBook->liquidity.vTimestamp.empty() || !m_pLogBook->liquidity.vTimestamp.empty()) {
+
+		ijParams.szHeader = "";
+		ijParams.szMarkerBegin = pt.get<string>(szTradePlot + "markers.begin_liquidity_price_data_array", "begin liquidity price data array");
+		ijParams.szMarkerEnd = pt.get<string>(szTradePlot + "markers.end_liquidity_price_data_array", "end liquidity price data array");
+		postChart(tpCharts, AllocProfiler::STAGE_PLOT_LIQUIDITY, [this, ijParams]() mutable { plotLiquidity(m_pCsvBook->liquidity, m_pLogBook->liquidity, ijParams); });
+
+		string szExport = pt.get<string>(szTradePlot + "liquidity.export", "");
+		if (!szExport.empty())
+			postChart(tpCharts, AllocProfiler::STAGE_PLOT_LIQUIDITY, [this, szExport, &obsCsv, &obsLog]() { exportLiquidity(szExport, obsCsv, obsLog); });
+	}
+
+	// Plot the trade tape when a feed had trades
+	if (m_pCsvBook->trades.nTrades > 0 || m_pLogBook->trades.nTrades > 0) {
+
+		ijParams.szHeader = "";
+		ijParams.szMarkerBegin = pt.get<string>(szTradePlot + "markers.begin_trade_volume_data_array", "begin trade volume data array");
+		ijParams.szMarkerEnd = pt.get<string>(szTradePlot + "markers.end_trade_volume_data_array", "end trade volume data array");
+		postChart(tpCharts, AllocProfiler::STAGE_PLOT_TRADES, [this, ijParams]() mutable { plotTrades(m_pCsvBook->trades, m_pLogBook->trades, ijParams); });
+	}
+
+	// Plot the share of rows and time at each spread when the distributions were computed
+	if (m_pCsvBook->spreads.ssAll.shSpread.getRows() > 0 || m_pLogBook->spreads.ssAll.shSpread.getRows() > 0) {
+
+		ijParams.szHeader = "";
+		ijParams.szMarkerBegin = pt.get<string>(szTradePlot + "markers.begin_spread_histogram_data_array", "begin spread histogram data array");
+		ijParams.szMarkerEnd = pt.get<string>(szTradePlot + "markers.end_spread_histogram_data_array", "end spread histogram data array");
+		postChart(tpCharts, AllocProfiler::STAGE_PLOT_SPREAD, [this, ijParams]() mutable { plotSpreadDistribution(m_pCsvBook->spreads.ssAll.shSpread, m_pLogBook->spreads.ssAll.shSpread, ijParams); });
+	}
+
+	// Wait for all the charts and stop on the first one that failed
+	tpCharts.join();
+	if (!m_eei.szDesc.empty()) {
+		TracedException te(m_eei);
+		throw te;
+	}
+
+	// Write the per row series to their sidecar file
+	{
+		AllocScope as(AllocProfiler::STAGE_CHART_DATA);
+		ChartDataWriter cdw(m_szDataFile, m_eDataMode);
+		sort(m_vSeries.begin(), m_vSeries.end(), [](const ChartSeries& cs1, const ChartSeries& cs2) { return cs1.szName < cs2.szName; });
+		if (!cdw.write(m_vSeries)) {
+			TracedException te(SZ_TRADEPLOT_EXCEPTION, "Could not write chart data file " + m_szDataFile, "TradePlot");
+			throw te;
+		}
+	}
+
+	// Write all the chart fragments into the html template at once
+	assembleHtml(m_szPlotFile);
+}
+
+void TradePlot::addSeries(ChartSeries& cs) {
+
+	boost::lock_guard<boost::mutex> lock(m_mtxFragments);
+	m_vSeries.push_back(std::move(cs));
+}
+
+void TradePlot::postChart(boost::asio::thread_pool& tp, AllocProfiler::ALLOC_STAGE eStage, const boost::function<void()>& fnChart) {
+
+	boost::asio::post(tp, [this, eStage, fnChart]() {
+
+		// Stub to allocate function name at compile time
+		static const string SZ_TRADEPLOT_POSTCHART = "postChart";
+
+		AllocScope as(eStage);
+
+		// Keep the first failure for the constructor to rethrow once all charts are done
+		try {
+			fnChart();
+		}
+		catch (const TracedException& te) {
+			boost::lock_guard<boost::mutex> lock(m_mtxFragments);
+			if (m_eei.szDesc.empty())
+				m_eei = te.getExceptionInfo();
+		}
+		catch (const std::bad_alloc&) {
+			TracedException te(SZ_TRADEPLOT_EXCEPTION, TracedException::SZ_EXCEPTION_BADALLOC, SZ_TRADEPLOT_POSTCHART);
+			boost::lock_guard<boost::mutex> lock(m_mtxFragments);
+			if (m_eei.szDesc.empty())
+				m_eei = te.getExceptionInfo();
+		}
+		catch (...) {
+			TracedException te(SZ_TRADEPLOT_EXCEPTION, TracedException::SZ_EXCEPTION_UNEXPECTED, SZ_TRADEPLOT_POSTCHART);
+			boost::lock_guard<boost::mutex> lock(m_mtxFragments);
+			if (m_eei.szDesc.empty())
+				m_eei = te.getExceptionInfo();
+		}
+	});
 }
 
 void TradePlot::plotVariation(const string& szBid, const string& szAsk, InjectParams& ijParams) {
@@ -313,7 +427,7 @@ void TradePlot::plotOrderDiff(mapOffers& moCsvBid, mapOffers& moLogBid, mapOffer
 	injectHtml(ijParams, vArray);
 }
 
-void TradePlot::plotSpread(vector<int>& csvSpread, vector<int>& logSpread, InjectParams& ijParams) {
+void TradePlot::plotSpread(const SeriesColumn& csvSpread, const SeriesColumn& logSpread, InjectParams& ijParams) {
 
 	string szTemplate("\t\t\t[a,b,c],");
 	string szLab("a"), szBid("b"), szAsk("c");
@@ -323,6 +437,25 @@ void TradePlot::plotSpread(vector<int>& csvSpread, vector<int>& logSpread, Injec
 
 	assert(maxSpreads > 0);
 
+	// Send the spreads to the sidecar file, left over rows keep the last spread
+	if (m_eDataMode != ChartDataWriter::DATA_INLINE) {
+
+		ChartSeries cs;
+		cs.szName = "spread";
+		cs.vColumnNames = { "Spread CSV", "Spread LOG" };
+		cs.bInteger = true;
+		cs.vColumns.assign(2, vector<double>(maxSpreads, 0));
+
+		fill(cs.vColumns[0].begin(), cs.vColumns[0].end(), static_cast<double>(csvSpread.back()));
+		fill(cs.vColumns[1].begin(), cs.vColumns[1].end(), static_cast<double>(logSpread.back()));
+		csvSpread.forEach([&cs](size_t i, int64_t nSpread) { cs.vColumns[0][i] = static_cast<double>(nSpread); });
+		logSpread.forEach([&cs](size_t i, int64_t nSpread) { cs.vColumns[1][i] = static_cast<double>(nSpread); });
+
+		addSeries(cs);
+		injectHtml(ijParams, vstring());
+		return;
+	}
+
 	vector<string> vArray(maxSpreads, szTemplate);
 
 	// Remove lsst comma in last vector element
@@ -332,24 +465,23 @@ void TradePlot::plotSpread(vector<int>& csvSpread, vector<int>& logSpread, Injec
 		vArray.at(i).replace(vArray.at(i).find_first_of('a'), 1, boost::lexical_cast<string>(i));
 	}
 
-	for (vector<int>::iterator it = csvSpread.begin(); it != csvSpread.end(); ++it) {
-		int iPair = std::distance(csvSpread.begin(), it);
-		vArray.at(iPair).replace(vArray.at(iPair).find_first_of('b'), 1, boost::lexical_cast<string>(*it));
-	}
+	// Decode the spreads straight from the series of each feed
+	csvSpread.forEach([&vArray](size_t iPair, int64_t nSpread) {
+		vArray.at(iPair).replace(vArray.at(iPair).find_first_of('b'), 1, boost::lexical_cast<string>(nSpread));
+	});
 
-	for (vector<int>::iterator it = logSpread.begin(); it != logSpread.end(); ++it) {
-		int iPair = std::distance(logSpread.begin(), it);
-		vArray.at(iPair).replace(vArray.at(iPair).find_first_of('c'), 1, boost::lexical_cast<string>(*it));
-	}
+	logSpread.forEach([&vArray](size_t iPair, int64_t nSpread) {
+		vArray.at(iPair).replace(vArray.at(iPair).find_first_of('c'), 1, boost::lexical_cast<string>(nSpread));
+	});
 
 	// Initialize all left over spreads with last value
-	int nSpread = csvSpread.at(csvSpread.size() - 1);
+	int64_t nSpread = csvSpread.back();
 	boost::regex reb("b");
 	for (auto& data : vArray) {
 		data.assign(boost::regex_replace(data, reb, boost::lexical_cast<string>(nSpread)));
 	}
 
-	nSpread = logSpread.at(logSpread.size() - 1);
+	nSpread = logSpread.back();
 	boost::regex rec("c");
 	for (auto& data : vArray) {
 		data.assign(boost::regex_replace(data, rec, boost::lexical_cast<string>(nSpread)));
@@ -357,31 +489,16 @@ void TradePlot::plotSpread(vector<int>& csvSpread, vector<int>& logSpread, Injec
 	injectHtml(ijParams, vArray);
 }
 
-void TradePlot::plotPriceDiff(vecBidAsk& vBidAskCsv, vecBidAsk& vBidAskLog, InjectParams& ijParams) {
+void TradePlot::plotPriceDiff(const SeriesStore& csvSeries, const SeriesStore& logSeries, InjectParams& ijParams) {
 
 	// Build the header
 	ijParams.szHeader = "\t\t\t['Price', 'Percentage'],";
 
-	// Copy the bid ask prices as pair and skip bid ask considered invalid (either bid or ask at zero)
-	vector<long>csvAsk;
-	vector<long>csvBid;
-	vector<long>logBid;
-	vector<long>logAsk;
-
-	for (vecBidAsk::iterator vit = vBidAskCsv.begin(); vit != vBidAskCsv.end(); ++vit) {
-		
-		if (vit->first > 0 && vit->second > 0) {
-			csvBid.push_back(vit->first);
-			csvAsk.push_back(vit->second);
-		}
-	}
-
-	for (vecBidAsk::iterator vit = vBidAskLog.begin(); vit != vBidAskLog.end(); ++vit) {
-		if (vit->first > 0 && vit->second > 0) {
-			logBid.push_back(vit->first);
-			logAsk.push_back(vit->second);
-		}
-	}
+	// The series only hold valid bid ask (neither bid nor ask at zero), so the first and last quotes are read directly
+	const SeriesColumn& csvBid = csvSeries.column(SeriesStore::SERIES_BID);
+	const SeriesColumn& csvAsk = csvSeries.column(SeriesStore::SERIES_ASK);
+	const SeriesColumn& logBid = logSeries.column(SeriesStore::SERIES_BID);
+	const SeriesColumn& logAsk = logSeries.column(SeriesStore::SERIES_ASK);
 
 	// Pre-initialize the strings with the instruments
 	vector<string> vLabels;
@@ -453,16 +570,326 @@ void TradePlot::plotPriceDiff(vecBidAsk& vBidAskCsv, vecBidAsk& vBidAskLog, Inje
 	//long logAskSum = boost::accumulate(logAsk, 0);
 }
 
+string TradePlot::getChartValue(const vector<double>& vd, size_t i, int nPrecision) {
+
+	// Rows past the end of a feed or without a value are left as gaps in the chart
+	if (i >= vd.size() || std::isnan(vd[i]))
+		return "null";
+
+	stringstream ss;
+	ss << fixed << setprecision(nPrecision) << vd[i];
+	return ss.str();
+}
+
+void TradePlot::plotLiquidity(const LiquiditySeries& lsCsv, const LiquiditySeries& lsLog, InjectParams& ijParams) {
+
+	size_t maxRows = max(lsCsv.vTimestamp.size(), lsLog.vTimestamp.size());
+	assert(maxRows > 0);
+
+	// Send the metrics to the sidecar file, rows past the end of a feed are gaps
+	if (m_eDataMode != ChartDataWriter::DATA_INLINE) {
+
+		ChartSeries csPrice;
+		csPrice.szName = "liquidity_price";
+		csPrice.vColumnNames = { "Microprice CSV", "Microprice LOG", "Buy Clip CSV", "Buy Clip LOG", "Sell Clip CSV", "Sell Clip LOG" };
+		csPrice.bInteger = false;
+		for (const vector<double>* pvd : { &lsCsv.vMicroprice, &lsLog.vMicroprice, &lsCsv.vBuyFill, &lsLog.vBuyFill, &lsCsv.vSellFill, &lsLog.vSellFill }) {
+			csPrice.vColumns.push_back(*pvd);
+			csPrice.vColumns.back().resize(maxRows, numeric_limits<double>::quiet_NaN());
+		}
+
+		ChartSeries csImbalance;
+		csImbalance.szName = "liquidity_imbalance";
+		csImbalance.vColumnNames = { "Imbalance CSV", "Imbalance LOG" };
+		csImbalance.bInteger = false;
+		for (const vector<double>* pvd : { &lsCsv.vImbalance, &lsLog.vImbalance }) {
+			csImbalance.vColumns.push_back(*pvd);
+			csImbalance.vColumns.back().resize(maxRows, numeric_limits<double>::quiet_NaN());
+		}
+
+		addSeries(csPrice);
+		addSeries(csImbalance);
+
+		// Empty both inline arrays
+		injectHtml(ijParams, vstring());
+		boost::regex reMarkerPrice("price");
+		ijParams.szMarkerBegin.assign(boost::regex_replace(ijParams.szMarkerBegin, reMarkerPrice, "imbalance"));
+		ijParams.szMarkerEnd.assign(boost::regex_replace(ijParams.szMarkerEnd, reMarkerPrice, "imbalance"));
+		injectHtml(ijParams, vstring());
+		return;
+	}
+
+	//--------------------------------------------------------------------------------
+	// Inject the microprice and the clip fill prices of both feeds
+	//--------------------------------------------------------------------------------
+	vector<string> vArray;
+	vArray.reserve(maxRows);
+	for (size_t i = 0; i < maxRows; ++i) {
+
+		vArray.push_back("\t\t\t[" + boost::lexical_cast<string>(i) + ","
+			+ getChartValue(lsCsv.vMicroprice, i, 2) + "," + getChartValue(lsLog.vMicroprice, i, 2) + ","
+			+ getChartValue(lsCsv.vBuyFill, i, 2) + "," + getChartValue(lsLog.vBuyFill, i, 2) + ","
+			+ getChartValue(lsCsv.vSellFill, i, 2) + "," + getChartValue(lsLog.vSellFill, i, 2) + "],");
+	}
+	vArray.at(vArray.size() - 1).pop_back();
+	injectHtml(ijParams, vArray);
+
+	//--------------------------------------------------------------------------------
+	// Inject the order book imbalance of both feeds
+	//--------------------------------------------------------------------------------
+	// Swap 'price' marker identifier with 'imbalance'
+	boost::regex reMarkerPrice("price");
+	ijParams.szMarkerBegin.assign(boost::regex_replace(ijParams.szMarkerBegin, reMarkerPrice, "imbalance"));
+	ijParams.szMarkerEnd.assign(boost::regex_replace(ijParams.szMarkerEnd, reMarkerPrice, "imbalance"));
+
+	vArray.clear();
+	for (size_t i = 0; i < maxRows; ++i) {
+
+		vArray.push_back("\t\t\t[" + boost::lexical_cast<string>(i) + ","
+			+ getChartValue(lsCsv.vImbalance, i, 4) + "," + getChartValue(lsLog.vImbalance, i, 4) + "],");
+	}
+	vArray.at(vArray.size() - 1).pop_back();
+	injectHtml(ijParams, vArray);
+}
+
+void TradePlot::plotTrades(const TradeSeries& tsCsv, const TradeSeries& tsLog, InjectParams& ijParams) {
+
+	const double NaN = numeric_limits<double>::quiet_NaN();
+	const TradeSeries* vpts[2] = { &tsCsv, &tsLog };
+
+	// Both feeds share the bucket length, their buckets are aligned from the earliest one
+	int64_t nBucketNs = 1;
+	int64_t nBucketFirst = INT64_MAX;
+	for (const TradeSeries* pts : vpts) {
+		if (!pts->vBucketVolume.empty()) {
+			nBucketNs = pts->nBucketNs;
+			nBucketFirst = min(nBucketFirst, pts->nBucketFirst);
+		}
+	}
+
+	// Volume, VWAP of the bucket and running VWAP of each feed per bucket, gaps outside of the buckets of a feed
+	vector<vector<double>> vVolume(2), vVwap(2), vRunning(2);
+	size_t maxBuckets = 0;
+	for (size_t f = 0; f < 2; ++f) {
+
+		const TradeSeries& ts = *vpts[f];
+		if (ts.vBucketVolume.empty())
+			continue;
+
+		size_t iOffset = static_cast<size_t>((ts.nBucketFirst - nBucketFirst) / nBucketNs);
+		size_t nBuckets = iOffset + ts.vBucketVolume.size();
+		maxBuckets = max(maxBuckets, nBuckets);
+
+		vVolume[f].assign(nBuckets, NaN);
+		vVwap[f].assign(nBuckets, NaN);
+		vRunning[f].assign(nBuckets, NaN);
+		for (size_t i = 0; i < ts.vBucketVolume.size(); ++i) {
+			vVolume[f][iOffset + i] = static_cast<double>(ts.vBucketVolume[i]);
+			if (ts.vBucketPricedVolume[i] > 0)
+				vVwap[f][iOffset + i] = ts.vBucketNotional[i] / ts.vBucketPricedVolume[i];
+			vRunning[f][iOffset + i] = ts.vRunningVwap[i];
+		}
+	}
+
+	if (m_eDataMode != ChartDataWriter::DATA_INLINE) {
+
+		ChartSeries csVolume;
+		csVolume.szName = "trade_volume";
+		csVolume.vColumnNames = { "Volume CSV", "Volume LOG" };
+		csVolume.bInteger = false;
+		for (vector<double>& vd : vVolume) {
+			vd.resize(maxBuckets, NaN);
+			csVolume.vColumns.push_back(vd);
+		}
+
+		ChartSeries csVwap;
+		csVwap.szName = "trade_vwap";
+		csVwap.vColumnNames = { "VWAP CSV", "VWAP LOG", "Running VWAP CSV", "Running VWAP LOG" };
+		csVwap.bInteger = false;
+		for (vector<double>* pvd : { &vVwap[0], &vVwap[1], &vRunning[0], &vRunning[1] }) {
+			pvd->resize(maxBuckets, NaN);
+			csVwap.vColumns.push_back(*pvd);
+		}
+
+		addSeries(csVolume);
+		addSeries(csVwap);
+
+		// Empty both inline arrays
+		injectHtml(ijParams, vstring());
+		boost::regex reMarkerVolume("volume");
+		ijParams.szMarkerBegin.assign(boost::regex_replace(ijParams.szMarkerBegin, reMarkerVolume, "vwap"));
+		ijParams.szMarkerEnd.assign(boost::regex_replace(ijParams.szMarkerEnd, reMarkerVolume, "vwap"));
+		injectHtml(ijParams, vstring());
+	}
+	else {
+		//--------------------------------------------------------------------------------
+		// Inject the traded volume of each time bucket of both feeds
+		//--------------------------------------------------------------------------------
+		vector<string> vArray;
+		vArray.reserve(maxBuckets);
+		for (size_t i = 0; i < maxBuckets; ++i) {
+
+			vArray.push_back("\t\t\t[" + boost::lexical_cast<string>(i) + ","
+				+ getChartValue(vVolume[0], i, 0) + "," + getChartValue(vVolume[1], i, 0) + "],");
+		}
+		if (!vArray.empty())
+			vArray.back().pop_back();
+		injectHtml(ijParams, vArray);
+
+		//--------------------------------------------------------------------------------
+		// Inject the VWAP of each time bucket and the running VWAP of both feeds
+		//--------------------------------------------------------------------------------
+		// Swap 'volume' marker identifier with 'vwap'
+		boost::regex reMarkerVolume("volume");
+		ijParams.szMarkerBegin.assign(boost::regex_replace(ijParams.szMarkerBegin, reMarkerVolume, "vwap"));
+		ijParams.szMarkerEnd.assign(boost::regex_replace(ijParams.szMarkerEnd, reMarkerVolume, "vwap"));
+
+		vArray.clear();
+		for (size_t i = 0; i < maxBuckets; ++i) {
+
+			vArray.push_back("\t\t\t[" + boost::lexical_cast<string>(i) + ","
+				+ getChartValue(vVwap[0], i, 2) + "," + getChartValue(vVwap[1], i, 2) + ","
+				+ getChartValue(vRunning[0], i, 2) + "," + getChartValue(vRunning[1], i, 2) + "],");
+		}
+		if (!vArray.empty())
+			vArray.back().pop_back();
+		injectHtml(ijParams, vArray);
+	}
+
+	//--------------------------------------------------------------------------------
+	// Inject the volume profile of both feeds, only the prices that traded
+	//--------------------------------------------------------------------------------
+	// Swap 'vwap' marker identifier with 'profile'
+	boost::regex reMarkerVwap("vwap");
+	ijParams.szMarkerBegin.assign(boost::regex_replace(ijParams.szMarkerBegin, reMarkerVwap, "profile"));
+	ijParams.szMarkerEnd.assign(boost::regex_replace(ijParams.szMarkerEnd, reMarkerVwap, "profile"));
+
+	// The profiles have the same price step, walk the prices both of them cover
+	long nTickSize = max(tsCsv.nTickSize, tsLog.nTickSize);
+	long nPriceFirst = numeric_limits<long>::max();
+	long nPriceLast = numeric_limits<long>::min();
+	for (const TradeSeries* pts : vpts) {
+		if (!pts->vProfile.empty()) {
+			nPriceFirst = min(nPriceFirst, pts->nProfileFirst);
+			nPriceLast = max(nPriceLast, pts->nProfileFirst + static_cast<long>(pts->vProfile.size() - 1) * pts->nTickSize);
+		}
+	}
+
+	auto getProfile = [](const TradeSeries& ts, long nPrice) -> int64_t {
+		if (ts.vProfile.empty() || nPrice < ts.nProfileFirst)
+			return 0;
+		size_t iSlot = static_cast<size_t>((nPrice - ts.nProfileFirst) / ts.nTickSize);
+		return (iSlot < ts.vProfile.size()) ? ts.vProfile[iSlot] : 0;
+	};
+
+	vector<string> vArray;
+	for (long nPrice = nPriceFirst; nPrice <= nPriceLast; nPrice += nTickSize) {
+
+		int64_t nVolumeCsv = getProfile(tsCsv, nPrice);
+		int64_t nVolumeLog = getProfile(tsLog, nPrice);
+		if (nVolumeCsv == 0 && nVolumeLog == 0)
+			continue;
+
+		vArray.push_back("\t\t\t[" + boost::lexical_cast<string>(nPrice) + "," + boost::lexical_cast<string>(nVolumeCsv) + ","
+			+ boost::lexical_cast<string>(nVolumeLog) + "],");
+	}
+	if (!vArray.empty())
+		vArray.back().pop_back();
+	injectHtml(ijParams, vArray);
+}
+
+void TradePlot::plotSpreadDistribution(const SpreadHistogram& shCsv, const SpreadHistogram& shLog, InjectParams& ijParams) {
+
+	// Percentage of the rows and of the time of a feed at a spread, a gap when the feed has none
+	auto getShare = [](uint64_t nPart, uint64_t nTotal) -> string {
+		if (nTotal == 0)
+			return "null";
+		stringstream ss;
+		ss << fixed << setprecision(2) << 100.0 * nPart / nTotal;
+		return ss.str();
+	};
+
+	vector<string> vArray;
+	size_t maxBuckets = max(shCsv.size(), shLog.size());
+	for (size_t i = 0; i < maxBuckets; ++i) {
+
+		uint64_t nRowsCsv = (i < shCsv.size()) ? shCsv.getRows(i) : 0;
+		uint64_t nRowsLog = (i < shLog.size()) ? shLog.getRows(i) : 0;
+		if (nRowsCsv == 0 && nRowsLog == 0)
+			continue;
+
+		int64_t nTimeCsv = (i < shCsv.size()) ? shCsv.getTimeNs(i) : 0;
+		int64_t nTimeLog = (i < shLog.size()) ? shLog.getTimeNs(i) : 0;
+
+		vArray.push_back("\t\t\t[" + boost::lexical_cast<string>(i) + ","
+			+ getShare(nRowsCsv, shCsv.getRows()) + "," + getShare(nRowsLog, shLog.getRows()) + ","
+			+ getShare(nTimeCsv, shCsv.getTimeNs()) + "," + getShare(nTimeLog, shLog.getTimeNs()) + "],");
+	}
+	if (!vArray.empty())
+		vArray.back().pop_back();
+	injectHtml(ijParams, vArray);
+}
+
+void TradePlot::exportLiquidity(const string& szFile, const OBStream& obsCsv, const OBStream& obsLog) {
+
+	ofstream ofs(szFile);
+	if (!ofs.is_open()) {
+		cout << " Liquidity export " << szFile << " could not be written." << endl;
+		return;
+	}
+
+	ofs << "Source,Row,TimeUtc,BidDepth,AskDepth,BuyFill,SellFill,Imbalance,Microprice" << endl;
+
+	// One line per row of each feed, empty values where the book was too thin
+	const pair<const OBStream*, const LiquiditySeries*> feeds[] = { { &obsCsv, &m_pCsvBook->liquidity }, { &obsLog, &m_pLogBook->liquidity } };
+
+	for (auto& feed : feeds) {
+
+		const OBStream* pobs = feed.first;
+		const LiquiditySeries& ls = *feed.second;
+
+		for (size_t i = 0; i < ls.vTimestamp.size(); ++i) {
+
+			ofs << pobs->getSourceFile() << ',' << i << ',' << FeedClock::format(ls.vTimestamp[i]) << ','
+				<< ls.vBidDepth[i] << ',' << ls.vAskDepth[i];
+
+			for (const vector<double>* pvd : { &ls.vBuyFill, &ls.vSellFill, &ls.vImbalance, &ls.vMicroprice }) {
+				string szValue = getChartValue(*pvd, i, pvd == &ls.vImbalance ? 4 : 2);
+				ofs << ',' << (szValue == "null" ? "" : szValue);
+			}
+			ofs << endl;
+		}
+	}
+	ofs.close();
+}
+
 void TradePlot::plotVolatility(InjectParams& ijParams) {
 
 }
 
 void TradePlot::injectHtml(const InjectParams& ijParams, const vstring& vs)
 {
+	AllocScope as(AllocProfiler::STAGE_INJECT_HTML);
+
+	// Keep the chart data until all the charts are computed, the template is only rewritten once
+	HtmlFragment hf;
+	hf.szMarkerBegin	= ijParams.szMarkerBegin;
+	hf.szMarkerEnd		= ijParams.szMarkerEnd;
+	hf.szHeader			= ijParams.szHeader;
+	hf.vLines			= vs;
+
+	boost::lock_guard<boost::mutex> lock(m_mtxFragments);
+	m_vFragments.push_back(std::move(hf));
+}
+
+void TradePlot::assembleHtml(const string& szHtml)
+{
+	AllocScope as(AllocProfiler::STAGE_ASSEMBLE_HTML);
+
 	// Now inject the built columns in the html
 	vstring vHtml;
 
-	ifstream file(ijParams.szHtml);
+	ifstream file(szHtml);
 	string line;
 
 	// First read and parse all the html lines
@@ -473,39 +900,50 @@ void TradePlot::injectHtml(const InjectParams& ijParams, const vstring& vs)
 	// We are done
 	file.close();
 
-	// Inject the lines between the begin and section
-	ofstream ofs(ijParams.szHtml);
-	regex reBegin(ijParams.szMarkerBegin);
-	regex reEnd(ijParams.szMarkerEnd);
+	// Markers of every fragment
+	vector<regex> vreBegin, vreEnd;
+	for (auto& hf : m_vFragments) {
+		vreBegin.push_back(regex(hf.szMarkerBegin));
+		vreEnd.push_back(regex(hf.szMarkerEnd));
+	}
+
+	// Inject each fragment between its begin and end markers
+	ofstream ofs(szHtml);
 	smatch m;
 
-	bool bSkipNextLines = false;
+	int iSkipping = -1;
 
 	// Merge trade bars
 	for (auto& line : vHtml)
 	{
-		if (regex_search(line, m, reEnd) == true) {
-			bSkipNextLines = false;
+		if (iSkipping >= 0 && regex_search(line, m, vreEnd[iSkipping]) == true) {
+			iSkipping = -1;
 		}
 
-		if (bSkipNextLines == true)
+		if (iSkipping >= 0)
 			continue;
 
 		ofs << line << endl;
 
-		if (regex_search(line, m, reBegin) == true) {
+		for (size_t i = 0; i < m_vFragments.size(); ++i) {
+
+			if (regex_search(line, m, vreBegin[i]) == false)
+				continue;
+
+			const HtmlFragment& hf = m_vFragments[i];
 
 			// Inject header if any
-			if (ijParams.szHeader.empty() == false) 
-				ofs << ijParams.szHeader << endl;
+			if (hf.szHeader.empty() == false)
+				ofs << hf.szHeader << endl;
 
 			// Inject data array
-			for (auto& it : vs) {
+			for (auto& it : hf.vLines) {
 				ofs << it << endl;
 			}
 
 			// Skip the lines until the end marker line
-			bSkipNextLines = true;
+			iSkipping = static_cast<int>(i);
+			break;
 		}
 	}
 	ofs.close();
@@ -565,86 +1003,3 @@ void TradePlot::plotWall(mapKeyVal& mkvBidCsv, mapKeyVal& mkvAskCsv, mapKeyVal&
 	injectHtml(ijParams, vArray);
 }
 
-
-string TradePlot::getFormattedStream(const string& szFeedName, const OBRowFeed& obrf, const string& szFormat)
-{
-	stringstream ss, ssleft, ssright, ssbid, ssask, ssBidQty, ssAskQty, ssBookBid, ssBookAsk;
-
-	vector<pairPriceSize> vBid = obrf.vecBidLevels;
-	vector<pairPriceSize> vAsk = obrf.vecAskLevels;
-
-	ssBidQty << boost::lexical_cast<string>(obrf.pairBidPriceSize.first) << ',';
-	ssBidQty << boost::lexical_cast<string>(obrf.pairBidPriceSize.second);
-	ssAskQty << boost::lexical_cast<string>(obrf.pairAskPriceSize.first) << ',';
-	ssAskQty << boost::lexical_cast<string>(obrf.pairAskPriceSize.second);
-
-	//pairPriceSize lp;
-
-	for (vector<pairPriceSize>::iterator it = vBid.begin(); it != vBid.end(); ++it) {
-
-		pairPriceSize lp = *it;
-
-		if (it != vBid.begin()) {
-			ssBookBid << ';';
-		}
-
-		ssBookBid << boost::lexical_cast<string>(lp.first) << ',';
-		ssBookBid << boost::lexical_cast<string>(lp.second);
-	}
-
-	for (vector<pairPriceSize>::iterator it = vAsk.begin(); it != vAsk.end(); ++it) {
-
-		pairPriceSize lp = *it;
-
-		if (it != vAsk.begin()) {
-			ssBookAsk << ';';
-		}
-
-		ssBookAsk << boost::lexical_cast<string>(lp.first) << ',';
-		ssBookAsk << boost::lexical_cast<string>(lp.second);
-	}
-
-	// Build the stream of Bid and Ask order books
-	ss << boost::format(szFormat) \
-		% szFeedName % obrf.szInstrument %obrf.datetime %obrf.szFeedStat % ssBidQty.str() % ssAskQty.str() % ssBookBid.str() % ssBookAsk.str();
-
-	return ss.str();
-}
-
-void TradePlot::consoleOut(OBStreamCSV& obsCsv, OBStreamLog& obsLog) {
-
-	// Layout the line feeds from each stream sources one below another for comparison
-	// The rows are interleaved between files one showing on top of another with an extra CR/LF for clarity.
-
-	int nMinRows = min(obsCsv.getNumRows(), obsLog.getNumRows());
-
-	ofstream ofsDiff(m_szConsoleLog);
-
-	const string szFormatHead = "%1%   %|12t| %2% %|28t|%3% %|52t|%4% %|66t|%5%      %|83t|%6%     %|101t|%7%         %|160t|%8%\n";
-	const string szFormatLine = "[%1%] %|12t| %2% %|28t|%3% %|52t|%4% %|66t|Bid{%5%} %|83t|Ask{%6%}%|101t|BookBid{%7%}%|160t|BookAsk{%8%}\n";
-
-	stringstream sshead;
-	sshead << boost::format(szFormatHead) % "Source" % "Instrument" % "DateTime" % "Stat" % "Bid" % "Ask" % "BookBid" % "BookAsk";
-	ofsDiff << sshead.str();
-	cout << sshead.str();
-
-	string szLine1, szLine2;
-
-	// Loop through all the feed records
-	for (int i : boost::irange(0, nMinRows)) {
-
-		szLine1 = getFormattedStream(obsCsv.getSourceFile(), obsCsv.getRowFeedAt(i), szFormatLine);
-		szLine2 = getFormattedStream(obsLog.getSourceFile(), obsLog.getRowFeedAt(i), szFormatLine);
-
-		// Separate each line with an extra blank line
-		ofsDiff << szLine1;
-		ofsDiff << szLine2 << endl;
-
-		// Write to console for quick view
-		cout << szLine1;
-		cout << szLine2 << endl;
-	}
-
-	// Release the output file
-	ofsDiff.close();
-}
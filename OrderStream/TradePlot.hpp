@@ -1,5 +1,9 @@
 #pragma once
 
+#include <boost/property_tree/ptree.hpp>
+
+#include "ChartData.hpp"
+
 typedef struct InjectParams {
 
 	string		szInstrCsv;
@@ -19,34 +23,64 @@ typedef struct InjectParams {
 } InjectParams;
 
 
-// Base class
-class TradePlot {
+typedef struct HtmlFragment {
+
+	string		szMarkerBegin;
+	string		szMarkerEnd;
+	string		szHeader;
+	vstring		vLines;
+
+} HtmlFragment;
+
+
+// Plots both streams to the html page once both of their books are complete
+class TradePlot : public OBPairSink {
 
 public:
 	// Chart plotting interface methds
 	TradePlot() = delete;
-	explicit TradePlot(const string& szXmlFile, OBStreamCSV& obsCsv, OBStreamLog& obsLog);
+	explicit TradePlot(const string& szXmlFile);
 
 	const string& getPlotFile() const { return m_szPlotFile; }
 
+protected:
+	void	onBooks(OBStreamCSV& obsCsv, OBStreamLog& obsLog);
+
 private:
 	void	plotOrderBook(mapOffers& moBid, mapOffers& moAsk, InjectParams& ijParams);
 	void	plotOrderDiff(mapOffers& moCsvBid, mapOffers& moLogBid, mapOffers& moCsvAsk, mapOffers& moLogAsk, InjectParams& ijParams);
-	void	plotSpread(vector<int>& csvSpread, vector<int>& logSpread, InjectParams& ijParams);
-	void	plotPriceDiff(vecBidAsk& vBidAskCsv, vecBidAsk& vBidAskLog, InjectParams& ijParams);
+	void	plotSpread(const SeriesColumn& csvSpread, const SeriesColumn& logSpread, InjectParams& ijParams);
+	void	plotPriceDiff(const SeriesStore& csvSeries, const SeriesStore& logSeries, InjectParams& ijParams);
 	void	plotVolatility(InjectParams& ijParams);
 	void	plotWall(mapKeyVal& mkvBidCsv, mapKeyVal& mkvAskCsv, mapKeyVal& mkvBidLog, mapKeyVal& mkvAskLog, InjectParams& ijParams);
 	void	plotVariation(const string& szBid, const string& szAsk, InjectParams& ijParams);
+	void	plotLiquidity(const LiquiditySeries& lsCsv, const LiquiditySeries& lsLog, InjectParams& ijParams);
+	void	exportLiquidity(const string& szFile, const OBStream& obsCsv, const OBStream& obsLog);
+	void	plotTrades(const TradeSeries& tsCsv, const TradeSeries& tsLog, InjectParams& ijParams);
+	void	plotSpreadDistribution(const SpreadHistogram& shCsv, const SpreadHistogram& shLog, InjectParams& ijParams);
 
-	void	consoleOut(OBStreamCSV& obsCsv, OBStreamLog& obsLog);
-	string	getFormattedStream(const string& szFeedName, const OBRowFeed& obrf, const string& szFormat);
+	string	getChartValue(const vector<double>& vd, size_t i, int nPrecision);
 	void	injectHtml(const InjectParams& ijParams, const vstring& vs);
+	void	assembleHtml(const string& szHtml);
+	void	postChart(boost::asio::thread_pool& tp, AllocProfiler::ALLOC_STAGE eStage, const boost::function<void()>& fnChart);
+	void	addSeries(ChartSeries& cs);
 
 private:
+	boost::property_tree::ptree	m_pt;
 	string	m_szPlotFile;
-	string	m_szConsoleLog;
-	bool	m_bConsoleOut;
+
+	// Per row series go to a sidecar data file unless they are inlined in the page
+	ChartDataWriter::DATA_MODE	m_eDataMode;
+	string						m_szDataFile;
 
 	boost::shared_ptr<OrderBook> m_pCsvBook;
 	boost::shared_ptr<OrderBook> m_pLogBook;
+
+	// Chart fragments computed on the thread pool and the first chart failure
+	vector<HtmlFragment>	m_vFragments;
+	vector<ChartSeries>		m_vSeries;
+	boost::mutex			m_mtxFragments;
+	ErrorExceptionInfo		m_eei;
+
+	static constexpr auto SZ_TRADEPLOT_EXCEPTION = "TradePlot Exception";
 };